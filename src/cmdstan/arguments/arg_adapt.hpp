@@ -35,6 +35,11 @@ class arg_adapt : public categorical_argument {
         "window", "Initial width of slow adaptation interval", 25));
     _subarguments.push_back(
         new arg_single_bool("save_metric", "Save metric as JSON?", false));
+    _subarguments.push_back(new arg_single_string(
+        "warm_start",
+        "Stan CSV output of a previous run from which to take each chain's "
+        "step size, metric, and initial values",
+        ""));
   }
 };
 
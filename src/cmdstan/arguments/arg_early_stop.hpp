@@ -0,0 +1,29 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_EARLY_STOP_HPP
+#define CMDSTAN_ARGUMENTS_ARG_EARLY_STOP_HPP
+
+#include <cmdstan/arguments/categorical_argument.hpp>
+#include <cmdstan/arguments/arg_single_bool.hpp>
+#include <cmdstan/arguments/arg_single_int_pos.hpp>
+#include <cmdstan/arguments/arg_single_real_pos.hpp>
+
+namespace cmdstan {
+
+class arg_early_stop : public categorical_argument {
+ public:
+  arg_early_stop() {
+    _name = "early_stop";
+    _description = "Stop sampling once the chains have converged";
+
+    _subarguments.push_back(
+        new arg_single_bool("engaged", "Early stopping engaged?", false));
+    _subarguments.push_back(new arg_single_real_pos(
+        "rhat", "Target for the largest rank-normalized split R-hat", 1.01));
+    _subarguments.push_back(new arg_single_real_pos(
+        "ess", "Target for the smallest bulk effective sample size", 400));
+    _subarguments.push_back(new arg_single_int_pos(
+        "check_every", "Period in sampling iterations between checks", 100));
+  }
+};
+
+}  // namespace cmdstan
+#endif
@@ -26,6 +26,11 @@ class arg_laplace : public categorical_argument {
                             true));
     _subarguments.push_back(new arg_single_int_nonneg(
         "draws", "Number of draws from the laplace approximation", 1000));
+    _subarguments.push_back(new arg_single_string(
+        "hessian_file",
+        "Binary file in which to save the Hessian at the mode, "
+        "reused by later runs with the same model, data, mode and jacobian",
+        ""));
   }
 };
 
@@ -4,6 +4,7 @@
 #include <cmdstan/arguments/arg_log_prob_unconstrained_params.hpp>
 #include <cmdstan/arguments/arg_log_prob_constrained_params.hpp>
 #include <cmdstan/arguments/arg_single_bool.hpp>
+#include <cmdstan/arguments/arg_single_string.hpp>
 #include <cmdstan/arguments/categorical_argument.hpp>
 
 namespace cmdstan {
@@ -28,6 +29,11 @@ class arg_log_prob : public categorical_argument {
                             "When true, include change-of-variables adjustment"
                             " for constraining parameter transforms",
                             true));
+    _subarguments.push_back(new arg_single_string(
+        "stream",
+        "Serve requests read from standard input, \"text\" or \"binary\","
+        " instead of reading a file of parameter values",
+        ""));
   }
 };
 
@@ -0,0 +1,25 @@
+#ifndef CMDSTAN_ARGUMENTS_ARG_MAX_RUNTIME_HPP
+#define CMDSTAN_ARGUMENTS_ARG_MAX_RUNTIME_HPP
+
+#include <cmdstan/arguments/singleton_argument.hpp>
+
+namespace cmdstan {
+
+class arg_max_runtime : public real_argument {
+ public:
+  arg_max_runtime() : real_argument() {
+    _name = "max_runtime";
+    _description
+        = "Maximum runtime in seconds, after which the algorithm stops at "
+          "the next iteration; 0 for no limit";
+    _validity = "0 <= max_runtime";
+    _default = "0";
+    _default_value = 0;
+    _value = _default_value;
+  }
+
+  bool is_valid(double value) { return value >= 0; }
+};
+
+}  // namespace cmdstan
+#endif
@@ -3,6 +3,8 @@
 
 #include <cmdstan/arguments/singleton_argument.hpp>
 #include <stan/math/prim/core/init_threadpool_tbb.hpp>
+#include <stdexcept>
+#include <string>
 
 namespace cmdstan {
 
@@ -32,5 +34,30 @@ class arg_num_threads : public int_argument {
 #endif
 };
 
+/**
+ * Parse the number of threads given to a mode which doesn't use the
+ * argument parser, e.g., serve, by the rule of the num_threads
+ * argument.  Without STAN_THREADS the autodiff stack is shared by all
+ * threads, so the only valid value is 1.  Throws an exception if the
+ * value is not valid.
+ *
+ * @param value number of threads
+ * @return number of threads
+ */
+inline int parse_num_threads(const std::string &value) {
+  arg_num_threads arg;
+  size_t end = 0;
+  int num_threads = 0;
+  try {
+    num_threads = std::stoi(value, &end);
+  } catch (const std::logic_error &e) {
+  }
+  if (end == 0 || end != value.size() || !arg.set_value(num_threads))
+    throw std::invalid_argument(value
+                                + " is not a valid value for \"num_threads\"."
+                                + " Valid values:" + arg.print_valid());
+  return num_threads;
+}
+
 }  // namespace cmdstan
 #endif
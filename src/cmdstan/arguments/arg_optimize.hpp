@@ -24,6 +24,8 @@ class arg_optimize : public categorical_argument {
         new arg_single_int_pos("iter", "Total number of iterations", 2000));
     _subarguments.push_back(new arg_single_bool(
         "save_iterations", "Stream optimization progress to output?", false));
+    _subarguments.push_back(new arg_single_int_pos(
+        "num_chains", "Number of independent optimization runs", 1));
   }
 };
 
@@ -7,6 +7,8 @@
 #include <cmdstan/arguments/arg_profile_file.hpp>
 #include <cmdstan/arguments/arg_refresh.hpp>
 #include <cmdstan/arguments/arg_single_bool.hpp>
+#include <cmdstan/arguments/arg_single_int_pos.hpp>
+#include <cmdstan/arguments/arg_single_string.hpp>
 #include <cmdstan/arguments/categorical_argument.hpp>
 
 namespace cmdstan {
@@ -27,6 +29,15 @@ class arg_output : public categorical_argument {
         "Save the CmdStan configuration (parsed arguments + default values) as "
         "JSON alongside the output files",
         false));
+    _subarguments.push_back(new arg_single_string(
+        "shm",
+        "Also publish the draws of each chain in a POSIX shared memory "
+        "ring buffer with this name, suffixed by the chain id if there "
+        "are several chains",
+        ""));
+    _subarguments.push_back(new arg_single_int_pos(
+        "shm_rows", "Number of draws held by each shared memory ring buffer",
+        4096));
   }
 };
 
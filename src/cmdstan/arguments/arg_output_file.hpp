@@ -9,7 +9,8 @@ class arg_output_file : public string_argument {
  public:
   arg_output_file() : string_argument() {
     _name = "file";
-    _description = "Output file";
+    _description
+        = "Output file, \"-\" for standard output, or a named pipe";
     _validity = "Path to existing file";
     _default = "output.csv";
     _default_value = "output.csv";
@@ -2,10 +2,12 @@
 #define CMDSTAN_ARGUMENTS_ARG_SAMPLE_HPP
 
 #include <cmdstan/arguments/arg_adapt.hpp>
+#include <cmdstan/arguments/arg_early_stop.hpp>
 #include <cmdstan/arguments/arg_sample_algo.hpp>
 #include <cmdstan/arguments/arg_single_bool.hpp>
 #include <cmdstan/arguments/arg_single_int_nonneg.hpp>
 #include <cmdstan/arguments/arg_single_int_pos.hpp>
+#include <cmdstan/arguments/arg_single_string.hpp>
 #include <cmdstan/arguments/categorical_argument.hpp>
 
 namespace cmdstan {
@@ -27,6 +29,17 @@ class arg_sample : public categorical_argument {
     _subarguments.push_back(new arg_sample_algo());
     _subarguments.push_back(
         new arg_single_int_pos("num_chains", "Number of chains", 1));
+    _subarguments.push_back(new arg_single_bool(
+        "pathfinder_init",
+        "Initialize chains and metric from multi-path pathfinder?", false));
+    _subarguments.push_back(new arg_single_int_nonneg(
+        "checkpoint_every",
+        "Period in iterations between checkpoints of the sampler state, "
+        "0 for none",
+        0));
+    _subarguments.push_back(new arg_single_string(
+        "resume", "Checkpoint file from which to resume a previous run", ""));
+    _subarguments.push_back(new arg_early_stop());
   }
 };
 
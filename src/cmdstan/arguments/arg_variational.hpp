@@ -48,6 +48,8 @@ class arg_variational : public categorical_argument {
     _subarguments.push_back(new arg_single_int_pos(
         "output_samples", output_draws::description().c_str(),
         output_draws::default_value()));
+    _subarguments.push_back(new arg_single_int_pos(
+        "num_chains", "Number of independent ADVI runs", 1));
   }
 };
 
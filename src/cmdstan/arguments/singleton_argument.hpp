@@ -9,15 +9,17 @@
 namespace cmdstan {
 
 namespace internal {
-void from_string(std::string &src, double &dest) { dest = std::stod(src); }
-void from_string(std::string &src, int &dest) { dest = std::stoi(src); }
-void from_string(std::string &src, long long int &dest) {
+inline void from_string(std::string &src, double &dest) {
+  dest = std::stod(src);
+}
+inline void from_string(std::string &src, int &dest) { dest = std::stoi(src); }
+inline void from_string(std::string &src, long long int &dest) {
   dest = std::stoll(src);
 }
-void from_string(std::string &src, unsigned int &dest) {
+inline void from_string(std::string &src, unsigned int &dest) {
   dest = std::stoul(src);
 }
-void from_string(std::string &src, bool &dest) {
+inline void from_string(std::string &src, bool &dest) {
   if (src == "true" || src == "1") {
     dest = true;
   } else if (src == "false" || src == "0") {
@@ -26,9 +28,9 @@ void from_string(std::string &src, bool &dest) {
     throw std::invalid_argument(std::string("invalid boolean value ") + src);
   }
 }
-void from_string(std::string &src, std::string &dest) { dest = src; }
+inline void from_string(std::string &src, std::string &dest) { dest = src; }
 
-std::string to_string(std::string &src) { return src; }
+inline std::string to_string(std::string &src) { return src; }
 template <typename T>
 std::string to_string(T &src) {
   return std::to_string(src);
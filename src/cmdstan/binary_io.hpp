@@ -0,0 +1,145 @@
+#ifndef CMDSTAN_BINARY_IO_HPP
+#define CMDSTAN_BINARY_IO_HPP
+
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Write a scalar value in native byte order.
+ *
+ * @tparam T arithmetic type
+ * @param out binary output stream
+ * @param x value to write
+ */
+template <typename T,
+          typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+inline void write_binary(std::ostream &out, const T &x) {
+  out.write(reinterpret_cast<const char *>(&x), sizeof(T));
+}
+
+/**
+ * Write a string as its length followed by its characters.
+ *
+ * @param out binary output stream
+ * @param x string to write
+ */
+inline void write_binary(std::ostream &out, const std::string &x) {
+  write_binary(out, static_cast<std::uint64_t>(x.size()));
+  out.write(x.data(), x.size());
+}
+
+/**
+ * Write a vector of strings as its length followed by each string.
+ *
+ * @param out binary output stream
+ * @param x strings to write
+ */
+inline void write_binary(std::ostream &out, const std::vector<std::string> &x) {
+  write_binary(out, static_cast<std::uint64_t>(x.size()));
+  for (const auto &s : x)
+    write_binary(out, s);
+}
+
+/**
+ * Write an Eigen matrix or vector as its dimensions followed by its
+ * values in column-major order.
+ *
+ * @tparam T scalar type
+ * @param out binary output stream
+ * @param x matrix to write
+ */
+template <typename T, int R, int C>
+inline void write_binary(std::ostream &out, const Eigen::Matrix<T, R, C> &x) {
+  write_binary(out, static_cast<std::uint64_t>(x.rows()));
+  write_binary(out, static_cast<std::uint64_t>(x.cols()));
+  out.write(reinterpret_cast<const char *>(x.data()), sizeof(T) * x.size());
+}
+
+/**
+ * Read a scalar value written by `write_binary`.
+ * Failures are reported through the stream state.
+ *
+ * @tparam T arithmetic type
+ * @param in binary input stream
+ * @param x value read
+ */
+template <typename T,
+          typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+inline void read_binary(std::istream &in, T &x) {
+  in.read(reinterpret_cast<char *>(&x), sizeof(T));
+}
+
+/**
+ * Read a string written by `write_binary`.
+ * Failures are reported through the stream state.
+ *
+ * @param in binary input stream
+ * @param x string read
+ */
+inline void read_binary(std::istream &in, std::string &x) {
+  std::uint64_t size = 0;
+  read_binary(in, size);
+  if (!in || size > (std::uint64_t{1} << 32)) {
+    in.setstate(std::ios::failbit);
+    return;
+  }
+  x.resize(size);
+  in.read(&x[0], size);
+}
+
+/**
+ * Read a vector of strings written by `write_binary`.
+ * Failures are reported through the stream state.
+ *
+ * @param in binary input stream
+ * @param x strings read
+ */
+inline void read_binary(std::istream &in, std::vector<std::string> &x) {
+  std::uint64_t size = 0;
+  read_binary(in, size);
+  if (!in || size > (std::uint64_t{1} << 32)) {
+    in.setstate(std::ios::failbit);
+    return;
+  }
+  x.resize(size);
+  for (auto &s : x) {
+    read_binary(in, s);
+    if (!in)
+      return;
+  }
+}
+
+/**
+ * Read an Eigen matrix or vector written by `write_binary`.
+ * Failures, including a dimension mismatch for fixed-size
+ * types, are reported through the stream state.
+ *
+ * @tparam T scalar type
+ * @param in binary input stream
+ * @param x matrix read
+ */
+template <typename T, int R, int C>
+inline void read_binary(std::istream &in, Eigen::Matrix<T, R, C> &x) {
+  std::uint64_t rows = 0;
+  std::uint64_t cols = 0;
+  read_binary(in, rows);
+  read_binary(in, cols);
+  if (!in || (R != Eigen::Dynamic && rows != R)
+      || (C != Eigen::Dynamic && cols != C)
+      || (cols > 0 && rows > (std::uint64_t{1} << 40) / sizeof(T) / cols)) {
+    in.setstate(std::ios::failbit);
+    return;
+  }
+  x.resize(rows, cols);
+  in.read(reinterpret_cast<char *>(x.data()), sizeof(T) * x.size());
+}
+
+}  // namespace cmdstan
+#endif
@@ -4,14 +4,22 @@
 #include <cmdstan/arguments/arg_data.hpp>
 #include <cmdstan/arguments/arg_id.hpp>
 #include <cmdstan/arguments/arg_init.hpp>
+#include <cmdstan/arguments/arg_max_runtime.hpp>
 #include <cmdstan/arguments/arg_output.hpp>
 #include <cmdstan/arguments/arg_num_threads.hpp>
 #include <cmdstan/arguments/arg_random.hpp>
 #include <cmdstan/arguments/arg_opencl.hpp>
 #include <cmdstan/arguments/arg_profile_file.hpp>
 #include <cmdstan/arguments/argument_parser.hpp>
+#include <cmdstan/command_context.hpp>
 #include <cmdstan/command_helper.hpp>
+#include <cmdstan/log_prob_stream.hpp>
+#include <cmdstan/model_cache.hpp>
+#include <cmdstan/output_stream.hpp>
+#include <cmdstan/stop_interrupt.hpp>
 #include <cmdstan/return_codes.hpp>
+#include <cmdstan/sample_checkpoint.hpp>
+#include <cmdstan/thread_pool.hpp>
 #include <cmdstan/write_model.hpp>
 #include <cmdstan/write_stan.hpp>
 #include <cmdstan/write_config.hpp>
@@ -29,29 +37,6 @@
 #include <stan/io/stan_csv_reader.hpp>
 #include <stan/io/json/json_data.hpp>
 #include <stan/model/model_base.hpp>
-#include <stan/services/diagnose/diagnose.hpp>
-#include <stan/services/experimental/advi/fullrank.hpp>
-#include <stan/services/experimental/advi/meanfield.hpp>
-#include <stan/services/optimize/bfgs.hpp>
-#include <stan/services/optimize/lbfgs.hpp>
-#include <stan/services/optimize/laplace_sample.hpp>
-#include <stan/services/optimize/newton.hpp>
-#include <stan/services/pathfinder/multi.hpp>
-#include <stan/services/pathfinder/single.hpp>
-#include <stan/services/sample/fixed_param.hpp>
-#include <stan/services/sample/hmc_nuts_dense_e.hpp>
-#include <stan/services/sample/hmc_nuts_dense_e_adapt.hpp>
-#include <stan/services/sample/hmc_nuts_diag_e.hpp>
-#include <stan/services/sample/hmc_nuts_diag_e_adapt.hpp>
-#include <stan/services/sample/hmc_nuts_unit_e.hpp>
-#include <stan/services/sample/hmc_nuts_unit_e_adapt.hpp>
-#include <stan/services/sample/hmc_static_dense_e.hpp>
-#include <stan/services/sample/hmc_static_dense_e_adapt.hpp>
-#include <stan/services/sample/hmc_static_diag_e.hpp>
-#include <stan/services/sample/hmc_static_diag_e_adapt.hpp>
-#include <stan/services/sample/hmc_static_unit_e.hpp>
-#include <stan/services/sample/hmc_static_unit_e_adapt.hpp>
-#include <stan/services/sample/standalone_gqs.hpp>
 #include <fstream>
 #include <iostream>
 #include <memory>
@@ -68,20 +53,32 @@
 #endif
 
 // forward declaration for function defined in another translation unit
-stan::model::model_base &new_model(stan::io::var_context &data_context,
-                                   unsigned int seed, std::ostream *msg_stream);
 stan::math::profile_map &get_stan_profile_data();
 
 namespace cmdstan {
 
 #ifdef STAN_MPI
-stan::math::mpi_cluster &get_mpi_cluster() {
+inline stan::math::mpi_cluster &get_mpi_cluster() {
   static stan::math::mpi_cluster cluster;
   return cluster;
 }
 #endif
 
-int command(int argc, const char *argv[]) {
+/**
+ * Run the method given by the command line arguments.
+ *
+ * @param argc number of arguments
+ * @param argv arguments
+ * @param models if not null, models of runs which give a seed are
+ *   taken from and added to this cache instead of being constructed
+ *   for this run only
+ * @param embedded whether the run is a job of serve or manifest, which
+ *   shares the standard streams and the thread pool of the process
+ *   with other jobs
+ * @return return code
+ */
+inline int command(int argc, const char *argv[],
+                   model_cache *models = nullptr, bool embedded = false) {
   stan::callbacks::stream_writer info(std::cout);
   stan::callbacks::stream_writer err(std::cerr);
   stan::callbacks::stream_logger logger(std::cout, std::cout, std::cout,
@@ -102,6 +99,7 @@ int command(int argc, const char *argv[]) {
   valid_arguments.push_back(new arg_random());
   valid_arguments.push_back(new arg_output());
   valid_arguments.push_back(new arg_num_threads());
+  valid_arguments.push_back(new arg_max_runtime());
 #ifdef STAN_OPENCL
   valid_arguments.push_back(new arg_opencl());
 #endif
@@ -119,6 +117,28 @@ int command(int argc, const char *argv[]) {
   if (parser.help_printed())
     return return_codes::OK;
 
+  // log_prob stream mode responds on standard output, and output
+  // file "-" writes the output there, so all other output goes to
+  // standard error
+  std::string log_prob_stream;
+  if (parser.arg("method")->arg("log_prob"))
+    log_prob_stream = get_arg_val<string_argument>(parser, "method",
+                                                   "log_prob", "stream");
+  bool stdout_output
+      = get_arg_val<string_argument>(parser, "output", "file") == "-";
+  std::ostream responses(std::cout.rdbuf());
+  std::unique_ptr<internal::rdbuf_guard> console_guard;
+  if (!log_prob_stream.empty() || stdout_output) {
+    if (embedded)
+      throw std::invalid_argument(
+          !log_prob_stream.empty()
+              ? "log_prob stream mode can't be run by serve or manifest"
+              : "Output to standard output can't be run by serve or "
+                "manifest");
+    console_guard.reset(new internal::rdbuf_guard{
+        std::cout, std::cout.rdbuf(std::cerr.rdbuf())});
+  }
+
 #ifdef STAN_OPENCL
   int opencl_device_id = get_arg_val<int_argument>(parser, "opencl", "device");
   int opencl_platform_id
@@ -134,9 +154,10 @@ int command(int argc, const char *argv[]) {
 #endif
 
   int num_threads = get_arg_val<int_argument>(parser, "num_threads");
-  // Need to make sure these two ways to set thread # match.
+  // Need to make sure these two ways to set thread # match.  The
+  // threads of an embedded run are those of serve or manifest.
   int env_threads = stan::math::internal::get_num_threads();
-  if (env_threads != num_threads) {
+  if (!embedded && env_threads != num_threads) {
     if (env_threads != 1) {
       std::stringstream thread_msg;
       thread_msg << "STAN_NUM_THREADS= " << env_threads
@@ -145,7 +166,7 @@ int command(int argc, const char *argv[]) {
       throw std::invalid_argument(thread_msg.str());
     }
   }
-  stan::math::init_threadpool_tbb(num_threads);
+  init_thread_pool(num_threads);
 
   unsigned int num_chains = get_num_chains(parser);
   check_file_config(parser);
@@ -164,11 +185,26 @@ int command(int argc, const char *argv[]) {
 
   std::string filename = get_arg_val<string_argument>(parser, "data", "file");
 
-  std::shared_ptr<stan::io::var_context> var_context
-      = get_var_context(filename);
+  // a model which isn't cached is owned by this run, as a process may
+  // run many jobs.  Without a seed, the seed of each run is new, so its
+  // model is not cached.
+  std::shared_ptr<stan::model::model_base> cached_model;
+  std::unique_ptr<stan::model::model_base> owned_model;
+  if (models != nullptr && !random_arg->is_default())
+    cached_model = models->get(filename, random_seed, &std::cout);
+  else
+    owned_model.reset(
+        &new_model(*get_var_context(filename), random_seed, &std::cout));
 
   stan::model::model_base &model
-      = new_model(*var_context, random_seed, &std::cout);
+      = cached_model ? *cached_model : *owned_model;
+
+  // the profiling data is global, so it would mix the embedded runs
+  const char *shared_profile_msg
+      = "Models with profile blocks can't be run by serve or manifest, "
+        "as their jobs share the profiling data of the process";
+  if (embedded && get_stan_profile_data().size() > 0)
+    throw std::invalid_argument(shared_profile_msg);
 
   //////////////////////////////////////////////////
   //           Configure callback writers         //
@@ -181,10 +217,11 @@ int command(int argc, const char *argv[]) {
       = get_arg_val<string_argument>(parser, "output", "file");
   std::string diagnostic_file
       = get_arg_val<string_argument>(parser, "output", "diagnostic_file");
+  bool streamed_output = is_output_stream(output_file);
+  // must outlive the sample writers, which write to its stream buffers
+  std::unique_ptr<output_stream> streamed;
 
-  stan::callbacks::interrupt interrupt;
-  stan::callbacks::json_writer<std::ofstream> dummy_json_writer;  // pathfinder
-  stan::callbacks::writer init_writer;  // unused - save param initializations
+  stop_interrupt interrupt(get_arg_val<real_argument>(parser, "max_runtime"));
   std::vector<stan::callbacks::writer> init_writers{num_chains,
                                                     stan::callbacks::writer{}};
   std::vector<stan::callbacks::unique_stream_writer<std::ofstream>>
@@ -195,7 +232,11 @@ int command(int argc, const char *argv[]) {
       diagnostic_json_writers;
   std::vector<stan::callbacks::json_writer<std::ofstream>> metric_json_writers;
 
-  std::string output_base = get_basename_suffix(output_file).first;
+  // files written next to output streamed to standard output are
+  // named after the default output file
+  std::string output_base
+      = get_basename_suffix(output_file == "-" ? "output.csv" : output_file)
+            .first;
   std::string diagnostic_base;
   if (!diagnostic_file.empty())
     diagnostic_base = get_basename_suffix(diagnostic_file).first;
@@ -207,6 +248,56 @@ int command(int argc, const char *argv[]) {
                                        "save_single_paths"));
   bool save_diagnostics = diagnostic_base != output_base;
 
+  // a sampler run resumed from checkpoints appends to its output files
+  std::vector<chain_checkpoint> checkpoints;
+  std::vector<checkpoint_files> files;
+  if (user_method->arg("sample"))
+    checkpoints = get_checkpoints(parser, model, num_chains, id);
+
+  // draws published in shared memory as they are sampled
+  std::string shm_name = get_arg_val<string_argument>(parser, "output", "shm");
+  if (!shm_name.empty()) {
+    bool nuts_diag_e
+        = user_method->arg("sample")
+          && get_arg_val<list_argument>(parser, "method", "sample",
+                                        "algorithm")
+                 == "hmc"
+          && get_arg_val<list_argument>(parser, "method", "sample",
+                                        "algorithm", "hmc", "engine")
+                 == "nuts"
+          && get_arg_val<list_argument>(parser, "method", "sample",
+                                        "algorithm", "hmc", "metric")
+                 == "diag_e"
+          && !get_arg_val<bool_argument>(parser, "method", "sample", "adapt",
+                                         "save_metric")
+          && checkpoints.empty();
+    if (!nuts_diag_e || model.num_params_r() == 0) {
+      throw std::invalid_argument(
+          "Shared memory output is only supported for the NUTS sampler "
+          "with the diag_e metric, without save_metric or resume.");
+    }
+    if (shm_name[0] != '/')
+      shm_name = "/" + shm_name;
+  }
+
+  // draws streamed to standard output or a named pipe; several chains
+  // share the stream in frames tagged by chain id
+  if (streamed_output) {
+    bool sample = user_method->arg("sample");
+    if (user_method->arg("pathfinder") || (num_chains > 1 && !sample)
+        || !checkpoints.empty()
+        || (sample
+            && get_arg_val<int_argument>(parser, "method", "sample",
+                                         "checkpoint_every")
+                   > 0)) {
+      throw std::invalid_argument(
+          "Output to standard output or a named pipe is not supported "
+          "for pathfinder, for several runs of other methods than "
+          "sample, or with checkpoints.");
+    }
+    streamed = std::make_unique<output_stream>(output_file, responses.rdbuf());
+  }
+
   if (user_method->arg("pathfinder")) {
     if (num_chains == 1) {
       init_filestream_writers(sample_writers, num_chains, id, output_base, "",
@@ -229,16 +320,46 @@ int command(int argc, const char *argv[]) {
       }
     }
     init_null_writers(diagnostic_csv_writers, num_chains);
+  } else if (!log_prob_stream.empty()) {
+    // the responses are the only output of log_prob stream mode
+    init_null_writers(sample_writers, num_chains);
+    init_null_writers(diagnostic_csv_writers, num_chains);
+    init_null_writers(diagnostic_json_writers, num_chains);
   } else {
-    init_filestream_writers(sample_writers, num_chains, id, output_file, "",
-                            ".csv", sig_figs, "# ");
+    auto sample_files
+        = make_filenames(output_file, "", ".csv", num_chains, id);
+    auto diagnostic_files
+        = make_filenames(diagnostic_base, "", ".csv", num_chains, id);
+    std::ios_base::openmode mode = std::ios::out;
+    if (!checkpoints.empty()) {
+      // drop output written after the checkpoints and append to the rest
+      for (size_t i = 0; i < num_chains; ++i) {
+        truncate_file(sample_files[i], checkpoints[i].sample_offset);
+        if (save_diagnostics)
+          truncate_file(diagnostic_files[i],
+                        checkpoints[i].diagnostic_offset);
+      }
+      mode = std::ios::app;
+    }
+    auto sample_streams
+        = streamed ? streamed->open_writers(sample_writers, num_chains, id,
+                                            sig_figs, "# ")
+                   : open_filestream_writers(sample_writers, sample_files,
+                                             mode, sig_figs, "# ");
+    std::vector<std::ofstream *> diagnostic_streams(num_chains, nullptr);
     if (save_diagnostics) {
-      init_filestream_writers(diagnostic_csv_writers, num_chains, id,
-                              diagnostic_base, "", ".csv", sig_figs, "# ");
+      diagnostic_streams = open_filestream_writers(
+          diagnostic_csv_writers, diagnostic_files, mode, sig_figs, "# ");
     } else {
       init_null_writers(diagnostic_csv_writers, num_chains);
     }
     init_null_writers(diagnostic_json_writers, num_chains);
+    auto checkpoint_names = make_filenames(output_base + "_checkpoint.bin", "",
+                                           ".bin", num_chains, id);
+    for (size_t i = 0; i < num_chains; ++i)
+      files.push_back({checkpoint_names[i], sample_streams[i], sample_files[i],
+                       diagnostic_streams[i],
+                       save_diagnostics ? diagnostic_files[i] : ""});
   }
   if (user_method->arg("sample")
       && get_arg_val<bool_argument>(parser, "method", "sample", "adapt",
@@ -272,7 +393,7 @@ int command(int argc, const char *argv[]) {
     write_config(json_args, parser, model);
   }
 
-  for (int i = 0; i < num_chains; ++i) {
+  for (int i = 0; i < num_chains && checkpoints.empty(); ++i) {
     write_config(sample_writers[i], parser, model);
     write_stan(diagnostic_csv_writers[i]);
     write_model(diagnostic_csv_writers[i], model.model_name());
@@ -282,514 +403,60 @@ int command(int argc, const char *argv[]) {
   //////////////////////////////////////////////////
   //            Invoke Services                   //
   //////////////////////////////////////////////////
+  command_context context{parser,
+                          model,
+                          num_chains,
+                          id,
+                          random_seed,
+                          num_threads,
+                          sig_figs,
+                          refresh,
+                          filename,
+                          init,
+                          init_radius,
+                          output_file,
+                          output_base,
+                          diagnostic_file,
+                          save_single_paths,
+                          log_prob_stream,
+                          shm_name,
+                          responses,
+                          interrupt,
+                          logger,
+                          info,
+                          init_contexts,
+                          init_writers,
+                          sample_writers,
+                          diagnostic_csv_writers,
+                          diagnostic_json_writers,
+                          metric_json_writers,
+                          checkpoints,
+                          files};
   int return_code = return_codes::NOT_OK;
-  std::stringstream msg;
-
   if (user_method->arg("pathfinder")) {
-    // ---- pathfinder start ---- //
-    auto pathfinder_arg = parser.arg("method")->arg("pathfinder");
-    int history_size
-        = get_arg_val<int_argument>(*pathfinder_arg, "history_size");
-    double init_alpha
-        = get_arg_val<real_argument>(*pathfinder_arg, "init_alpha");
-    double tol_obj = get_arg_val<real_argument>(*pathfinder_arg, "tol_obj");
-    double tol_rel_obj
-        = get_arg_val<real_argument>(*pathfinder_arg, "tol_rel_obj");
-    double tol_grad = get_arg_val<real_argument>(*pathfinder_arg, "tol_grad");
-    double tol_rel_grad
-        = get_arg_val<real_argument>(*pathfinder_arg, "tol_rel_grad");
-    double tol_param = get_arg_val<real_argument>(*pathfinder_arg, "tol_param");
-    int max_lbfgs_iters
-        = get_arg_val<int_argument>(*pathfinder_arg, "max_lbfgs_iters");
-    int num_elbo_draws
-        = get_arg_val<int_argument>(*pathfinder_arg, "num_elbo_draws");
-    int num_draws = get_arg_val<int_argument>(*pathfinder_arg, "num_draws");
-    int num_psis_draws
-        = get_arg_val<int_argument>(*pathfinder_arg, "num_psis_draws");
-    if (num_chains == 1) {
-      save_single_paths = save_single_paths || !diagnostic_file.empty();
-      return_code = stan::services::pathfinder::pathfinder_lbfgs_single<
-          false, stan::model::model_base>(
-          model, *(init_contexts[0]), random_seed, id, init_radius,
-          history_size, init_alpha, tol_obj, tol_rel_obj, tol_grad,
-          tol_rel_grad, tol_param, max_lbfgs_iters, num_elbo_draws, num_draws,
-          save_single_paths, refresh, interrupt, logger, init_writer,
-          sample_writers[0], diagnostic_json_writers[0]);
-    } else {
-      auto ofs = std::make_unique<std::ofstream>(output_base + ".csv");
-      if (sig_figs > -1)
-        ofs->precision(sig_figs);
-      stan::callbacks::unique_stream_writer<std::ofstream> pathfinder_writer(
-          std::move(ofs), "# ");
-      write_config(pathfinder_writer, parser, model);
-      return_code = stan::services::pathfinder::pathfinder_lbfgs_multi<
-          stan::model::model_base>(
-          model, init_contexts, random_seed, id, init_radius, history_size,
-          init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad, tol_param,
-          max_lbfgs_iters, num_elbo_draws, num_draws, num_psis_draws,
-          num_chains, save_single_paths, refresh, interrupt, logger,
-          init_writers, sample_writers, diagnostic_json_writers,
-          pathfinder_writer, dummy_json_writer);
-    }
-    // ---- pathfinder end ---- //
+    return_code = run_pathfinder(context);
   } else if (user_method->arg("generate_quantities")) {
-    // ---- generate_quantities start ---- //
-    auto gq_arg = parser.arg("method")->arg("generate_quantities");
-    std::string fname = get_arg_val<string_argument>(*gq_arg, "fitted_params");
-    if (fname.empty()) {
-      msg << "Missing fitted_params argument, cannot run generate_quantities "
-             "without fitted sample.";
-      throw std::invalid_argument(msg.str());
-    }
-    std::vector<std::string> param_names = get_constrained_param_names(model);
-    stan::io::stan_csv fitted_params;
-    size_t col_offset, num_rows, num_cols;
-    parse_stan_csv(fname, model, param_names, fitted_params, col_offset,
-                   num_rows, num_cols);
-    return_code = stan::services::standalone_generate(
-        model, fitted_params.samples.block(0, col_offset, num_rows, num_cols),
-        random_seed, interrupt, logger, sample_writers[0]);
-    // ---- generate_quantities end ---- //
+    return_code = run_generate_quantities(context);
   } else if (user_method->arg("laplace")) {
-    // ---- laplace start ---- //
-    auto laplace_arg = parser.arg("method")->arg("laplace");
-    std::string fname = get_arg_val<string_argument>(*laplace_arg, "mode");
-    if (fname.empty()) {
-      msg << "Missing mode argument, cannot get laplace sample "
-             "without parameter estimates theta-hat";
-      throw std::invalid_argument(msg.str());
-    }
-    Eigen::VectorXd theta_hat = get_laplace_mode(fname, model);
-    bool jacobian = get_arg_val<bool_argument>(*laplace_arg, "jacobian");
-    int draws = get_arg_val<int_argument>(*laplace_arg, "draws");
-    if (jacobian) {
-      return_code = stan::services::laplace_sample<true>(
-          model, theta_hat, draws, random_seed, refresh, interrupt, logger,
-          sample_writers[0]);
-    } else {
-      return_code = stan::services::laplace_sample<false>(
-          model, theta_hat, draws, random_seed, refresh, interrupt, logger,
-          sample_writers[0]);
-    }
-    // ---- laplace end ---- //
+    return_code = run_laplace(context);
   } else if (user_method->arg("log_prob")) {
-    // ---- log_prob start ---- //
-    auto log_prob_arg = parser.arg("method")->arg("log_prob");
-    std::string upars_file
-        = get_arg_val<string_argument>(*log_prob_arg, "unconstrained_params");
-    std::string cpars_file
-        = get_arg_val<string_argument>(*log_prob_arg, "constrained_params");
-    bool jacobian = get_arg_val<bool_argument>(*log_prob_arg, "jacobian");
-    if (upars_file.length() == 0 && cpars_file.length() == 0) {
-      msg << "No input parameter files provided, "
-          << "cannot calculate log probability density.";
-      throw std::invalid_argument(msg.str());
-    }
-    if (upars_file.length() > 0 && cpars_file.length() > 0) {
-      msg << "Cannot specify both input files of both "
-          << "constrained and unconstrained parameter values.";
-      throw std::invalid_argument(msg.str());
-    }
-    std::vector<std::vector<double>> params_r_ind;
-    if (upars_file.length() > 0) {
-      params_r_ind = get_uparams_r(upars_file, model);
-    } else if (cpars_file.length() > 0) {
-      std::vector<std::string> param_names = get_constrained_param_names(model);
-      if (get_suffix(cpars_file) == ".csv") {
-        stan::io::stan_csv fitted_params;
-        size_t col_offset, num_rows, num_cols;
-        parse_stan_csv(cpars_file, model, param_names, fitted_params,
-                       col_offset, num_rows, num_cols);
-        params_r_ind = unconstrain_params_csv(model, fitted_params, col_offset,
-                                              num_rows, num_cols);
-      } else {
-        params_r_ind = {unconstrain_params_var_context(cpars_file, model)};
-      }
-    }
-    try {
-      services_log_prob_grad(model, jacobian, params_r_ind, sig_figs,
-                             sample_writers[0].get_stream());
-      return_code = return_codes::OK;
-    } catch (const std::exception &e) {
-      return_code = return_codes::NOT_OK;
-    }
-    // ---- log_prob end ---- //
+    return_code = run_log_prob(context);
   } else if (user_method->arg("diagnose")) {
-    // ---- diagnose start ---- //
-    list_argument *test = dynamic_cast<list_argument *>(
-        parser.arg("method")->arg("diagnose")->arg("test"));
-    if (test->value() == "gradient") {
-      double epsilon = get_arg_val<real_argument>(*test, "gradient", "epsilon");
-      double error = get_arg_val<real_argument>(*test, "gradient", "error");
-      return_code = stan::services::diagnose::diagnose(
-          model, *(init_contexts[0]), random_seed, id, init_radius, epsilon,
-          error, interrupt, logger, init_writers[0], sample_writers[0]);
-    }
-    // ---- diagnose end ---- //
+    return_code = run_diagnose(context);
   } else if (user_method->arg("optimize")) {
-    // ---- optimize start ---- //
-    int num_iterations
-        = get_arg_val<int_argument>(parser, "method", "optimize", "iter");
-    bool save_iterations = get_arg_val<bool_argument>(
-        parser, "method", "optimize", "save_iterations");
-    bool jacobian
-        = get_arg_val<bool_argument>(parser, "method", "optimize", "jacobian");
-    list_argument *algo = dynamic_cast<list_argument *>(
-        parser.arg("method")->arg("optimize")->arg("algorithm"));
-    if (algo->value() == "newton") {
-      if (jacobian) {
-        return_code
-            = stan::services::optimize::newton<stan::model::model_base, true>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_iterations, save_iterations, interrupt, logger,
-                init_writers[0], sample_writers[0]);
-      } else {
-        return_code
-            = stan::services::optimize::newton<stan::model::model_base, false>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_iterations, save_iterations, interrupt, logger,
-                init_writers[0], sample_writers[0]);
-      }
-    } else if (algo->value() == "bfgs") {
-      double init_alpha
-          = get_arg_val<real_argument>(*algo, "bfgs", "init_alpha");
-      double tol_obj = get_arg_val<real_argument>(*algo, "bfgs", "tol_obj");
-      double tol_rel_obj
-          = get_arg_val<real_argument>(*algo, "bfgs", "tol_rel_obj");
-      double tol_grad = get_arg_val<real_argument>(*algo, "bfgs", "tol_grad");
-      double tol_rel_grad
-          = get_arg_val<real_argument>(*algo, "bfgs", "tol_rel_grad");
-      double tol_param = get_arg_val<real_argument>(*algo, "bfgs", "tol_param");
-
-      if (jacobian) {
-        return_code
-            = stan::services::optimize::bfgs<stan::model::model_base, true>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad,
-                tol_param, num_iterations, save_iterations, refresh, interrupt,
-                logger, init_writers[0], sample_writers[0]);
-      } else {
-        return_code
-            = stan::services::optimize::bfgs<stan::model::model_base, false>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad,
-                tol_param, num_iterations, save_iterations, refresh, interrupt,
-                logger, init_writers[0], sample_writers[0]);
-      }
-    } else if (algo->value() == "lbfgs") {
-      int history_size
-          = get_arg_val<int_argument>(*algo, "lbfgs", "history_size");
-      double init_alpha
-          = get_arg_val<real_argument>(*algo, "lbfgs", "init_alpha");
-      double tol_obj = get_arg_val<real_argument>(*algo, "lbfgs", "tol_obj");
-      double tol_rel_obj
-          = get_arg_val<real_argument>(*algo, "lbfgs", "tol_rel_obj");
-      double tol_grad = get_arg_val<real_argument>(*algo, "lbfgs", "tol_grad");
-      double tol_rel_grad
-          = get_arg_val<real_argument>(*algo, "lbfgs", "tol_rel_grad");
-      double tol_param
-          = get_arg_val<real_argument>(*algo, "lbfgs", "tol_param");
-
-      if (jacobian) {
-        return_code
-            = stan::services::optimize::lbfgs<stan::model::model_base, true>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                history_size, init_alpha, tol_obj, tol_rel_obj, tol_grad,
-                tol_rel_grad, tol_param, num_iterations, save_iterations,
-                refresh, interrupt, logger, init_writers[0], sample_writers[0]);
-      } else {
-        return_code
-            = stan::services::optimize::lbfgs<stan::model::model_base, false>(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                history_size, init_alpha, tol_obj, tol_rel_obj, tol_grad,
-                tol_rel_grad, tol_param, num_iterations, save_iterations,
-                refresh, interrupt, logger, init_writers[0], sample_writers[0]);
-      }
-    }
-    // ---- optimize end ---- //
+    return_code = run_optimize(context);
   } else if (user_method->arg("sample")) {
-    // ---- sample start ---- //
-    int num_warmup
-        = get_arg_val<int_argument>(parser, "method", "sample", "num_warmup");
-    int num_samples
-        = get_arg_val<int_argument>(parser, "method", "sample", "num_samples");
-    int num_thin
-        = get_arg_val<int_argument>(parser, "method", "sample", "thin");
-    bool save_warmup
-        = get_arg_val<bool_argument>(parser, "method", "sample", "save_warmup");
-
-    bool adapt_engaged = get_arg_val<bool_argument>(parser, "method", "sample",
-                                                    "adapt", "engaged");
-    if (adapt_engaged == true && num_warmup == 0) {
-      msg << "The number of warmup samples (num_warmup) must be greater than "
-          << "zero if adaptation is enabled." << std::endl;
-      throw std::invalid_argument(msg.str());
-    }
-    list_argument *algo = dynamic_cast<list_argument *>(
-        parser.arg("method")->arg("sample")->arg("algorithm"));
-    std::string algo_name = algo->value();
-    if (model.num_params_r() == 0 || algo_name == "fixed_param") {
-      if (algo_name != "fixed_param") {
-        info(
-            "Model contains no parameters, running fixed_param sampler, "
-            "no updates to Markov chain");
-      }
-      return_code = stan::services::sample::fixed_param(
-          model, num_chains, init_contexts, random_seed, id, init_radius,
-          num_samples, num_thin, refresh, interrupt, logger, init_writers,
-          sample_writers, diagnostic_csv_writers);
-    } else if (algo_name == "hmc") {
-      list_argument *metric_arg
-          = dynamic_cast<list_argument *>(parser.arg("method")
-                                              ->arg("sample")
-                                              ->arg("algorithm")
-                                              ->arg("hmc")
-                                              ->arg("metric"));
-      std::string metric = metric_arg->value();
-      std::string metric_file = get_arg_val<string_argument>(
-          parser, "method", "sample", "algorithm", "hmc", "metric_file");
-      bool metric_supplied = !metric_file.empty();
-      context_vector metric_contexts;
-      if (metric_supplied) {
-        metric_contexts = get_vec_var_context(metric_file, num_chains, id);
-      }
-      double stepsize = get_arg_val<real_argument>(
-          parser, "method", "sample", "algorithm", "hmc", "stepsize");
-      double jitter = get_arg_val<real_argument>(
-          parser, "method", "sample", "algorithm", "hmc", "stepsize_jitter");
-      list_argument *hmc_engine
-          = dynamic_cast<list_argument *>(algo->arg("hmc")->arg("engine"));
-      std::string engine = hmc_engine->value();
-      if (engine == "nuts") {
-        int max_depth
-            = get_arg_val<int_argument>(parser, "method", "sample", "algorithm",
-                                        "hmc", "engine", "nuts", "max_depth");
-        if (adapt_engaged == false) {
-          // NUTS, no adaptation
-          if (metric == "dense_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_nuts_dense_e(
-                model, num_chains, init_contexts, metric_contexts, random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, max_depth, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers);
-          } else if (metric == "dense_e") {
-            return_code = stan::services::sample::hmc_nuts_dense_e(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, interrupt, logger, init_writers,
-                sample_writers, diagnostic_csv_writers);
-          } else if (metric == "diag_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_nuts_diag_e(
-                model, num_chains, init_contexts, metric_contexts, random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, max_depth, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers);
-          } else if (metric == "diag_e") {
-            return_code = stan::services::sample::hmc_nuts_diag_e(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, interrupt, logger, init_writers,
-                sample_writers, diagnostic_csv_writers);
-          } else if (metric == "unit_e") {
-            return_code = stan::services::sample::hmc_nuts_unit_e(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, interrupt, logger, init_writers,
-                sample_writers, diagnostic_csv_writers);
-          }
-        } else {
-          // NUTS adaptation
-          double delta = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "delta");
-          double gamma = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "gamma");
-          double kappa = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "kappa");
-          double t0 = get_arg_val<real_argument>(parser, "method", "sample",
-                                                 "adapt", "t0");
-          unsigned int init_buffer = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "init_buffer");
-          unsigned int term_buffer = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "term_buffer");
-          unsigned int window = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "window");
-
-          if (metric == "dense_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_nuts_dense_e_adapt(
-                model, num_chains, init_contexts, metric_contexts, random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, max_depth, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers,
-                metric_json_writers);
-          } else if (metric == "dense_e") {
-            return_code = stan::services::sample::hmc_nuts_dense_e_adapt(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers,
-                metric_json_writers);
-          } else if (metric == "diag_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_nuts_diag_e_adapt(
-                model, num_chains, init_contexts, metric_contexts, random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, max_depth, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers,
-                metric_json_writers);
-          } else if (metric == "diag_e") {
-            return_code = stan::services::sample::hmc_nuts_diag_e_adapt(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers, sample_writers, diagnostic_csv_writers,
-                metric_json_writers);
-          } else if (metric == "unit_e") {
-            return_code = stan::services::sample::hmc_nuts_unit_e_adapt(
-                model, num_chains, init_contexts, random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, max_depth, delta, gamma, kappa, t0, interrupt,
-                logger, init_writers, sample_writers, diagnostic_csv_writers,
-                metric_json_writers);
-          }
-        }
-      } else if (engine == "static") {
-        double int_time = get_arg_val<real_argument>(
-            parser, "method", "sample", "algorithm", "hmc", "engine", "static",
-            "int_time");
-        if (adapt_engaged == false) {  // static, no adaptation
-          if (metric == "dense_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_static_dense_e(
-                model, *(init_contexts[0]), *(metric_contexts[0]), random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, int_time, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "dense_e") {
-            return_code = stan::services::sample::hmc_static_dense_e(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, interrupt, logger, init_writers[0],
-                sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "diag_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_static_diag_e(
-                model, *(init_contexts[0]), *(metric_contexts[0]), random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, int_time, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "diag_e") {
-            return_code = stan::services::sample::hmc_static_diag_e(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, interrupt, logger, init_writers[0],
-                sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "unit_e") {
-            return_code = stan::services::sample::hmc_static_unit_e(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, interrupt, logger, init_writers[0],
-                sample_writers[0], diagnostic_csv_writers[0]);
-          }
-        } else {  // static adaptation
-          double delta = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "delta");
-          double gamma = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "gamma");
-          double kappa = get_arg_val<real_argument>(parser, "method", "sample",
-                                                    "adapt", "kappa");
-          double t0 = get_arg_val<real_argument>(parser, "method", "sample",
-                                                 "adapt", "t0");
-          unsigned int init_buffer = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "init_buffer");
-          unsigned int term_buffer = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "term_buffer");
-          unsigned int window = get_arg_val<u_int_argument>(
-              parser, "method", "sample", "adapt", "window");
-          if (metric == "dense_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_static_dense_e_adapt(
-                model, *(init_contexts[0]), *(metric_contexts[0]), random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, int_time, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "dense_e") {
-            return_code = stan::services::sample::hmc_static_dense_e_adapt(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "diag_e" && metric_supplied == true) {
-            return_code = stan::services::sample::hmc_static_diag_e_adapt(
-                model, *(init_contexts[0]), *(metric_contexts[0]), random_seed,
-                id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
-                refresh, stepsize, jitter, int_time, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "diag_e") {
-            return_code = stan::services::sample::hmc_static_diag_e_adapt(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, delta, gamma, kappa, t0,
-                init_buffer, term_buffer, window, interrupt, logger,
-                init_writers[0], sample_writers[0], diagnostic_csv_writers[0]);
-          } else if (metric == "unit_e") {
-            return_code = stan::services::sample::hmc_static_unit_e_adapt(
-                model, *(init_contexts[0]), random_seed, id, init_radius,
-                num_warmup, num_samples, num_thin, save_warmup, refresh,
-                stepsize, jitter, int_time, delta, gamma, kappa, t0, interrupt,
-                logger, init_writers[0], sample_writers[0],
-                diagnostic_csv_writers[0]);
-          }
-        }
-      }  // end static HMC
-    }    // ---- sample end ---- //
+    return_code = run_sample(context);
   } else if (user_method->arg("variational")) {
-    // ---- variational start ---- //
-    list_argument *algo = dynamic_cast<list_argument *>(
-        parser.arg("method")->arg("variational")->arg("algorithm"));
-    std::string algorithm = algo->value();
-    int grad_samples = get_arg_val<int_argument>(parser, "method",
-                                                 "variational", "grad_samples");
-    int elbo_samples = get_arg_val<int_argument>(parser, "method",
-                                                 "variational", "elbo_samples");
-    int max_iterations
-        = get_arg_val<int_argument>(parser, "method", "variational", "iter");
-    double tol_rel_obj = get_arg_val<real_argument>(
-        parser, "method", "variational", "tol_rel_obj");
-    double eta
-        = get_arg_val<real_argument>(parser, "method", "variational", "eta");
-    bool adapt_engaged = get_arg_val<bool_argument>(
-        parser, "method", "variational", "adapt", "engaged");
-    int adapt_iterations = get_arg_val<int_argument>(
-        parser, "method", "variational", "adapt", "iter");
-    int eval_elbo = get_arg_val<int_argument>(parser, "method", "variational",
-                                              "eval_elbo");
-    int output_samples = get_arg_val<int_argument>(
-        parser, "method", "variational", "output_samples");
-    if (algorithm == "fullrank") {
-      return_code = stan::services::experimental::advi::fullrank(
-          model, *(init_contexts[0]), random_seed, id, init_radius,
-          grad_samples, elbo_samples, max_iterations, tol_rel_obj, eta,
-          adapt_engaged, adapt_iterations, eval_elbo, output_samples, interrupt,
-          logger, init_writers[0], sample_writers[0],
-          diagnostic_csv_writers[0]);
-    } else if (algorithm == "meanfield") {
-      return_code = stan::services::experimental::advi::meanfield(
-          model, *(init_contexts[0]), random_seed, id, init_radius,
-          grad_samples, elbo_samples, max_iterations, tol_rel_obj, eta,
-          adapt_engaged, adapt_iterations, eval_elbo, output_samples, interrupt,
-          logger, init_writers[0], sample_writers[0],
-          diagnostic_csv_writers[0]);
-    }
-
-    // ---- variational end ---- //
+    return_code = run_variational(context);
   }
+  // services which catch exceptions report a stop as a failure
+  if (return_code != return_codes::OK && interrupt.stop_requested())
+    return_code = return_codes::INTERRUPTED;
   //////////////////////////////////////////////////
 
   stan::math::profile_map &profile_data = get_stan_profile_data();
-  if (profile_data.size() > 0) {
+  if (profile_data.size() > 0 && !embedded) {
     std::string profile_file_name
         = get_arg_val<string_argument>(parser, "output", "profile_file");
     std::fstream profile_stream(profile_file_name.c_str(), std::fstream::out);
@@ -805,6 +472,8 @@ int command(int argc, const char *argv[]) {
 #ifdef STAN_MPI
   cluster.stop_listen();
 #endif
+  if (embedded && profile_data.size() > 0)
+    throw std::invalid_argument(shared_profile_msg);
   return return_code;
 }
 
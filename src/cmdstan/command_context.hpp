@@ -0,0 +1,82 @@
+#ifndef CMDSTAN_COMMAND_CONTEXT_HPP
+#define CMDSTAN_COMMAND_CONTEXT_HPP
+
+#include <cmdstan/arguments/argument_parser.hpp>
+#include <cmdstan/command_helper.hpp>
+#include <cmdstan/sample_checkpoint.hpp>
+#include <cmdstan/stop_interrupt.hpp>
+#include <stan/callbacks/json_writer.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/unique_stream_writer.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/model/model_base.hpp>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * The methods run by `command` are each compiled in their own
+ * translation unit, src/cmdstan/command_<method>.cpp, so that the
+ * services they instantiate are compiled in parallel.
+ */
+
+namespace cmdstan {
+
+using csv_writers
+    = std::vector<stan::callbacks::unique_stream_writer<std::ofstream>>;
+using json_writers = std::vector<stan::callbacks::json_writer<std::ofstream>>;
+
+/**
+ * The parsed arguments, model, and writers which `command` sets up for
+ * the method it runs.
+ */
+struct command_context {
+  argument_parser &parser;
+  stan::model::model_base &model;
+  unsigned int num_chains;
+  unsigned int id;  // chain id of the first chain
+  unsigned int random_seed;
+  int num_threads;
+  int sig_figs;
+  int refresh;
+  std::string data_file;
+  std::string init;  // file of initial values, empty for an init radius
+  double init_radius;
+  std::string output_file;
+  std::string output_base;
+  std::string diagnostic_file;
+  bool save_single_paths;
+  std::string log_prob_stream;
+  std::string shm_name;
+  std::ostream &responses;  // standard output of the log_prob stream mode
+  stop_interrupt &interrupt;
+  stan::callbacks::logger &logger;
+  stan::callbacks::writer &info;
+  context_vector &init_contexts;
+  std::vector<stan::callbacks::writer> &init_writers;
+  csv_writers &sample_writers;
+  csv_writers &diagnostic_csv_writers;
+  json_writers &diagnostic_json_writers;
+  json_writers &metric_json_writers;
+  std::vector<chain_checkpoint> &checkpoints;  // of a resumed sampler run
+  std::vector<checkpoint_files> &files;
+};
+
+/**
+ * Run a method of CmdStan.
+ *
+ * @param context arguments, model, and writers of the run
+ * @return return code
+ */
+int run_pathfinder(command_context &context);
+int run_generate_quantities(command_context &context);
+int run_laplace(command_context &context);
+int run_log_prob(command_context &context);
+int run_diagnose(command_context &context);
+int run_optimize(command_context &context);
+int run_sample(command_context &context);
+int run_variational(command_context &context);
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,32 @@
+#include <cmdstan/command_context.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <stan/services/diagnose/diagnose.hpp>
+
+namespace cmdstan {
+
+int run_diagnose(command_context &context) {
+  auto &parser = context.parser;
+  auto &model = context.model;
+  auto &id = context.id;
+  auto &random_seed = context.random_seed;
+  auto &init_radius = context.init_radius;
+  auto &interrupt = context.interrupt;
+  auto &logger = context.logger;
+  auto &init_contexts = context.init_contexts;
+  auto &init_writers = context.init_writers;
+  auto &sample_writers = context.sample_writers;
+  int return_code = return_codes::NOT_OK;
+
+  list_argument *test = dynamic_cast<list_argument *>(
+      parser.arg("method")->arg("diagnose")->arg("test"));
+  if (test->value() == "gradient") {
+    double epsilon = get_arg_val<real_argument>(*test, "gradient", "epsilon");
+    double error = get_arg_val<real_argument>(*test, "gradient", "error");
+    return_code = stan::services::diagnose::diagnose(
+        model, *(init_contexts[0]), random_seed, id, init_radius, epsilon,
+        error, interrupt, logger, init_writers[0], sample_writers[0]);
+  }
+  return return_code;
+}
+
+}  // namespace cmdstan
@@ -0,0 +1,40 @@
+#include <cmdstan/command_context.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <stan/services/sample/standalone_gqs.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+int run_generate_quantities(command_context &context) {
+  auto &parser = context.parser;
+  auto &model = context.model;
+  auto &random_seed = context.random_seed;
+  auto &interrupt = context.interrupt;
+  auto &logger = context.logger;
+  auto &sample_writers = context.sample_writers;
+  int return_code = return_codes::NOT_OK;
+  std::stringstream msg;
+
+  auto gq_arg = parser.arg("method")->arg("generate_quantities");
+  std::string fname = get_arg_val<string_argument>(*gq_arg, "fitted_params");
+  if (fname.empty()) {
+    msg << "Missing fitted_params argument, cannot run generate_quantities "
+           "without fitted sample.";
+    throw std::invalid_argument(msg.str());
+  }
+  std::vector<std::string> param_names = get_constrained_param_names(model);
+  stan::io::stan_csv fitted_params;
+  size_t col_offset, num_rows, num_cols;
+  parse_stan_csv(fname, model, param_names, fitted_params, col_offset,
+                 num_rows, num_cols);
+  return_code = stan::services::standalone_generate(
+      model, fitted_params.samples.block(0, col_offset, num_rows, num_cols),
+      random_seed, interrupt, logger, sample_writers[0]);
+  return return_code;
+}
+
+}  // namespace cmdstan
@@ -6,6 +6,7 @@
 #include <stan/callbacks/unique_stream_writer.hpp>
 #include <stan/callbacks/json_writer.hpp>
 #include <stan/callbacks/writer.hpp>
+#include <stan/io/array_var_context.hpp>
 #include <stan/io/dump.hpp>
 #include <stan/io/empty_var_context.hpp>
 #include <stan/io/ends_with.hpp>
@@ -14,8 +15,11 @@
 #include <stan/math/prim/fun/Eigen.hpp>
 #include <stan/model/log_prob_grad.hpp>
 #include <stan/model/model_base.hpp>
+#include <stan/services/error_codes.hpp>
 #include <stan/services/sample/standalone_gqs.hpp>
 #include <boost/algorithm/string.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -109,7 +113,7 @@ inline constexpr auto get_arg_val(List &&arg_list, Args &&... args) {
  * @param filename
  * @return suffix
  */
-std::string get_suffix(const std::string &name) {
+inline std::string get_suffix(const std::string &name) {
   if (name.empty())
     return "";
   size_t file_marker_pos = name.find_last_of(".");
@@ -125,7 +129,7 @@ std::string get_suffix(const std::string &name) {
  * @param filename - name to split
  * @return pair of strings {base, suffix}
  */
-std::pair<std::string, std::string> get_basename_suffix(
+inline std::pair<std::string, std::string> get_basename_suffix(
     const std::string &name) {
   std::string base;
   std::string suffix;
@@ -147,7 +151,7 @@ std::pair<std::string, std::string> get_basename_suffix(
  * @param fname name of file which exists and has read perms.
  * @return input stream
  */
-std::ifstream safe_open(const std::string &fname) {
+inline std::ifstream safe_open(const std::string &fname) {
   std::ifstream stream(fname.c_str());
   if (fname != "" && (stream.rdstate() & std::ifstream::failbit)) {
     std::stringstream msg;
@@ -181,11 +185,11 @@ inline shared_context_ptr get_var_context(const std::string &file) {
   return std::make_shared<stan::io::dump>(var_context);
 }
 
-std::vector<std::string> make_filenames(const std::string &filename,
-                                        const std::string &tag,
-                                        const std::string &type,
-                                        unsigned int num_chains,
-                                        unsigned int id) {
+inline std::vector<std::string> make_filenames(const std::string &filename,
+                                               const std::string &tag,
+                                               const std::string &type,
+                                               unsigned int num_chains,
+                                               unsigned int id) {
   std::vector<std::string> names(num_chains);
   auto base_sfx = get_basename_suffix(filename);
   if (base_sfx.second.empty()) {
@@ -204,6 +208,51 @@ std::vector<std::string> make_filenames(const std::string &filename,
   return names;
 }
 
+/**
+ * Make a var context holding values for all of a model's parameters
+ * from the values of its constrained parameters, in the order of
+ * `constrained_param_names`, e.g., one row of a Stan CSV file.
+ *
+ * @param model model
+ * @param values constrained parameter values
+ * @return var context which can be used as an init
+ */
+inline shared_context_ptr params_var_context(
+    const stan::model::model_base &model, const Eigen::VectorXd &values) {
+  std::vector<std::string> vars;
+  std::vector<std::vector<size_t>> dims;
+  model.get_param_names(vars, false, false);
+  model.get_dims(dims, false, false);
+  std::vector<double> vals(values.data(), values.data() + values.size());
+  return std::make_shared<stan::io::array_var_context>(vars, vals, dims);
+}
+
+/**
+ * Make a var context holding the variable `inv_metric`, as read by the
+ * HMC samplers from a metric file: the diagonal of the inverse metric
+ * for a diagonal metric or the full matrix for a dense one.
+ *
+ * @param inv_metric inverse metric, a square matrix
+ * @param dense true for a dense metric, false for a diagonal one
+ * @return var context for the metric
+ */
+inline shared_context_ptr metric_var_context(const Eigen::MatrixXd &inv_metric,
+                                             bool dense) {
+  std::vector<double> values;
+  std::vector<std::vector<size_t>> dims;
+  size_t N = inv_metric.rows();
+  if (dense) {
+    values.assign(inv_metric.data(), inv_metric.data() + inv_metric.size());
+    dims.push_back({N, N});
+  } else {
+    values.resize(N);
+    Eigen::VectorXd::Map(values.data(), N) = inv_metric.diagonal();
+    dims.push_back({N});
+  }
+  return std::make_shared<stan::io::array_var_context>(
+      std::vector<std::string>{"inv_metric"}, values, dims);
+}
+
 using context_vector = std::vector<shared_context_ptr>;
 /**
  * Make a vector of shared pointers to contexts.
@@ -213,8 +262,8 @@ using context_vector = std::vector<shared_context_ptr>;
  * @param num_chains The number of chains to run
  * @return a std vector of shared pointers to var contexts
  */
-context_vector get_vec_var_context(const std::string &file, size_t num_chains,
-                                   unsigned int id) {
+inline context_vector get_vec_var_context(const std::string &file,
+                                          size_t num_chains, unsigned int id) {
   using stan::io::var_context;
   if (num_chains == 1) {
     return context_vector(1, get_var_context(file));
@@ -321,7 +370,7 @@ context_vector get_vec_var_context(const std::string &file, size_t num_chains,
  * @param model instantiated model
  * @return vector of constrained parameter names
  */
-std::vector<std::string> get_constrained_param_names(
+inline std::vector<std::string> get_constrained_param_names(
     const stan::model::model_base &model) {
   std::vector<std::string> param_names;
   model.constrained_param_names(param_names, false, false);
@@ -347,11 +396,12 @@ std::vector<std::string> get_constrained_param_names(
  * @param num_rows total data table rows
  * @param num_cols total data table columns with parameter variable values
  */
-void parse_stan_csv(const std::string &fname,
-                    const stan::model::model_base &model,
-                    const std::vector<std::string> &param_names,
-                    stan::io::stan_csv &fitted_params, size_t &col_offset,
-                    size_t &num_rows, size_t &num_cols) {
+inline void parse_stan_csv(const std::string &fname,
+                           const stan::model::model_base &model,
+                           const std::vector<std::string> &param_names,
+                           stan::io::stan_csv &fitted_params,
+                           size_t &col_offset, size_t &num_rows,
+                           size_t &num_cols) {
   std::stringstream msg;
   // parse CSV contents
   std::ifstream stream = safe_open(fname);
@@ -404,8 +454,8 @@ void parse_stan_csv(const std::string &fname,
  * @param cparams vector of constrained param values
  * @return a std vector of unconstrained parameter values
  */
-std::vector<double> unconstrain_params(const stan::model::model_base &model,
-                                       const std::vector<double> &cparams) {
+inline std::vector<double> unconstrain_params(
+    const stan::model::model_base &model, const std::vector<double> &cparams) {
   std::stringstream msg;
   size_t num_uparams = model.num_params_r();
   std::vector<double> uparams(num_uparams);
@@ -433,7 +483,7 @@ std::vector<double> unconstrain_params(const stan::model::model_base &model,
  * @param cparams vector of constrained param values
  * @return a vector of std vectors of unconstrained parameter values
  */
-std::vector<std::vector<double>> unconstrain_params_csv(
+inline std::vector<std::vector<double>> unconstrain_params_csv(
     const stan::model::model_base &model, stan::io::stan_csv &fitted_params,
     size_t &col_offset, size_t &num_rows, size_t &num_cols) {
   std::vector<std::vector<double>> result;
@@ -455,7 +505,7 @@ std::vector<std::vector<double>> unconstrain_params_csv(
  * @param model Stan model
  * @return vector of vectors of parameter estimates
  */
-std::vector<double> unconstrain_params_var_context(
+inline std::vector<double> unconstrain_params_var_context(
     const std::string &fname, const stan::model::model_base &model) {
   std::stringstream msg;
   std::shared_ptr<stan::io::var_context> cpars_context = get_var_context(fname);
@@ -485,8 +535,8 @@ std::vector<double> unconstrain_params_var_context(
  * @param model Stan model
  * @return Eigen vector of unconstrained parameter estimates
  */
-Eigen::VectorXd get_laplace_mode_csv(const std::string &fname,
-                                     const stan::model::model_base &model) {
+inline Eigen::VectorXd get_laplace_mode_csv(
+    const std::string &fname, const stan::model::model_base &model) {
   std::stringstream msg;
   std::vector<std::string> cparam_names;
   model.constrained_param_names(cparam_names);
@@ -562,8 +612,8 @@ Eigen::VectorXd get_laplace_mode_csv(const std::string &fname,
  * @param model Stan model
  * @return Eigen vector of parameter estimates
  */
-Eigen::VectorXd get_laplace_mode(const std::string &fname,
-                                 const stan::model::model_base &model) {
+inline Eigen::VectorXd get_laplace_mode(const std::string &fname,
+                                        const stan::model::model_base &model) {
   std::stringstream msg;
   Eigen::VectorXd theta_hat;
   if (get_suffix(fname) == ".csv") {
@@ -590,7 +640,7 @@ Eigen::VectorXd get_laplace_mode(const std::string &fname,
  * @param model Stan model
  * @return vector of vectors of parameter estimates
  */
-std::vector<std::vector<double>> get_uparams_r(
+inline std::vector<std::vector<double>> get_uparams_r(
     const std::string &fname, const stan::model::model_base &model) {
   size_t u_params_cols = 0;
   size_t u_params_rows = 0;
@@ -639,9 +689,10 @@ std::vector<std::vector<double>> get_uparams_r(
  * @param params_set array of unconstrained parameter values
  * @
  */
-void services_log_prob_grad(const stan::model::model_base &model, bool jacobian,
-                            std::vector<std::vector<double>> &params_set,
-                            int sig_figs, std::ostream &output_stream) {
+inline void services_log_prob_grad(const stan::model::model_base &model,
+                                   bool jacobian,
+                                   std::vector<std::vector<double>> &params_set,
+                                   int sig_figs, std::ostream &output_stream) {
   // header row
   output_stream << std::setprecision(sig_figs) << "lp__,";
   std::vector<std::string> p_names;
@@ -673,38 +724,62 @@ void services_log_prob_grad(const stan::model::model_base &model, bool jacobian,
 }
 
 /**
- * For sample and pathfinder methods, return number of
- * chains or pathfinders to run, otherwise return 1.
- * For the sampler, only adaptive NUTS-HMC with non-unit metric
- * supports multi-chain parallelization; if sampler config is invalid,
- * this will throw an error.
+ * For sample, optimize, variational, and pathfinder methods, return number
+ * of chains, runs, or pathfinders to run, otherwise return 1.
+ * All samplers support multi-chain parallelization.
  *
  * @param parser user config
  * @return int num chains or paths
  */
-unsigned int get_num_chains(argument_parser &parser) {
+inline unsigned int get_num_chains(argument_parser &parser) {
   auto user_method = parser.arg("method");
   if (user_method->arg("pathfinder"))
     return get_arg_val<int_argument>(parser, "method", "pathfinder",
                                      "num_paths");
 
+  if (user_method->arg("optimize"))
+    return get_arg_val<int_argument>(parser, "method", "optimize",
+                                     "num_chains");
+  if (user_method->arg("variational"))
+    return get_arg_val<int_argument>(parser, "method", "variational",
+                                     "num_chains");
+
   auto sample_arg = user_method->arg("sample");
   if (!sample_arg)  // TODO parallel GQ now possible, consider
     return 1;
 
-  unsigned int num_chains
-      = get_arg_val<int_argument>(*sample_arg, "num_chains");
+  return get_arg_val<int_argument>(*sample_arg, "num_chains");
+}
 
-  if (num_chains > 1) {
-    list_argument *algo
-        = dynamic_cast<list_argument *>(sample_arg->arg("algorithm"));
-    if (algo->value() != "fixed_param"
-        && get_arg_val<list_argument>(*algo, "hmc", "engine") == "static") {
-      throw std::invalid_argument(
-          "Argument 'num_chains' is unavailable for the 'static' HMC engine.");
-    }
-  }
-  return num_chains;
+/**
+ * Run a single-chain service once per chain, in parallel on the
+ * TBB threadpool, the same way the multi-chain NUTS services do.
+ * The service is called with the index of the chain, which selects
+ * its inits, metric, and writers; the caller must offset the chain id
+ * by this index so that each chain has its own RNG stream.
+ *
+ * @tparam F callable taking a chain index and returning a return code
+ * @param num_chains number of chains
+ * @param f single-chain service
+ * @return error_codes::OK if all chains succeeded, otherwise
+ *   the return code of the first chain that failed
+ */
+template <typename F>
+int run_chains_parallel(size_t num_chains, F &&f) {
+  if (num_chains == 1)
+    return f(0);
+  std::vector<int> return_codes(num_chains, stan::services::error_codes::OK);
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, num_chains, 1),
+      [&](const tbb::blocked_range<size_t> &r) {
+        for (size_t i = r.begin(); i != r.end(); ++i)
+          return_codes[i] = f(i);
+      },
+      tbb::simple_partitioner());
+  for (int return_code : return_codes)
+    if (return_code != stan::services::error_codes::OK)
+      return return_code;
+  return stan::services::error_codes::OK;
 }
 
 /**
@@ -713,7 +788,7 @@ unsigned int get_num_chains(argument_parser &parser) {
  *
  * @param parser user config
  */
-void check_file_config(argument_parser &parser) {
+inline void check_file_config(argument_parser &parser) {
   std::string sample_file
       = get_arg_val<string_argument>(parser, "output", "file");
   auto user_method = parser.arg("method");
@@ -750,6 +825,123 @@ void check_file_config(argument_parser &parser) {
   }
 }
 
+/**
+ * Writer which forwards all output to another writer and keeps
+ * the column names and the last row of values written.
+ * Used to compare the results of several runs of an algorithm,
+ * e.g., the final estimate of an optimizer, which is the last row
+ * it writes, or the final ELBO written to the ADVI diagnostic output.
+ */
+class last_row_writer : public stan::callbacks::writer {
+ public:
+  explicit last_row_writer(stan::callbacks::writer &writer)
+      : writer_(writer) {}
+
+  void operator()(const std::vector<std::string> &names) override {
+    names_ = names;
+    writer_(names);
+  }
+
+  void operator()(const std::vector<double> &values) override {
+    values_ = values;
+    writer_(values);
+  }
+
+  void operator()() override { writer_(); }
+
+  void operator()(const std::string &message) override { writer_(message); }
+
+  const std::vector<std::string> &names() const { return names_; }
+
+  const std::vector<double> &values() const { return values_; }
+
+ private:
+  stan::callbacks::writer &writer_;
+  std::vector<std::string> names_;
+  std::vector<double> values_;
+};
+
+/**
+ * Writer which forwards all output to two writers.
+ */
+class tee_writer : public stan::callbacks::writer {
+ public:
+  tee_writer(stan::callbacks::writer &first, stan::callbacks::writer &second)
+      : first_(first), second_(second) {}
+
+  void operator()(const std::vector<std::string> &names) override {
+    first_(names);
+    second_(names);
+  }
+
+  void operator()(const std::vector<double> &values) override {
+    first_(values);
+    second_(values);
+  }
+
+  void operator()() override {
+    first_();
+    second_();
+  }
+
+  void operator()(const std::string &message) override {
+    first_(message);
+    second_(message);
+  }
+
+ private:
+  stan::callbacks::writer &first_;
+  stan::callbacks::writer &second_;
+};
+
+/**
+ * Find the run with the largest value in a column of the last row
+ * written, among the runs which succeeded and wrote such a row.
+ *
+ * @param writers per-run writers
+ * @param return_codes per-run return codes
+ * @param col column index
+ * @return index of the best run, or -1 if there is none
+ */
+inline int best_run(const std::vector<last_row_writer> &writers,
+                    const std::vector<int> &return_codes, size_t col) {
+  int best = -1;
+  for (size_t i = 0; i < writers.size(); ++i) {
+    if (return_codes[i] != stan::services::error_codes::OK
+        || writers[i].values().size() <= col)
+      continue;
+    if (best < 0 || writers[i].values()[col] > writers[best].values()[col])
+      best = i;
+  }
+  return best;
+}
+
+/**
+ * Find the optimization run with the highest log density (column `lp__`)
+ * among the runs which succeeded, and write its estimate to a writer.
+ * Returns the index of the best run, or -1 if no run succeeded.
+ *
+ * @param writers per-run writers holding the final estimates
+ * @param return_codes per-run return codes
+ * @param id chain id of the first run
+ * @param writer output writer for the best estimate
+ * @return index of the best run, or -1
+ */
+inline int write_best_mode(const std::vector<last_row_writer> &writers,
+                           const std::vector<int> &return_codes,
+                           unsigned int id, stan::callbacks::writer &writer) {
+  int best = best_run(writers, return_codes, 0);
+  if (best < 0)
+    return best;
+  std::stringstream msg;
+  msg << "Mode of optimization run " << (id + best) << ", best of "
+      << writers.size() << " runs";
+  writer(msg.str());
+  writer(writers[best].names());
+  writer(writers[best].values());
+  return best;
+}
+
 template <typename T>
 void init_null_writers(std::vector<T> &writers, size_t num_chains) {
   writers.reserve(num_chains);
@@ -758,21 +950,43 @@ void init_null_writers(std::vector<T> &writers, size_t num_chains) {
   }
 }
 
+/**
+ * Open one file stream writer per file name, with the given open mode.
+ * The streams remain owned by the writers; pointers to them are returned
+ * so that the caller can flush them.
+ *
+ * @param writers output, writers
+ * @param filenames names of files
+ * @param mode open mode of the files
+ * @param sig_figs precision of the streams, -1 for the default
+ * @param args further arguments of the writers' constructor
+ * @return file streams of the writers
+ */
 template <typename T, typename... Ts>
-void init_filestream_writers(std::vector<T> &writers, unsigned int num_chains,
-                             unsigned int id, std::string &filename,
-                             std::string tag, std::string suffix, int sig_figs,
-                             Ts &&... args) {
-  writers.reserve(num_chains);
-  auto filenames = make_filenames(filename, tag, suffix, num_chains, id);
-
-  for (size_t i = 0; i < num_chains; ++i) {
-    auto ofs = std::make_unique<std::ofstream>(filenames[i]);
+std::vector<std::ofstream *> open_filestream_writers(
+    std::vector<T> &writers, const std::vector<std::string> &filenames,
+    std::ios_base::openmode mode, int sig_figs, Ts &&... args) {
+  std::vector<std::ofstream *> streams;
+  writers.reserve(filenames.size());
+  for (const auto &fname : filenames) {
+    auto ofs = std::make_unique<std::ofstream>(fname, mode);
     if (sig_figs > -1) {
       ofs->precision(sig_figs);
     }
+    streams.push_back(ofs.get());
     writers.emplace_back(std::move(ofs), std::forward<Ts>(args)...);
   }
+  return streams;
+}
+
+template <typename T, typename... Ts>
+std::vector<std::ofstream *> init_filestream_writers(
+    std::vector<T> &writers, unsigned int num_chains, unsigned int id,
+    std::string &filename, std::string tag, std::string suffix, int sig_figs,
+    Ts &&... args) {
+  return open_filestream_writers(
+      writers, make_filenames(filename, tag, suffix, num_chains, id),
+      std::ios::out, sig_figs, std::forward<Ts>(args)...);
 }
 
 }  // namespace cmdstan
@@ -0,0 +1,51 @@
+#include <cmdstan/command_context.hpp>
+#include <cmdstan/file_fingerprint.hpp>
+#include <cmdstan/laplace_sample.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace cmdstan {
+
+int run_laplace(command_context &context) {
+  auto &parser = context.parser;
+  auto &model = context.model;
+  auto &random_seed = context.random_seed;
+  auto &num_threads = context.num_threads;
+  auto &refresh = context.refresh;
+  auto &filename = context.data_file;
+  auto &interrupt = context.interrupt;
+  auto &logger = context.logger;
+  auto &sample_writers = context.sample_writers;
+  int return_code = return_codes::NOT_OK;
+  std::stringstream msg;
+
+  auto laplace_arg = parser.arg("method")->arg("laplace");
+  std::string fname = get_arg_val<string_argument>(*laplace_arg, "mode");
+  if (fname.empty()) {
+    msg << "Missing mode argument, cannot get laplace sample "
+           "without parameter estimates theta-hat";
+    throw std::invalid_argument(msg.str());
+  }
+  Eigen::VectorXd theta_hat = get_laplace_mode(fname, model);
+  bool jacobian = get_arg_val<bool_argument>(*laplace_arg, "jacobian");
+  int draws = get_arg_val<int_argument>(*laplace_arg, "draws");
+  std::string hessian_file
+      = get_arg_val<string_argument>(*laplace_arg, "hessian_file");
+  std::uint64_t data_hash = 0;
+  if (!hessian_file.empty() && !filename.empty())
+    data_hash = get_file_fingerprint(filename).hash;
+  if (jacobian) {
+    return_code = cmdstan::laplace_sample<true>(
+        model, theta_hat, draws, random_seed, num_threads, refresh,
+        hessian_file, data_hash, interrupt, logger, sample_writers[0]);
+  } else {
+    return_code = cmdstan::laplace_sample<false>(
+        model, theta_hat, draws, random_seed, num_threads, refresh,
+        hessian_file, data_hash, interrupt, logger, sample_writers[0]);
+  }
+  return return_code;
+}
+
+}  // namespace cmdstan
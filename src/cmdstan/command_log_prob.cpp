@@ -0,0 +1,88 @@
+#include <cmdstan/command_context.hpp>
+#include <cmdstan/log_prob_stream.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+int run_log_prob(command_context &context) {
+  auto &parser = context.parser;
+  auto &model = context.model;
+  auto &id = context.id;
+  auto &random_seed = context.random_seed;
+  auto &sig_figs = context.sig_figs;
+  auto &log_prob_stream = context.log_prob_stream;
+  auto &responses = context.responses;
+  auto &sample_writers = context.sample_writers;
+  int return_code = return_codes::NOT_OK;
+  std::stringstream msg;
+
+  auto log_prob_arg = parser.arg("method")->arg("log_prob");
+  std::string upars_file
+      = get_arg_val<string_argument>(*log_prob_arg, "unconstrained_params");
+  std::string cpars_file
+      = get_arg_val<string_argument>(*log_prob_arg, "constrained_params");
+  bool jacobian = get_arg_val<bool_argument>(*log_prob_arg, "jacobian");
+  if (!log_prob_stream.empty()) {
+    if (log_prob_stream != "text" && log_prob_stream != "binary") {
+      msg << "Unknown log_prob stream format \"" << log_prob_stream
+          << "\", must be \"text\" or \"binary\".";
+      throw std::invalid_argument(msg.str());
+    }
+    if (upars_file.length() > 0 || cpars_file.length() > 0) {
+      msg << "Cannot specify input files of parameter values "
+          << "in stream mode.";
+      throw std::invalid_argument(msg.str());
+    }
+    auto rng = stan::services::util::create_rng(random_seed, id);
+    if (log_prob_stream == "text")
+      return_code = services_log_prob_stream_text(
+          model, jacobian, rng, sig_figs, std::cin, responses);
+    else
+      return_code = services_log_prob_stream_binary(
+          model, jacobian, rng, std::cin, responses);
+  } else {
+    if (upars_file.length() == 0 && cpars_file.length() == 0) {
+      msg << "No input parameter files provided, "
+          << "cannot calculate log probability density.";
+      throw std::invalid_argument(msg.str());
+    }
+    if (upars_file.length() > 0 && cpars_file.length() > 0) {
+      msg << "Cannot specify both input files of both "
+          << "constrained and unconstrained parameter values.";
+      throw std::invalid_argument(msg.str());
+    }
+    std::vector<std::vector<double>> params_r_ind;
+    if (upars_file.length() > 0) {
+      params_r_ind = get_uparams_r(upars_file, model);
+    } else if (cpars_file.length() > 0) {
+      std::vector<std::string> param_names
+          = get_constrained_param_names(model);
+      if (get_suffix(cpars_file) == ".csv") {
+        stan::io::stan_csv fitted_params;
+        size_t col_offset, num_rows, num_cols;
+        parse_stan_csv(cpars_file, model, param_names, fitted_params,
+                       col_offset, num_rows, num_cols);
+        params_r_ind = unconstrain_params_csv(
+            model, fitted_params, col_offset, num_rows, num_cols);
+      } else {
+        params_r_ind = {unconstrain_params_var_context(cpars_file, model)};
+      }
+    }
+    try {
+      services_log_prob_grad(model, jacobian, params_r_ind, sig_figs,
+                             sample_writers[0].get_stream());
+      return_code = return_codes::OK;
+    } catch (const std::exception &e) {
+      return_code = return_codes::NOT_OK;
+    }
+  }
+  return return_code;
+}
+
+}  // namespace cmdstan
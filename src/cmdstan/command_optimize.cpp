@@ -0,0 +1,146 @@
+#include <cmdstan/command_context.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <cmdstan/write_config.hpp>
+#include <stan/services/optimize/bfgs.hpp>
+#include <stan/services/optimize/lbfgs.hpp>
+#include <stan/services/optimize/newton.hpp>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace cmdstan {
+
+int run_optimize(command_context &context) {
+  auto &parser = context.parser;
+  auto &model = context.model;
+  auto &num_chains = context.num_chains;
+  auto &id = context.id;
+  auto &random_seed = context.random_seed;
+  auto &sig_figs = context.sig_figs;
+  auto &refresh = context.refresh;
+  auto &init_radius = context.init_radius;
+  auto &output_base = context.output_base;
+  auto &interrupt = context.interrupt;
+  auto &logger = context.logger;
+  auto &init_contexts = context.init_contexts;
+  auto &init_writers = context.init_writers;
+  auto &sample_writers = context.sample_writers;
+  int return_code = return_codes::NOT_OK;
+  std::stringstream msg;
+
+  int num_iterations
+      = get_arg_val<int_argument>(parser, "method", "optimize", "iter");
+  bool save_iterations = get_arg_val<bool_argument>(
+      parser, "method", "optimize", "save_iterations");
+  bool jacobian
+      = get_arg_val<bool_argument>(parser, "method", "optimize", "jacobian");
+  list_argument *algo = dynamic_cast<list_argument *>(
+      parser.arg("method")->arg("optimize")->arg("algorithm"));
+  std::vector<last_row_writer> mode_writers;
+  mode_writers.reserve(num_chains);
+  for (size_t i = 0; i < num_chains; ++i)
+    mode_writers.emplace_back(sample_writers[i]);
+  auto optimize = [&](size_t i) {
+    if (algo->value() == "newton") {
+      if (jacobian) {
+        return stan::services::optimize::newton<stan::model::model_base,
+                                                 true>(
+            model, *(init_contexts[i]), random_seed, id + i, init_radius,
+            num_iterations, save_iterations, interrupt, logger,
+            init_writers[i], mode_writers[i]);
+      } else {
+        return stan::services::optimize::newton<stan::model::model_base,
+                                                 false>(
+            model, *(init_contexts[i]), random_seed, id + i, init_radius,
+            num_iterations, save_iterations, interrupt, logger,
+            init_writers[i], mode_writers[i]);
+      }
+    } else if (algo->value() == "bfgs") {
+      double init_alpha
+          = get_arg_val<real_argument>(*algo, "bfgs", "init_alpha");
+      double tol_obj = get_arg_val<real_argument>(*algo, "bfgs", "tol_obj");
+      double tol_rel_obj
+          = get_arg_val<real_argument>(*algo, "bfgs", "tol_rel_obj");
+      double tol_grad
+          = get_arg_val<real_argument>(*algo, "bfgs", "tol_grad");
+      double tol_rel_grad
+          = get_arg_val<real_argument>(*algo, "bfgs", "tol_rel_grad");
+      double tol_param
+          = get_arg_val<real_argument>(*algo, "bfgs", "tol_param");
+
+      if (jacobian) {
+        return stan::services::optimize::bfgs<stan::model::model_base, true>(
+            model, *(init_contexts[i]), random_seed, id + i, init_radius,
+            init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad,
+            tol_param, num_iterations, save_iterations, refresh, interrupt,
+            logger, init_writers[i], mode_writers[i]);
+      } else {
+        return stan::services::optimize::bfgs<stan::model::model_base,
+                                               false>(
+            model, *(init_contexts[i]), random_seed, id + i, init_radius,
+            init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad,
+            tol_param, num_iterations, save_iterations, refresh, interrupt,
+            logger, init_writers[i], mode_writers[i]);
+      }
+    } else if (algo->value() == "lbfgs") {
+      int history_size
+          = get_arg_val<int_argument>(*algo, "lbfgs", "history_size");
+      double init_alpha
+          = get_arg_val<real_argument>(*algo, "lbfgs", "init_alpha");
+      double tol_obj = get_arg_val<real_argument>(*algo, "lbfgs", "tol_obj");
+      double tol_rel_obj
+          = get_arg_val<real_argument>(*algo, "lbfgs", "tol_rel_obj");
+      double tol_grad
+          = get_arg_val<real_argument>(*algo, "lbfgs", "tol_grad");
+      double tol_rel_grad
+          = get_arg_val<real_argument>(*algo, "lbfgs", "tol_rel_grad");
+      double tol_param
+          = get_arg_val<real_argument>(*algo, "lbfgs", "tol_param");
+
+      if (jacobian) {
+        return stan::services::optimize::lbfgs<stan::model::model_base,
+                                                true>(
+            model, *(init_contexts[i]), random_seed, id + i, init_radius,
+            history_size, init_alpha, tol_obj, tol_rel_obj, tol_grad,
+            tol_rel_grad, tol_param, num_iterations, save_iterations,
+            refresh, interrupt, logger, init_writers[i], mode_writers[i]);
+      } else {
+        return stan::services::optimize::lbfgs<stan::model::model_base,
+                                                false>(
+            model, *(init_contexts[i]), random_seed, id + i, init_radius,
+            history_size, init_alpha, tol_obj, tol_rel_obj, tol_grad,
+            tol_rel_grad, tol_param, num_iterations, save_iterations,
+            refresh, interrupt, logger, init_writers[i], mode_writers[i]);
+      }
+    }
+    return static_cast<int>(return_codes::NOT_OK);
+  };
+  if (num_chains == 1) {
+    return_code = optimize(0);
+  } else {
+    // independent runs, each with its own inits and output file;
+    // the best mode over all runs which succeeded is written
+    // to the combined output file
+    std::vector<int> run_codes(num_chains, return_codes::NOT_OK);
+    run_chains_parallel(num_chains, [&](size_t i) {
+      run_codes[i] = optimize(i);
+      return run_codes[i];
+    });
+    auto ofs = std::make_unique<std::ofstream>(output_base + ".csv");
+    if (sig_figs > -1)
+      ofs->precision(sig_figs);
+    stan::callbacks::unique_stream_writer<std::ofstream> best_writer(
+        std::move(ofs), "# ");
+    write_config(best_writer, parser, model);
+    if (write_best_mode(mode_writers, run_codes, id, best_writer) >= 0) {
+      return_code = return_codes::OK;
+    } else {
+      msg << "All " << num_chains << " optimization runs failed.";
+      logger.error(msg);
+    }
+  }
+  return return_code;
+}
+
+}  // namespace cmdstan
@@ -0,0 +1,80 @@
+#include <cmdstan/command_context.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <cmdstan/write_config.hpp>
+#include <stan/services/pathfinder/multi.hpp>
+#include <stan/services/pathfinder/single.hpp>
+#include <fstream>
+#include <memory>
+
+namespace cmdstan {
+
+int run_pathfinder(command_context &context) {
+  auto &parser = context.parser;
+  auto &model = context.model;
+  auto &num_chains = context.num_chains;
+  auto &id = context.id;
+  auto &random_seed = context.random_seed;
+  auto &sig_figs = context.sig_figs;
+  auto &refresh = context.refresh;
+  auto &init_radius = context.init_radius;
+  auto &output_base = context.output_base;
+  auto &diagnostic_file = context.diagnostic_file;
+  auto &save_single_paths = context.save_single_paths;
+  auto &interrupt = context.interrupt;
+  auto &logger = context.logger;
+  auto &init_contexts = context.init_contexts;
+  auto &init_writers = context.init_writers;
+  auto &sample_writers = context.sample_writers;
+  auto &diagnostic_json_writers = context.diagnostic_json_writers;
+  stan::callbacks::json_writer<std::ofstream> dummy_json_writer;
+  stan::callbacks::writer init_writer;  // unused - save param initializations
+  int return_code = return_codes::NOT_OK;
+
+  auto pathfinder_arg = parser.arg("method")->arg("pathfinder");
+  int history_size
+      = get_arg_val<int_argument>(*pathfinder_arg, "history_size");
+  double init_alpha
+      = get_arg_val<real_argument>(*pathfinder_arg, "init_alpha");
+  double tol_obj = get_arg_val<real_argument>(*pathfinder_arg, "tol_obj");
+  double tol_rel_obj
+      = get_arg_val<real_argument>(*pathfinder_arg, "tol_rel_obj");
+  double tol_grad = get_arg_val<real_argument>(*pathfinder_arg, "tol_grad");
+  double tol_rel_grad
+      = get_arg_val<real_argument>(*pathfinder_arg, "tol_rel_grad");
+  double tol_param = get_arg_val<real_argument>(*pathfinder_arg, "tol_param");
+  int max_lbfgs_iters
+      = get_arg_val<int_argument>(*pathfinder_arg, "max_lbfgs_iters");
+  int num_elbo_draws
+      = get_arg_val<int_argument>(*pathfinder_arg, "num_elbo_draws");
+  int num_draws = get_arg_val<int_argument>(*pathfinder_arg, "num_draws");
+  int num_psis_draws
+      = get_arg_val<int_argument>(*pathfinder_arg, "num_psis_draws");
+  if (num_chains == 1) {
+    save_single_paths = save_single_paths || !diagnostic_file.empty();
+    return_code = stan::services::pathfinder::pathfinder_lbfgs_single<
+        false, stan::model::model_base>(
+        model, *(init_contexts[0]), random_seed, id, init_radius,
+        history_size, init_alpha, tol_obj, tol_rel_obj, tol_grad,
+        tol_rel_grad, tol_param, max_lbfgs_iters, num_elbo_draws, num_draws,
+        save_single_paths, refresh, interrupt, logger, init_writer,
+        sample_writers[0], diagnostic_json_writers[0]);
+  } else {
+    auto ofs = std::make_unique<std::ofstream>(output_base + ".csv");
+    if (sig_figs > -1)
+      ofs->precision(sig_figs);
+    stan::callbacks::unique_stream_writer<std::ofstream> pathfinder_writer(
+        std::move(ofs), "# ");
+    write_config(pathfinder_writer, parser, model);
+    return_code = stan::services::pathfinder::pathfinder_lbfgs_multi<
+        stan::model::model_base>(
+        model, init_contexts, random_seed, id, init_radius, history_size,
+        init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad, tol_param,
+        max_lbfgs_iters, num_elbo_draws, num_draws, num_psis_draws,
+        num_chains, save_single_paths, refresh, interrupt, logger,
+        init_writers, sample_writers, diagnostic_json_writers,
+        pathfinder_writer, dummy_json_writer);
+  }
+  return return_code;
+}
+
+}  // namespace cmdstan
@@ -0,0 +1,439 @@
+#include <cmdstan/command_context.hpp>
+#include <cmdstan/nuts_chains.hpp>
+#include <cmdstan/pathfinder_init.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <cmdstan/shm_ring_buffer.hpp>
+#include <cmdstan/warm_start.hpp>
+#include <stan/services/sample/fixed_param.hpp>
+#include <stan/services/sample/hmc_nuts_dense_e.hpp>
+#include <stan/services/sample/hmc_nuts_dense_e_adapt.hpp>
+#include <stan/services/sample/hmc_nuts_diag_e.hpp>
+#include <stan/services/sample/hmc_nuts_diag_e_adapt.hpp>
+#include <stan/services/sample/hmc_nuts_unit_e.hpp>
+#include <stan/services/sample/hmc_nuts_unit_e_adapt.hpp>
+#include <stan/services/sample/hmc_static_dense_e.hpp>
+#include <stan/services/sample/hmc_static_dense_e_adapt.hpp>
+#include <stan/services/sample/hmc_static_diag_e.hpp>
+#include <stan/services/sample/hmc_static_diag_e_adapt.hpp>
+#include <stan/services/sample/hmc_static_unit_e.hpp>
+#include <stan/services/sample/hmc_static_unit_e_adapt.hpp>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+int run_sample(command_context &context) {
+  auto &parser = context.parser;
+  auto &model = context.model;
+  auto &num_chains = context.num_chains;
+  auto &id = context.id;
+  auto &random_seed = context.random_seed;
+  auto &refresh = context.refresh;
+  auto &init = context.init;
+  auto &init_radius = context.init_radius;
+  auto &shm_name = context.shm_name;
+  auto &interrupt = context.interrupt;
+  auto &logger = context.logger;
+  auto &info = context.info;
+  auto &init_contexts = context.init_contexts;
+  auto &init_writers = context.init_writers;
+  auto &sample_writers = context.sample_writers;
+  auto &diagnostic_csv_writers = context.diagnostic_csv_writers;
+  auto &metric_json_writers = context.metric_json_writers;
+  auto &checkpoints = context.checkpoints;
+  auto &files = context.files;
+  int return_code = return_codes::NOT_OK;
+  std::stringstream msg;
+
+  int num_warmup
+      = get_arg_val<int_argument>(parser, "method", "sample", "num_warmup");
+  int num_samples
+      = get_arg_val<int_argument>(parser, "method", "sample", "num_samples");
+  int num_thin
+      = get_arg_val<int_argument>(parser, "method", "sample", "thin");
+  bool save_warmup
+      = get_arg_val<bool_argument>(parser, "method", "sample", "save_warmup");
+
+  bool adapt_engaged = get_arg_val<bool_argument>(parser, "method", "sample",
+                                                  "adapt", "engaged");
+  std::string warm_start = get_arg_val<string_argument>(
+      parser, "method", "sample", "adapt", "warm_start");
+  if (!warm_start.empty() && num_warmup == 0) {
+    // sample with the step size and metric of the previous run
+    adapt_engaged = false;
+  }
+  if (adapt_engaged == true && num_warmup == 0) {
+    msg << "The number of warmup samples (num_warmup) must be greater than "
+        << "zero if adaptation is enabled." << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  list_argument *algo = dynamic_cast<list_argument *>(
+      parser.arg("method")->arg("sample")->arg("algorithm"));
+  std::string algo_name = algo->value();
+  if (model.num_params_r() == 0 || algo_name == "fixed_param") {
+    if (algo_name != "fixed_param") {
+      info(
+          "Model contains no parameters, running fixed_param sampler, "
+          "no updates to Markov chain");
+    }
+    return_code = stan::services::sample::fixed_param(
+        model, num_chains, init_contexts, random_seed, id, init_radius,
+        num_samples, num_thin, refresh, interrupt, logger, init_writers,
+        sample_writers, diagnostic_csv_writers);
+  } else if (algo_name == "hmc") {
+    list_argument *metric_arg
+        = dynamic_cast<list_argument *>(parser.arg("method")
+                                            ->arg("sample")
+                                            ->arg("algorithm")
+                                            ->arg("hmc")
+                                            ->arg("metric"));
+    std::string metric = metric_arg->value();
+    std::string metric_file = get_arg_val<string_argument>(
+        parser, "method", "sample", "algorithm", "hmc", "metric_file");
+    bool metric_supplied = !metric_file.empty();
+    context_vector metric_contexts;
+    if (metric_supplied) {
+      metric_contexts = get_vec_var_context(metric_file, num_chains, id);
+    }
+    double stepsize = get_arg_val<real_argument>(
+        parser, "method", "sample", "algorithm", "hmc", "stepsize");
+    double jitter = get_arg_val<real_argument>(
+        parser, "method", "sample", "algorithm", "hmc", "stepsize_jitter");
+    bool pathfinder_init = get_arg_val<bool_argument>(
+        parser, "method", "sample", "pathfinder_init");
+    if (!warm_start.empty()) {
+      if (pathfinder_init) {
+        msg << "Arguments 'warm_start' and 'pathfinder_init' cannot "
+               "both be used.";
+        throw std::invalid_argument(msg.str());
+      }
+      // user-supplied inits, metric, and step size take precedence
+      auto warm_starts
+          = read_warm_starts(model, warm_start, num_chains, id);
+      double warm_stepsize = 0;
+      for (size_t i = 0; i < num_chains; ++i) {
+        if (init.empty())
+          init_contexts[i] = params_var_context(model, warm_starts[i].params);
+        warm_stepsize += warm_starts[i].stepsize / num_chains;
+      }
+      if (!metric_supplied && metric != "unit_e") {
+        metric_contexts.clear();
+        for (size_t i = 0; i < num_chains; ++i)
+          metric_contexts.push_back(metric_var_context(
+              warm_starts[i].inv_metric, metric == "dense_e"));
+        metric_supplied = true;
+      }
+      auto *stepsize_arg = dynamic_cast<real_argument *>(get_arg(
+          parser, "method", "sample", "algorithm", "hmc", "stepsize"));
+      if (stepsize_arg->is_default())
+        stepsize = warm_stepsize;
+    }
+    if (pathfinder_init) {
+      // a user-supplied metric takes precedence over pathfinder's
+      context_vector pathfinder_metrics;
+      return_code = pathfinder_inits(
+          model, init, random_seed, id, init_radius, num_chains,
+          metric_supplied ? "unit_e" : metric, refresh, interrupt, logger,
+          init_contexts, pathfinder_metrics);
+      if (return_code != return_codes::OK) {
+        msg << "Pathfinder initialization failed.";
+        throw std::invalid_argument(msg.str());
+      }
+      if (!pathfinder_metrics.empty()) {
+        metric_contexts = pathfinder_metrics;
+        metric_supplied = true;
+      }
+    }
+    list_argument *hmc_engine
+        = dynamic_cast<list_argument *>(algo->arg("hmc")->arg("engine"));
+    std::string engine = hmc_engine->value();
+    int checkpoint_every = get_arg_val<int_argument>(
+        parser, "method", "sample", "checkpoint_every");
+    bool early_stop = get_arg_val<bool_argument>(
+        parser, "method", "sample", "early_stop", "engaged");
+    // with a runtime limit, the default sampler stops cleanly
+    bool stepped_nuts
+        = get_arg_val<real_argument>(parser, "max_runtime") > 0
+          && engine == "nuts" && metric == "diag_e"
+          && !get_arg_val<bool_argument>(parser, "method", "sample",
+                                         "adapt", "save_metric");
+    if (checkpoint_every > 0 || !checkpoints.empty() || early_stop
+        || stepped_nuts || !shm_name.empty()) {
+      // NUTS with a diag_e metric, run in steps between checkpoints
+      // and convergence checks
+      nuts_config config;
+      config.num_warmup = num_warmup;
+      config.num_samples = num_samples;
+      config.num_thin = num_thin;
+      config.save_warmup = save_warmup;
+      config.refresh = refresh;
+      config.stepsize = stepsize;
+      config.stepsize_jitter = jitter;
+      config.max_depth
+          = get_arg_val<int_argument>(parser, "method", "sample", "algorithm",
+                                      "hmc", "engine", "nuts", "max_depth");
+      config.adapt_engaged = adapt_engaged;
+      config.delta = get_arg_val<real_argument>(parser, "method", "sample",
+                                                "adapt", "delta");
+      config.gamma = get_arg_val<real_argument>(parser, "method", "sample",
+                                                "adapt", "gamma");
+      config.kappa = get_arg_val<real_argument>(parser, "method", "sample",
+                                                "adapt", "kappa");
+      config.t0 = get_arg_val<real_argument>(parser, "method", "sample",
+                                             "adapt", "t0");
+      config.init_buffer = get_arg_val<u_int_argument>(
+          parser, "method", "sample", "adapt", "init_buffer");
+      config.term_buffer = get_arg_val<u_int_argument>(
+          parser, "method", "sample", "adapt", "term_buffer");
+      config.window = get_arg_val<u_int_argument>(parser, "method", "sample",
+                                                   "adapt", "window");
+      config.checkpoint_every = checkpoint_every;
+      config.early_stop = early_stop;
+      config.target_rhat = get_arg_val<real_argument>(
+          parser, "method", "sample", "early_stop", "rhat");
+      config.target_ess = get_arg_val<real_argument>(
+          parser, "method", "sample", "early_stop", "ess");
+      config.check_every = get_arg_val<int_argument>(
+          parser, "method", "sample", "early_stop", "check_every");
+      int shm_rows = get_arg_val<int_argument>(parser, "output", "shm_rows");
+      std::vector<std::unique_ptr<stan::callbacks::writer>> shm_writers;
+      std::vector<tee_writer> draw_writers;
+      draw_writers.reserve(num_chains);
+      for (size_t i = 0; i < num_chains; ++i) {
+        if (shm_name.empty())
+          shm_writers.push_back(std::make_unique<stan::callbacks::writer>());
+        else
+          shm_writers.push_back(std::make_unique<shm_ring_writer>(
+              num_chains == 1 ? shm_name
+                              : shm_name + "_" + std::to_string(id + i),
+              shm_rows));
+        draw_writers.emplace_back(sample_writers[i], *shm_writers[i]);
+      }
+      return_code = run_nuts_chains(
+          model, config, num_chains, init_contexts,
+          metric_supplied ? metric_contexts : context_vector{}, random_seed,
+          id, init_radius, checkpoints, files, interrupt, logger,
+          init_writers, draw_writers, diagnostic_csv_writers);
+    } else if (engine == "nuts") {
+      int max_depth
+          = get_arg_val<int_argument>(parser, "method", "sample", "algorithm",
+                                      "hmc", "engine", "nuts", "max_depth");
+      if (adapt_engaged == false) {
+        // NUTS, no adaptation
+        if (metric == "dense_e" && metric_supplied == true) {
+          return_code = stan::services::sample::hmc_nuts_dense_e(
+              model, num_chains, init_contexts, metric_contexts, random_seed,
+              id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
+              refresh, stepsize, jitter, max_depth, interrupt, logger,
+              init_writers, sample_writers, diagnostic_csv_writers);
+        } else if (metric == "dense_e") {
+          return_code = stan::services::sample::hmc_nuts_dense_e(
+              model, num_chains, init_contexts, random_seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, jitter, max_depth, interrupt, logger, init_writers,
+              sample_writers, diagnostic_csv_writers);
+        } else if (metric == "diag_e" && metric_supplied == true) {
+          return_code = stan::services::sample::hmc_nuts_diag_e(
+              model, num_chains, init_contexts, metric_contexts, random_seed,
+              id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
+              refresh, stepsize, jitter, max_depth, interrupt, logger,
+              init_writers, sample_writers, diagnostic_csv_writers);
+        } else if (metric == "diag_e") {
+          return_code = stan::services::sample::hmc_nuts_diag_e(
+              model, num_chains, init_contexts, random_seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, jitter, max_depth, interrupt, logger, init_writers,
+              sample_writers, diagnostic_csv_writers);
+        } else if (metric == "unit_e") {
+          return_code = stan::services::sample::hmc_nuts_unit_e(
+              model, num_chains, init_contexts, random_seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, jitter, max_depth, interrupt, logger, init_writers,
+              sample_writers, diagnostic_csv_writers);
+        }
+      } else {
+        // NUTS adaptation
+        double delta = get_arg_val<real_argument>(parser, "method", "sample",
+                                                  "adapt", "delta");
+        double gamma = get_arg_val<real_argument>(parser, "method", "sample",
+                                                  "adapt", "gamma");
+        double kappa = get_arg_val<real_argument>(parser, "method", "sample",
+                                                  "adapt", "kappa");
+        double t0 = get_arg_val<real_argument>(parser, "method", "sample",
+                                               "adapt", "t0");
+        unsigned int init_buffer = get_arg_val<u_int_argument>(
+            parser, "method", "sample", "adapt", "init_buffer");
+        unsigned int term_buffer = get_arg_val<u_int_argument>(
+            parser, "method", "sample", "adapt", "term_buffer");
+        unsigned int window = get_arg_val<u_int_argument>(
+            parser, "method", "sample", "adapt", "window");
+
+        if (metric == "dense_e" && metric_supplied == true) {
+          return_code = stan::services::sample::hmc_nuts_dense_e_adapt(
+              model, num_chains, init_contexts, metric_contexts, random_seed,
+              id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
+              refresh, stepsize, jitter, max_depth, delta, gamma, kappa, t0,
+              init_buffer, term_buffer, window, interrupt, logger,
+              init_writers, sample_writers, diagnostic_csv_writers,
+              metric_json_writers);
+        } else if (metric == "dense_e") {
+          return_code = stan::services::sample::hmc_nuts_dense_e_adapt(
+              model, num_chains, init_contexts, random_seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, jitter, max_depth, delta, gamma, kappa, t0,
+              init_buffer, term_buffer, window, interrupt, logger,
+              init_writers, sample_writers, diagnostic_csv_writers,
+              metric_json_writers);
+        } else if (metric == "diag_e" && metric_supplied == true) {
+          return_code = stan::services::sample::hmc_nuts_diag_e_adapt(
+              model, num_chains, init_contexts, metric_contexts, random_seed,
+              id, init_radius, num_warmup, num_samples, num_thin, save_warmup,
+              refresh, stepsize, jitter, max_depth, delta, gamma, kappa, t0,
+              init_buffer, term_buffer, window, interrupt, logger,
+              init_writers, sample_writers, diagnostic_csv_writers,
+              metric_json_writers);
+        } else if (metric == "diag_e") {
+          return_code = stan::services::sample::hmc_nuts_diag_e_adapt(
+              model, num_chains, init_contexts, random_seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, jitter, max_depth, delta, gamma, kappa, t0,
+              init_buffer, term_buffer, window, interrupt, logger,
+              init_writers, sample_writers, diagnostic_csv_writers,
+              metric_json_writers);
+        } else if (metric == "unit_e") {
+          return_code = stan::services::sample::hmc_nuts_unit_e_adapt(
+              model, num_chains, init_contexts, random_seed, id, init_radius,
+              num_warmup, num_samples, num_thin, save_warmup, refresh,
+              stepsize, jitter, max_depth, delta, gamma, kappa, t0, interrupt,
+              logger, init_writers, sample_writers, diagnostic_csv_writers,
+              metric_json_writers);
+        }
+      }
+    } else if (engine == "static") {
+      double int_time = get_arg_val<real_argument>(
+          parser, "method", "sample", "algorithm", "hmc", "engine", "static",
+          "int_time");
+      // the static HMC services run a single chain; run one per chain
+      // on the threadpool, each with its own inits, metric, and writers
+      if (adapt_engaged == false) {  // static, no adaptation
+        if (metric == "dense_e" && metric_supplied == true) {
+          return_code = run_chains_parallel(num_chains, [&](size_t i) {
+            return stan::services::sample::hmc_static_dense_e(
+                model, *(init_contexts[i]), *(metric_contexts[i]),
+                random_seed, id + i, init_radius, num_warmup, num_samples,
+                num_thin, save_warmup, refresh, stepsize, jitter, int_time,
+                interrupt, logger, init_writers[i], sample_writers[i],
+                diagnostic_csv_writers[i]);
+          });
+        } else if (metric == "dense_e") {
+          return_code = run_chains_parallel(num_chains, [&](size_t i) {
+            return stan::services::sample::hmc_static_dense_e(
+                model, *(init_contexts[i]), random_seed, id + i,
+                init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                refresh, stepsize, jitter, int_time, interrupt, logger,
+                init_writers[i], sample_writers[i],
+                diagnostic_csv_writers[i]);
+          });
+        } else if (metric == "diag_e" && metric_supplied == true) {
+          return_code = run_chains_parallel(num_chains, [&](size_t i) {
+            return stan::services::sample::hmc_static_diag_e(
+                model, *(init_contexts[i]), *(metric_contexts[i]),
+                random_seed, id + i, init_radius, num_warmup, num_samples,
+                num_thin, save_warmup, refresh, stepsize, jitter, int_time,
+                interrupt, logger, init_writers[i], sample_writers[i],
+                diagnostic_csv_writers[i]);
+          });
+        } else if (metric == "diag_e") {
+          return_code = run_chains_parallel(num_chains, [&](size_t i) {
+            return stan::services::sample::hmc_static_diag_e(
+                model, *(init_contexts[i]), random_seed, id + i,
+                init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                refresh, stepsize, jitter, int_time, interrupt, logger,
+                init_writers[i], sample_writers[i],
+                diagnostic_csv_writers[i]);
+          });
+        } else if (metric == "unit_e") {
+          return_code = run_chains_parallel(num_chains, [&](size_t i) {
+            return stan::services::sample::hmc_static_unit_e(
+                model, *(init_contexts[i]), random_seed, id + i,
+                init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                refresh, stepsize, jitter, int_time, interrupt, logger,
+                init_writers[i], sample_writers[i],
+                diagnostic_csv_writers[i]);
+          });
+        }
+      } else {  // static adaptation
+        double delta = get_arg_val<real_argument>(parser, "method", "sample",
+                                                  "adapt", "delta");
+        double gamma = get_arg_val<real_argument>(parser, "method", "sample",
+                                                  "adapt", "gamma");
+        double kappa = get_arg_val<real_argument>(parser, "method", "sample",
+                                                  "adapt", "kappa");
+        double t0 = get_arg_val<real_argument>(parser, "method", "sample",
+                                               "adapt", "t0");
+        unsigned int init_buffer = get_arg_val<u_int_argument>(
+            parser, "method", "sample", "adapt", "init_buffer");
+        unsigned int term_buffer = get_arg_val<u_int_argument>(
+            parser, "method", "sample", "adapt", "term_buffer");
+        unsigned int window = get_arg_val<u_int_argument>(
+            parser, "method", "sample", "adapt", "window");
+        if (metric == "dense_e" && metric_supplied == true) {
+          return_code = run_chains_parallel(num_chains, [&](size_t i) {
+            return stan::services::sample::hmc_static_dense_e_adapt(
+                model, *(init_contexts[i]), *(metric_contexts[i]),
+                random_seed, id + i, init_radius, num_warmup, num_samples,
+                num_thin, save_warmup, refresh, stepsize, jitter, int_time,
+                delta, gamma, kappa, t0, init_buffer, term_buffer, window,
+                interrupt, logger, init_writers[i], sample_writers[i],
+                diagnostic_csv_writers[i]);
+          });
+        } else if (metric == "dense_e") {
+          return_code = run_chains_parallel(num_chains, [&](size_t i) {
+            return stan::services::sample::hmc_static_dense_e_adapt(
+                model, *(init_contexts[i]), random_seed, id + i,
+                init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                refresh, stepsize, jitter, int_time, delta, gamma, kappa, t0,
+                init_buffer, term_buffer, window, interrupt, logger,
+                init_writers[i], sample_writers[i],
+                diagnostic_csv_writers[i]);
+          });
+        } else if (metric == "diag_e" && metric_supplied == true) {
+          return_code = run_chains_parallel(num_chains, [&](size_t i) {
+            return stan::services::sample::hmc_static_diag_e_adapt(
+                model, *(init_contexts[i]), *(metric_contexts[i]),
+                random_seed, id + i, init_radius, num_warmup, num_samples,
+                num_thin, save_warmup, refresh, stepsize, jitter, int_time,
+                delta, gamma, kappa, t0, init_buffer, term_buffer, window,
+                interrupt, logger, init_writers[i], sample_writers[i],
+                diagnostic_csv_writers[i]);
+          });
+        } else if (metric == "diag_e") {
+          return_code = run_chains_parallel(num_chains, [&](size_t i) {
+            return stan::services::sample::hmc_static_diag_e_adapt(
+                model, *(init_contexts[i]), random_seed, id + i,
+                init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                refresh, stepsize, jitter, int_time, delta, gamma, kappa, t0,
+                init_buffer, term_buffer, window, interrupt, logger,
+                init_writers[i], sample_writers[i],
+                diagnostic_csv_writers[i]);
+          });
+        } else if (metric == "unit_e") {
+          return_code = run_chains_parallel(num_chains, [&](size_t i) {
+            return stan::services::sample::hmc_static_unit_e_adapt(
+                model, *(init_contexts[i]), random_seed, id + i,
+                init_radius, num_warmup, num_samples, num_thin, save_warmup,
+                refresh, stepsize, jitter, int_time, delta, gamma, kappa, t0,
+                interrupt, logger, init_writers[i], sample_writers[i],
+                diagnostic_csv_writers[i]);
+          });
+        }
+      }
+    }  // end static HMC
+  }
+  return return_code;
+}
+
+}  // namespace cmdstan
@@ -0,0 +1,104 @@
+#include <cmdstan/command_context.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <stan/services/experimental/advi/fullrank.hpp>
+#include <stan/services/experimental/advi/meanfield.hpp>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace cmdstan {
+
+int run_variational(command_context &context) {
+  auto &parser = context.parser;
+  auto &model = context.model;
+  auto &num_chains = context.num_chains;
+  auto &id = context.id;
+  auto &random_seed = context.random_seed;
+  auto &init_radius = context.init_radius;
+  auto &output_file = context.output_file;
+  auto &output_base = context.output_base;
+  auto &interrupt = context.interrupt;
+  auto &logger = context.logger;
+  auto &init_contexts = context.init_contexts;
+  auto &init_writers = context.init_writers;
+  auto &sample_writers = context.sample_writers;
+  auto &diagnostic_csv_writers = context.diagnostic_csv_writers;
+  int return_code = return_codes::NOT_OK;
+  std::stringstream msg;
+
+  list_argument *algo = dynamic_cast<list_argument *>(
+      parser.arg("method")->arg("variational")->arg("algorithm"));
+  std::string algorithm = algo->value();
+  int grad_samples = get_arg_val<int_argument>(parser, "method",
+                                               "variational", "grad_samples");
+  int elbo_samples = get_arg_val<int_argument>(parser, "method",
+                                               "variational", "elbo_samples");
+  int max_iterations
+      = get_arg_val<int_argument>(parser, "method", "variational", "iter");
+  double tol_rel_obj = get_arg_val<real_argument>(
+      parser, "method", "variational", "tol_rel_obj");
+  double eta
+      = get_arg_val<real_argument>(parser, "method", "variational", "eta");
+  bool adapt_engaged = get_arg_val<bool_argument>(
+      parser, "method", "variational", "adapt", "engaged");
+  int adapt_iterations = get_arg_val<int_argument>(
+      parser, "method", "variational", "adapt", "iter");
+  int eval_elbo = get_arg_val<int_argument>(parser, "method", "variational",
+                                            "eval_elbo");
+  int output_samples = get_arg_val<int_argument>(
+      parser, "method", "variational", "output_samples");
+  // the ELBO is written to the diagnostic output every eval_elbo iterations
+  std::vector<last_row_writer> elbo_writers;
+  elbo_writers.reserve(num_chains);
+  for (size_t i = 0; i < num_chains; ++i)
+    elbo_writers.emplace_back(diagnostic_csv_writers[i]);
+  auto variational = [&](size_t i) {
+    if (algorithm == "fullrank") {
+      return stan::services::experimental::advi::fullrank(
+          model, *(init_contexts[i]), random_seed, id + i, init_radius,
+          grad_samples, elbo_samples, max_iterations, tol_rel_obj, eta,
+          adapt_engaged, adapt_iterations, eval_elbo, output_samples,
+          interrupt, logger, init_writers[i], sample_writers[i],
+          elbo_writers[i]);
+    } else if (algorithm == "meanfield") {
+      return stan::services::experimental::advi::meanfield(
+          model, *(init_contexts[i]), random_seed, id + i, init_radius,
+          grad_samples, elbo_samples, max_iterations, tol_rel_obj, eta,
+          adapt_engaged, adapt_iterations, eval_elbo, output_samples,
+          interrupt, logger, init_writers[i], sample_writers[i],
+          elbo_writers[i]);
+    }
+    return static_cast<int>(return_codes::NOT_OK);
+  };
+  if (num_chains == 1) {
+    return_code = variational(0);
+  } else {
+    // independent runs, each with its own inits and output file;
+    // the output of the run with the highest final ELBO is copied
+    // to the combined output file
+    std::vector<int> run_codes(num_chains, return_codes::NOT_OK);
+    run_chains_parallel(num_chains, [&](size_t i) {
+      run_codes[i] = variational(i);
+      return run_codes[i];
+    });
+    sample_writers.clear();  // close the per-run output files
+    int best = best_run(elbo_writers, run_codes, 2);
+    if (best >= 0) {
+      auto run_files
+          = make_filenames(output_file, "", ".csv", num_chains, id);
+      std::ifstream best_csv(run_files[best]);
+      std::ofstream combined_csv(output_base + ".csv");
+      combined_csv << best_csv.rdbuf();
+      combined_csv << "# ELBO of variational run " << (id + best)
+                   << ", best of " << num_chains
+                   << " runs: " << elbo_writers[best].values()[2] << "\n";
+      return_code = return_codes::OK;
+    } else {
+      msg << "All " << num_chains << " variational runs failed.";
+      logger.error(msg);
+    }
+  }
+  return return_code;
+}
+
+}  // namespace cmdstan
@@ -0,0 +1,241 @@
+#ifndef CMDSTAN_CONVERGENCE_MONITOR_HPP
+#define CMDSTAN_CONVERGENCE_MONITOR_HPP
+
+#include <stan/analyze/mcmc/compute_effective_sample_size.hpp>
+#include <stan/analyze/mcmc/compute_potential_scale_reduction.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/math/prim.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Rank-normalize draws pooled across chains: replace each draw by
+ * `inv_Phi((r - 3/8) / (S + 1/4))`, where r is its rank among all S
+ * draws, with tied draws given their average rank (Vehtari et al., 2021).
+ *
+ * @param chains draws of one quantity, one vector per chain
+ * @return rank-normalized draws, one vector per chain
+ */
+inline std::vector<Eigen::VectorXd> rank_normalize(
+    const std::vector<Eigen::VectorXd> &chains) {
+  std::vector<std::pair<double, std::pair<size_t, Eigen::Index>>> draws;
+  for (size_t c = 0; c < chains.size(); ++c)
+    for (Eigen::Index n = 0; n < chains[c].size(); ++n)
+      draws.push_back({chains[c](n), {c, n}});
+  std::sort(draws.begin(), draws.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  std::vector<Eigen::VectorXd> z;
+  for (const auto &chain : chains)
+    z.emplace_back(chain.size());
+  double S = draws.size();
+  for (size_t begin = 0; begin < draws.size();) {
+    size_t end = begin + 1;
+    while (end < draws.size() && draws[end].first == draws[begin].first)
+      ++end;
+    double rank = 0.5 * (begin + 1 + end);
+    double z_rank = stan::math::inv_Phi((rank - 0.375) / (S + 0.25));
+    for (size_t k = begin; k < end; ++k)
+      z[draws[k].second.first](draws[k].second.second) = z_rank;
+    begin = end;
+  }
+  return z;
+}
+
+namespace internal {
+template <typename F>
+double apply_to_chains(F &&f, const std::vector<Eigen::VectorXd> &chains) {
+  std::vector<const double *> draws;
+  std::vector<size_t> sizes;
+  for (const auto &chain : chains) {
+    draws.push_back(chain.data());
+    sizes.push_back(chain.size());
+  }
+  return f(draws, sizes);
+}
+}  // namespace internal
+
+/**
+ * Rank-normalized split R-hat: the larger of the split R-hat of the
+ * rank-normalized draws and of the rank-normalized absolute deviations
+ * from the median (Vehtari et al., 2021).  NaN if all draws are equal.
+ *
+ * @param chains draws of one quantity, one vector per chain
+ * @return R-hat
+ */
+inline double rank_split_rhat(const std::vector<Eigen::VectorXd> &chains) {
+  auto rhat = [](auto &draws, auto &sizes) {
+    return stan::analyze::compute_split_potential_scale_reduction(draws,
+                                                                  sizes);
+  };
+  std::vector<double> all;
+  for (const auto &chain : chains)
+    all.insert(all.end(), chain.data(), chain.data() + chain.size());
+  std::nth_element(all.begin(), all.begin() + all.size() / 2, all.end());
+  double median = all[all.size() / 2];
+  std::vector<Eigen::VectorXd> folded;
+  for (const auto &chain : chains)
+    folded.push_back((chain.array() - median).abs().matrix());
+  double bulk = internal::apply_to_chains(rhat, rank_normalize(chains));
+  double tail = internal::apply_to_chains(rhat, rank_normalize(folded));
+  if (std::isnan(bulk) || std::isnan(tail))
+    return std::numeric_limits<double>::quiet_NaN();
+  return std::max(bulk, tail);
+}
+
+/**
+ * Bulk effective sample size: the split effective sample size of the
+ * rank-normalized draws (Vehtari et al., 2021).  NaN if all draws are
+ * equal.
+ *
+ * @param chains draws of one quantity, one vector per chain
+ * @return bulk ESS
+ */
+inline double bulk_ess(const std::vector<Eigen::VectorXd> &chains) {
+  auto ess = [](auto &draws, auto &sizes) {
+    return stan::analyze::compute_split_effective_sample_size(draws, sizes);
+  };
+  return internal::apply_to_chains(ess, rank_normalize(chains));
+}
+
+/**
+ * Writer which forwards all output to another writer and, while
+ * recording, keeps the rows of values written, so that diagnostics
+ * of the draws so far can be computed while a chain is running.
+ */
+class draws_recorder : public stan::callbacks::writer {
+ public:
+  explicit draws_recorder(stan::callbacks::writer &writer) : writer_(writer) {}
+
+  void operator()(const std::vector<std::string> &names) override {
+    names_ = names;
+    writer_(names);
+  }
+
+  void operator()(const std::vector<double> &values) override {
+    if (recording_ && values.size() == names_.size())
+      draws_.insert(draws_.end(), values.begin(), values.end());
+    writer_(values);
+  }
+
+  void operator()() override { writer_(); }
+
+  void operator()(const std::string &message) override { writer_(message); }
+
+  /**
+   * Start or stop recording draws.
+   */
+  void record(bool recording) { recording_ = recording; }
+
+  /**
+   * Add draws written before recording started, e.g., by an earlier
+   * run resumed from a checkpoint.
+   *
+   * @param names column names
+   * @param draws draws, one row per draw
+   */
+  void add(const std::vector<std::string> &names,
+           const Eigen::MatrixXd &draws) {
+    names_ = names;
+    for (Eigen::Index m = 0; m < draws.rows(); ++m)
+      for (Eigen::Index n = 0; n < draws.cols(); ++n)
+        draws_.push_back(draws(m, n));
+  }
+
+  const std::vector<std::string> &names() const { return names_; }
+
+  size_t num_draws() const {
+    return names_.empty() ? 0 : draws_.size() / names_.size();
+  }
+
+  /**
+   * Return the recorded draws of a column.
+   *
+   * @param col column index
+   * @return draws
+   */
+  Eigen::VectorXd column(size_t col) const {
+    size_t num_cols = names_.size();
+    Eigen::VectorXd x(num_draws());
+    for (Eigen::Index m = 0; m < x.size(); ++m)
+      x(m) = draws_[m * num_cols + col];
+    return x;
+  }
+
+ private:
+  stan::callbacks::writer &writer_;
+  std::vector<std::string> names_;
+  std::vector<double> draws_;
+  bool recording_ = false;
+};
+
+/**
+ * Largest rank-normalized split R-hat and smallest bulk ESS over
+ * `lp__` and the model's parameters, transformed parameters, and
+ * generated quantities.
+ */
+struct convergence_status {
+  double max_rhat = 0;
+  std::string max_rhat_name;
+  double min_ess = std::numeric_limits<double>::infinity();
+  std::string min_ess_name;
+  size_t num_draws = 0;  // per chain
+
+  bool converged(double target_rhat, double target_ess) const {
+    return num_draws > 0 && max_rhat <= target_rhat && min_ess >= target_ess;
+  }
+};
+
+/**
+ * Compute the convergence diagnostics of the draws recorded so far.
+ * All chains must have recorded the same columns.  Columns other than
+ * `lp__` whose names end in `__` hold sampler diagnostics and are
+ * skipped, as are columns whose draws are all equal.  Chains with
+ * fewer than four draws have no diagnostics.
+ *
+ * @param recorders draws recorded for each chain
+ * @return diagnostics
+ */
+inline convergence_status check_convergence(
+    const std::vector<draws_recorder> &recorders) {
+  convergence_status status;
+  size_t num_draws = recorders[0].num_draws();
+  for (const auto &recorder : recorders)
+    num_draws = std::min(num_draws, recorder.num_draws());
+  if (num_draws < 4)
+    return status;
+  status.num_draws = num_draws;
+  const auto &names = recorders[0].names();
+  for (size_t col = 0; col < names.size(); ++col) {
+    const std::string &name = names[col];
+    if (name != "lp__" && name.size() > 2
+        && name.compare(name.size() - 2, 2, "__") == 0)
+      continue;
+    std::vector<Eigen::VectorXd> chains;
+    for (const auto &recorder : recorders)
+      chains.push_back(recorder.column(col).head(num_draws));
+    double rhat = rank_split_rhat(chains);
+    double ess = bulk_ess(chains);
+    if (std::isnan(rhat) || std::isnan(ess))
+      continue;
+    if (rhat > status.max_rhat) {
+      status.max_rhat = rhat;
+      status.max_rhat_name = name;
+    }
+    if (ess < status.min_ess) {
+      status.min_ess = ess;
+      status.min_ess_name = name;
+    }
+  }
+  return status;
+}
+
+}  // namespace cmdstan
+#endif
@@ -1,53 +1,30 @@
 #include <cmdstan/stansummary_helper.hpp>
-#include <stan/mcmc/chains.hpp>
+#include <cmdstan/summary_draws.hpp>
 #include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <ios>
 #include <iostream>
+#include <utility>
 
 double RHAT_MAX = 1.05;
 
 void diagnose_usage() {
-  std::cout << "USAGE:  diagnose <filename 1> [<filename 2> ... <filename N>]"
+  std::cout << "USAGE:  diagnose [--single_precision] <filename 1> "
+               "[<filename 2> ... <filename N>]"
             << std::endl
             << std::endl;
 }
 
 /**
- * Diagnostic checks for NUTS-HMC sampler parameters.
+ * Run the diagnostic checks over a set of Stan csv files.
  *
- * @param argc Number of arguments
- * @param argv Arguments
- *
- * @return 0 for success,
- *         non-zero otherwise
+ * @tparam Chains type of container for the draws
+ * @param filenames names of readable Stan csv files
  */
-int main(int argc, const char *argv[]) {
-  if (argc == 1) {
-    diagnose_usage();
-    return 0;
-  }
-
-  // Parse any arguments specifying filenames
+template <typename Chains>
+void diagnose(const std::vector<std::string> &filenames) {
   std::ifstream ifstream;
-  std::vector<std::string> filenames;
-
-  for (int i = 1; i < argc; ++i) {
-    ifstream.open(argv[i]);
-    if (ifstream.good()) {
-      filenames.push_back(argv[i]);
-      ifstream.close();
-    } else {
-      std::cout << "File " << argv[i] << " not found" << std::endl;
-    }
-  }
-
-  if (!filenames.size()) {
-    std::cout << "No valid input files, exiting." << std::endl;
-    return 0;
-  }
-
   std::cout << std::fixed << std::setprecision(2);
 
   // Parse specified files
@@ -56,7 +33,7 @@ int main(int argc, const char *argv[]) {
 
   stan::io::stan_csv stan_csv
       = stan::io::stan_csv_reader::parse(ifstream, &std::cout);
-  stan::mcmc::chains<> chains(stan_csv);
+  Chains chains(std::move(stan_csv));
   ifstream.close();
 
   if (filenames.size() > 1)
@@ -69,7 +46,7 @@ int main(int argc, const char *argv[]) {
     std::cout << filenames[chain];
     ifstream.open(filenames[chain].c_str());
     stan_csv = stan::io::stan_csv_reader::parse(ifstream, &std::cout);
-    chains.add(stan_csv);
+    chains.add(std::move(stan_csv));
     ifstream.close();
     if (chain < filenames.size() - 1)
       std::cout << ", ";
@@ -214,6 +191,52 @@ int main(int argc, const char *argv[]) {
     std::cout << "Processing complete, no problems detected." << std::endl;
   else
     std::cout << "Processing complete." << std::endl;
+}
+
+/**
+ * Diagnostic checks for NUTS-HMC sampler parameters.
+ *
+ * @param argc Number of arguments
+ * @param argv Arguments
+ *
+ * @return 0 for success,
+ *         non-zero otherwise
+ */
+int main(int argc, const char *argv[]) {
+  if (argc == 1) {
+    diagnose_usage();
+    return 0;
+  }
+
+  // Parse any arguments specifying filenames
+  std::ifstream ifstream;
+  std::vector<std::string> filenames;
+  bool single_precision = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--single_precision") {
+      single_precision = true;
+      continue;
+    }
+    ifstream.open(argv[i]);
+    if (ifstream.good()) {
+      filenames.push_back(argv[i]);
+      ifstream.close();
+    } else {
+      std::cout << "File " << argv[i] << " not found" << std::endl;
+    }
+  }
+
+  if (!filenames.size()) {
+    std::cout << "No valid input files, exiting." << std::endl;
+    return 0;
+  }
+
+  // draws stored as float halve memory use, statistics are still double
+  if (single_precision)
+    diagnose<cmdstan::summary_draws<float>>(filenames);
+  else
+    diagnose<cmdstan::summary_draws<double>>(filenames);
 
   return 0;
 }
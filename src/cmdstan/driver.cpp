@@ -0,0 +1,60 @@
+#include <cmdstan/run_main.hpp>
+#include <cmdstan/shared_model.hpp>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+std::unique_ptr<cmdstan::shared_model_library> model_library;
+}
+
+/*
+ * The functions which a model executable links from the model's
+ * object file, forwarding to the loaded model library.
+ */
+stan::model::model_base &new_model(stan::io::var_context &data_context,
+                                   unsigned int seed,
+                                   std::ostream *msg_stream) {
+  return model_library->new_model(data_context, seed, msg_stream);
+}
+
+stan::math::profile_map &get_stan_profile_data() {
+  return model_library->profile_data();
+}
+
+void driver_usage() {
+  std::cout << "USAGE:  cmdstan_driver <model library> <arguments>..."
+            << std::endl
+            << std::endl
+            << "Run a model compiled into a shared library, e.g. with"
+            << std::endl
+            << "\"make foo/bar_model.so\", as the model executable would be "
+               "run,"
+            << std::endl
+            << "e.g. \"cmdstan_driver foo/bar_model.so sample data "
+               "file=bar.json\"."
+            << std::endl
+            << std::endl;
+}
+
+/**
+ * Generic driver of model libraries: loads the library given as the
+ * first argument and runs it with the remaining arguments, as the
+ * model executable would.  The library path takes the place of the
+ * program name in the output.
+ */
+int main(int argc, const char *argv[]) {
+  if (argc < 2 || argv[1][0] == '-') {
+    driver_usage();
+    return cmdstan::return_codes::NOT_OK;
+  }
+  try {
+    model_library = std::make_unique<cmdstan::shared_model_library>(argv[1]);
+  } catch (const std::invalid_argument &e) {
+    std::cerr << e.what() << std::endl;
+    return cmdstan::return_codes::NOT_OK;
+  }
+  std::vector<const char *> args(argv + 1, argv + argc);
+  return cmdstan::run_main(args.size(), args.data());
+}
@@ -0,0 +1,95 @@
+#ifndef CMDSTAN_FILE_FINGERPRINT_HPP
+#define CMDSTAN_FILE_FINGERPRINT_HPP
+
+#include <cmdstan/binary_io.hpp>
+#include <sys/stat.h>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Identifies the contents of a file by its size, its modification time
+ * and a 64-bit FNV-1a hash of its bytes.  Used to key cached results
+ * computed from input files.
+ */
+struct file_fingerprint {
+  std::uint64_t size = 0;
+  std::int64_t mtime = 0;
+  std::uint64_t hash = 0;
+
+  bool operator==(const file_fingerprint &other) const {
+    return size == other.size && mtime == other.mtime && hash == other.hash;
+  }
+  bool operator!=(const file_fingerprint &other) const {
+    return !(*this == other);
+  }
+};
+
+constexpr std::uint64_t fnv1a_offset_basis = 14695981039346656037ULL;
+
+/**
+ * Update a 64-bit FNV-1a hash with a block of bytes.
+ *
+ * @param data bytes to hash
+ * @param size number of bytes
+ * @param hash hash of the preceding bytes
+ * @return updated hash
+ */
+inline std::uint64_t fnv1a_hash(const char *data, size_t size,
+                                std::uint64_t hash = fnv1a_offset_basis) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * Compute the fingerprint of a file.
+ * Throws an exception if the file cannot be read.
+ *
+ * @param fname name of file which exists and has read perms
+ * @return file fingerprint
+ */
+inline file_fingerprint get_file_fingerprint(const std::string &fname) {
+  struct stat status;
+  std::ifstream in(fname, std::ios::binary);
+  if (stat(fname.c_str(), &status) != 0 || !in.good()) {
+    std::stringstream msg;
+    msg << "Can't open specified file, \"" << fname << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  file_fingerprint fingerprint;
+  fingerprint.size = status.st_size;
+  fingerprint.mtime = status.st_mtime;
+  fingerprint.hash = fnv1a_offset_basis;
+  std::vector<char> buffer(1 << 16);
+  while (in) {
+    in.read(buffer.data(), buffer.size());
+    fingerprint.hash
+        = fnv1a_hash(buffer.data(), in.gcount(), fingerprint.hash);
+  }
+  return fingerprint;
+}
+
+inline void write_binary(std::ostream &out, const file_fingerprint &x) {
+  write_binary(out, x.size);
+  write_binary(out, x.mtime);
+  write_binary(out, x.hash);
+}
+
+inline void read_binary(std::istream &in, file_fingerprint &x) {
+  read_binary(in, x.size);
+  read_binary(in, x.mtime);
+  read_binary(in, x.hash);
+}
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,217 @@
+#ifndef CMDSTAN_LAPLACE_HESSIAN_CACHE_HPP
+#define CMDSTAN_LAPLACE_HESSIAN_CACHE_HPP
+
+#include <cmdstan/binary_io.hpp>
+#include <cmdstan/file_fingerprint.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+constexpr std::uint64_t hessian_cache_magic = 0x4353484553534e43ULL;
+constexpr std::uint32_t hessian_cache_version = 3;
+
+/**
+ * Return a fingerprint of a model: a hash of its compile information
+ * and the names and dimensions of its parameters, so that a Hessian
+ * is not reused by a differently compiled model of the same name or
+ * one with other parameters.
+ *
+ * @tparam Model type of model
+ * @param model model
+ * @return fingerprint
+ */
+template <typename Model>
+inline std::uint64_t model_fingerprint(const Model &model) {
+  std::uint64_t hash = fnv1a_offset_basis;
+  // hash the terminating null too, so that the strings are delimited
+  auto hash_string = [&hash](const std::string &s) {
+    hash = fnv1a_hash(s.c_str(), s.size() + 1, hash);
+  };
+  for (const auto &info : model.model_compile_info())
+    hash_string(info);
+  std::vector<std::string> names;
+  model.constrained_param_names(names, true, true);
+  for (const auto &name : names)
+    hash_string(name);
+  names.clear();
+  model.unconstrained_param_names(names, false, false);
+  for (const auto &name : names)
+    hash_string(name);
+  std::vector<std::vector<size_t>> dims;
+  model.get_dims(dims, true, true);
+  for (const auto &dim : dims) {
+    std::uint64_t rank = dim.size();
+    hash = fnv1a_hash(reinterpret_cast<const char *>(&rank), sizeof(rank),
+                      hash);
+    hash = fnv1a_hash(reinterpret_cast<const char *>(dim.data()),
+                      sizeof(size_t) * dim.size(), hash);
+  }
+  return hash;
+}
+
+/**
+ * Identifies the Hessian of a model's log density at a mode:
+ * the model name and fingerprint, the hash of the data file contents,
+ * the mode on the unconstrained scale, whether the change-of-variables
+ * adjustment is included, and the log density and its gradient at the
+ * mode, which tell apart models edited without changing their
+ * parameters.  All are compared exactly.
+ */
+struct hessian_key {
+  std::string model_name;
+  std::uint64_t model_hash = 0;
+  std::uint64_t data_hash = 0;
+  Eigen::VectorXd mode;
+  bool jacobian = true;
+  double log_prob = 0;
+  Eigen::VectorXd gradient;
+
+  /**
+   * Return whether the key is for the same model, data and mode.
+   */
+  bool same_mode(const hessian_key &other) const {
+    return model_name == other.model_name && model_hash == other.model_hash
+           && data_hash == other.data_hash && mode.size() == other.mode.size()
+           && mode == other.mode;
+  }
+
+  bool operator==(const hessian_key &other) const {
+    return same_mode(other) && jacobian == other.jacobian
+           && log_prob == other.log_prob
+           && gradient.size() == other.gradient.size()
+           && gradient == other.gradient;
+  }
+};
+
+struct hessian_entry {
+  hessian_key key;
+  Eigen::MatrixXd hessian;
+};
+
+/**
+ * Read all entries of a Hessian cache file.  A cache file holds at
+ * most one entry for each setting of `jacobian`.  Returns an empty
+ * vector if the file does not exist or is not a valid cache file.
+ *
+ * @param filename name of cache file
+ * @return cache entries
+ */
+inline std::vector<hessian_entry> read_hessian_entries(
+    const std::string &filename) {
+  std::vector<hessian_entry> entries;
+  std::ifstream in(filename, std::ios::binary);
+  if (!in.good())
+    return entries;
+  try {
+    std::uint64_t magic = 0;
+    std::uint32_t version = 0;
+    std::uint32_t num_entries = 0;
+    read_binary(in, magic);
+    read_binary(in, version);
+    read_binary(in, num_entries);
+    if (!in || magic != hessian_cache_magic
+        || version != hessian_cache_version || num_entries > 2)
+      return entries;
+    for (std::uint32_t i = 0; i < num_entries; ++i) {
+      hessian_entry entry;
+      std::uint8_t jacobian = 0;
+      read_binary(in, entry.key.model_name);
+      read_binary(in, entry.key.model_hash);
+      read_binary(in, entry.key.data_hash);
+      read_binary(in, entry.key.mode);
+      read_binary(in, jacobian);
+      read_binary(in, entry.key.log_prob);
+      read_binary(in, entry.key.gradient);
+      read_binary(in, entry.hessian);
+      entry.key.jacobian = jacobian != 0;
+      Eigen::Index N = entry.key.mode.size();
+      if (!in || entry.hessian.rows() != N || entry.hessian.cols() != N)
+        return {};
+      entries.push_back(std::move(entry));
+    }
+  } catch (const std::exception &e) {
+    return {};
+  }
+  return entries;
+}
+
+/**
+ * Look up the Hessian for a key in a cache file.
+ *
+ * @param in name of cache file
+ * @param in key for the Hessian
+ * @param out Hessian
+ * @return true if the cache holds a Hessian for the key
+ */
+inline bool read_hessian_cache(const std::string &filename,
+                               const hessian_key &key,
+                               Eigen::MatrixXd &hessian) {
+  for (auto &entry : read_hessian_entries(filename)) {
+    if (entry.key == key) {
+      hessian = std::move(entry.hessian);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Save the Hessian for a key to a cache file.  An entry for the same
+ * model, data and mode with the other `jacobian` setting is kept,
+ * all other entries are replaced.  The file is written to a temporary
+ * name and then renamed.
+ * Throws an exception if the cache file cannot be written.
+ *
+ * @param in name of cache file
+ * @param in key for the Hessian
+ * @param in Hessian
+ */
+inline void write_hessian_cache(const std::string &filename,
+                                const hessian_key &key,
+                                const Eigen::MatrixXd &hessian) {
+  std::vector<hessian_entry> entries;
+  for (auto &entry : read_hessian_entries(filename)) {
+    if (entry.key.same_mode(key) && entry.key.jacobian != key.jacobian)
+      entries.push_back(std::move(entry));
+  }
+  entries.push_back({key, hessian});
+
+  std::string tmp_filename = filename + ".tmp";
+  std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+  if (!out.good()) {
+    std::stringstream msg;
+    msg << "Can't write Hessian file, \"" << filename << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  write_binary(out, hessian_cache_magic);
+  write_binary(out, hessian_cache_version);
+  write_binary(out, static_cast<std::uint32_t>(entries.size()));
+  for (const auto &entry : entries) {
+    write_binary(out, entry.key.model_name);
+    write_binary(out, entry.key.model_hash);
+    write_binary(out, entry.key.data_hash);
+    write_binary(out, entry.key.mode);
+    write_binary(out, static_cast<std::uint8_t>(entry.key.jacobian));
+    write_binary(out, entry.key.log_prob);
+    write_binary(out, entry.key.gradient);
+    write_binary(out, entry.hessian);
+  }
+  out.close();
+  if (!out || std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    std::remove(tmp_filename.c_str());
+    std::stringstream msg;
+    msg << "Can't write Hessian file, \"" << filename << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+}
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,290 @@
+#ifndef CMDSTAN_LAPLACE_SAMPLE_HPP
+#define CMDSTAN_LAPLACE_SAMPLE_HPP
+
+#include <cmdstan/laplace_hessian_cache.hpp>
+#include <cmdstan/stop_interrupt.hpp>
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/math/prim.hpp>
+#include <stan/model/log_prob_grad.hpp>
+#include <stan/model/log_prob_propto.hpp>
+#include <stan/services/error_codes.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Compute the Hessian of the log density at a point by finite
+ * differences of gradients, as `stan::math::internal::finite_diff_hessian_auto`
+ * does.  The 2 * N gradient evaluations are independent and are
+ * run in parallel on the TBB threadpool.
+ *
+ * @tparam jacobian whether to include the change-of-variables adjustment
+ * @tparam Model type of model
+ * @param model model
+ * @param theta point on the unconstrained scale
+ * @param msgs stream for messages from the model
+ * @return Hessian matrix
+ */
+template <bool jacobian, typename Model>
+Eigen::MatrixXd log_prob_hessian(const Model &model,
+                                 const Eigen::VectorXd &theta,
+                                 std::ostream &msgs) {
+  int N = theta.size();
+  Eigen::VectorXd epsilons(N);
+  for (int i = 0; i < N; ++i)
+    epsilons(i) = std::cbrt(std::numeric_limits<double>::epsilon())
+                  * std::fmax(1.0, std::fabs(theta(i)));
+
+  // gradients at theta + eps_i e_i in 0..N-1, theta - eps_i e_i in N..2N-1
+  std::vector<Eigen::VectorXd> grads(2 * N);
+  std::vector<std::stringstream> grad_msgs(2 * N);
+  tbb::parallel_for(tbb::blocked_range<int>(0, 2 * N),
+                    [&](const tbb::blocked_range<int> &r) {
+                      for (int k = r.begin(); k < r.end(); ++k) {
+                        int i = k % N;
+                        Eigen::VectorXd x(theta);
+                        x(i) += k < N ? epsilons(i) : -epsilons(i);
+                        stan::model::log_prob_grad<true, jacobian>(
+                            model, x, grads[k], &grad_msgs[k]);
+                      }
+                    });
+  for (auto &grad_msg : grad_msgs)
+    msgs << grad_msg.str();
+
+  Eigen::MatrixXd hessian(N, N);
+  for (int i = 0; i < N; ++i) {
+    for (int j = i; j < N; ++j) {
+      hessian(j, i) = (grads[j](i) - grads[N + j](i)) / (4 * epsilons(j))
+                      + (grads[i](j) - grads[N + i](j)) / (4 * epsilons(i));
+      hessian(i, j) = hessian(j, i);
+    }
+  }
+  return hessian;
+}
+
+/**
+ * Number of draws in each block of `laplace_draws`.
+ */
+constexpr int laplace_block_size = 256;
+
+/**
+ * Generate draws from the Laplace approximation at a mode, given the
+ * Hessian of the log density at the mode.  Draws are split into
+ * contiguous blocks of `laplace_block_size` draws which are generated
+ * in parallel, block k using the RNG stream `create_rng(random_seed,
+ * k)`, so the output is deterministic for a given seed, whatever the
+ * number of threads; up to one block it matches
+ * `stan::services::laplace_sample`.  Each block is written once it and
+ * the blocks before it are complete, so only the blocks finished out
+ * of order are held in memory.
+ *
+ * @tparam jacobian whether to include the change-of-variables adjustment
+ * @tparam Model type of model
+ * @param model model
+ * @param theta_hat mode on the unconstrained scale
+ * @param hessian Hessian of the log density at the mode
+ * @param draws number of draws
+ * @param random_seed seed for the RNG streams
+ * @param refresh refresh rate, non-positive to suppress messages
+ * @param logger logger for messages
+ * @param sample_writer writer for the draws
+ */
+template <bool jacobian, typename Model>
+void laplace_draws(const Model &model, const Eigen::VectorXd &theta_hat,
+                   const Eigen::MatrixXd &hessian, int draws,
+                   unsigned int random_seed, int refresh,
+                   stan::callbacks::logger &logger,
+                   stan::callbacks::writer &sample_writer) {
+  int num_unc_params = theta_hat.size();
+  std::vector<std::string> param_tp_gq_names;
+  model.constrained_param_names(param_tp_gq_names, true, true);
+  size_t draw_size = param_tp_gq_names.size();
+  std::vector<std::string> names{"log_p__", "log_g__"};
+  names.insert(names.end(), param_tp_gq_names.begin(),
+               param_tp_gq_names.end());
+  sample_writer(names);
+
+  if (refresh > 0)
+    logger.info("Calculating inverse of Cholesky factor\n");
+  Eigen::MatrixXd L_neg_hessian = (-hessian).llt().matrixL();
+  Eigen::MatrixXd inv_sqrt_neg_hessian = L_neg_hessian.inverse().transpose();
+  Eigen::MatrixXd half_hessian = 0.5 * hessian;
+
+  if (refresh > 0)
+    logger.info("Generating draws\n");
+  int num_blocks = (draws + laplace_block_size - 1) / laplace_block_size;
+  // blocks finished out of order wait for the blocks before them
+  std::vector<Eigen::MatrixXd> blocks(num_blocks);
+  std::vector<std::string> block_msgs(num_blocks);
+  std::vector<bool> finished(num_blocks, false);
+  int next_block = 0;
+  std::mutex write_mutex;
+  std::vector<double> draw(draw_size + 2);
+  tbb::parallel_for(
+      tbb::blocked_range<int>(0, num_blocks, 1),
+      [&](const tbb::blocked_range<int> &r) {
+        for (int k = r.begin(); k < r.end(); ++k) {
+          auto rng = stan::services::util::create_rng(random_seed, k);
+          int begin = k * laplace_block_size;
+          int end = std::min(draws, begin + laplace_block_size);
+          Eigen::MatrixXd output(end - begin, draw_size + 2);
+          std::stringstream msgs;
+          Eigen::VectorXd z(num_unc_params);
+          Eigen::VectorXd draw_vec;
+          for (int m = 0; m < end - begin; ++m) {
+            for (int n = 0; n < num_unc_params; ++n)
+              z(n) = stan::math::std_normal_rng(rng);
+            Eigen::VectorXd unc_draw = theta_hat + inv_sqrt_neg_hessian * z;
+            double log_p = stan::model::log_prob_propto<jacobian>(
+                model, unc_draw, &msgs);
+            Eigen::VectorXd diff = unc_draw - theta_hat;
+            double log_q = diff.transpose() * half_hessian * diff;
+            model.write_array(rng, unc_draw, draw_vec, true, true, &msgs);
+            output(m, 0) = log_p;
+            output(m, 1) = log_q;
+            output.row(m).tail(draw_size)
+                = draw_vec.head(draw_size).transpose();
+          }
+
+          std::lock_guard<std::mutex> lock(write_mutex);
+          blocks[k] = std::move(output);
+          block_msgs[k] = msgs.str();
+          finished[k] = true;
+          for (; next_block < num_blocks && finished[next_block];
+               ++next_block) {
+            if (refresh > 0 && !block_msgs[next_block].empty())
+              logger.info(block_msgs[next_block]);
+            const Eigen::MatrixXd &block = blocks[next_block];
+            for (int m = 0; m < block.rows(); ++m) {
+              int iteration = next_block * laplace_block_size + m;
+              if (refresh > 0 && iteration % refresh == 0)
+                logger.info("iteration: " + std::to_string(iteration)
+                            + "\n");
+              Eigen::VectorXd::Map(draw.data(), draw.size())
+                  = block.row(m).transpose();
+              sample_writer(draw);
+            }
+            blocks[next_block] = Eigen::MatrixXd();
+            block_msgs[next_block].clear();
+          }
+        }
+      },
+      tbb::simple_partitioner());
+}
+
+/**
+ * Parallel counterpart of `stan::services::laplace_sample`: compute
+ * the Hessian at the mode and generate draws from the Laplace
+ * approximation, using up to `num_threads` threads for both steps.
+ * The draws don't depend on the number of threads.
+ * If a Hessian file is given, the Hessian is read from it when it was
+ * saved for the same model, data, mode and `jacobian` setting;
+ * otherwise it is computed and saved to the file, with a warning if
+ * the file can't be written.
+ *
+ * @tparam jacobian whether to include the change-of-variables adjustment
+ * @tparam Model type of model
+ * @param model model
+ * @param theta_hat mode on the unconstrained scale
+ * @param draws number of draws, positive
+ * @param random_seed seed for the RNG streams
+ * @param num_threads number of threads; if not positive, those of the
+ *   threadpool
+ * @param refresh refresh rate, non-positive to suppress messages
+ * @param hessian_file name of Hessian cache file, empty for none
+ * @param data_hash hash of the data file contents
+ * @param interrupt interrupt callback
+ * @param logger logger for messages
+ * @param sample_writer writer for the draws
+ * @return error_codes::OK on success, error_codes::SOFTWARE otherwise;
+ *   a `stop_exception` from the interrupt callback is rethrown
+ */
+template <bool jacobian, typename Model>
+int laplace_sample(const Model &model, const Eigen::VectorXd &theta_hat,
+                   int draws, unsigned int random_seed, int num_threads,
+                   int refresh, const std::string &hessian_file,
+                   std::uint64_t data_hash,
+                   stan::callbacks::interrupt &interrupt,
+                   stan::callbacks::logger &logger,
+                   stan::callbacks::writer &sample_writer) {
+  try {
+    if (draws <= 0)
+      throw std::domain_error("Number of draws must be > 0; found draws = "
+                              + std::to_string(draws));
+    std::vector<std::string> unc_param_names;
+    model.unconstrained_param_names(unc_param_names, false, false);
+    if (theta_hat.size() != static_cast<int>(unc_param_names.size()))
+      throw std::domain_error(
+          "Specified mode is wrong size; expected "
+          + std::to_string(unc_param_names.size())
+          + " unconstrained parameters, but specified mode has size = "
+          + std::to_string(theta_hat.size()));
+    if (num_threads <= 0)
+      num_threads = tbb::this_task_arena::max_concurrency();
+    tbb::task_arena arena(num_threads);
+
+    hessian_key key{model.model_name(), model_fingerprint(model), data_hash,
+                    theta_hat, jacobian};
+    if (!hessian_file.empty()) {
+      std::stringstream msgs;
+      key.log_prob = stan::model::log_prob_grad<true, jacobian>(
+          model, theta_hat, key.gradient, &msgs);
+    }
+    Eigen::MatrixXd hessian;
+    if (!hessian_file.empty()
+        && read_hessian_cache(hessian_file, key, hessian)) {
+      if (refresh > 0)
+        logger.info("Using Hessian from file " + hessian_file + "\n");
+    } else {
+      if (refresh > 0)
+        logger.info("Calculating Hessian\n");
+      interrupt();
+      std::stringstream hessian_msgs;
+      arena.execute([&]() {
+        hessian = log_prob_hessian<jacobian>(model, theta_hat, hessian_msgs);
+      });
+      if (refresh > 0) {
+        logger.info(hessian_msgs);
+        logger.info("\n");
+      }
+      if (!hessian_file.empty()) {
+        try {
+          write_hessian_cache(hessian_file, key, hessian);
+        } catch (const std::invalid_argument &e) {
+          logger.warn(std::string("Warning: ") + e.what());
+        }
+      }
+    }
+    interrupt();
+    arena.execute([&]() {
+      laplace_draws<jacobian>(model, theta_hat, hessian, draws, random_seed,
+                              refresh, logger, sample_writer);
+    });
+    return stan::services::error_codes::OK;
+  } catch (const stop_exception &e) {
+    throw;
+  } catch (const std::exception &e) {
+    logger.error(e.what());
+  } catch (...) {
+    logger.error("unknown exception");
+  }
+  return stan::services::error_codes::SOFTWARE;
+}
+
+}  // namespace cmdstan
+#endif
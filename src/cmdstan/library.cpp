@@ -0,0 +1,108 @@
+#include <cmdstan/library.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <cmdstan/stop_interrupt.hpp>
+#include <cmdstan/thread_pool.hpp>
+#include <stan/callbacks/structured_writer.hpp>
+#include <stan/io/dump.hpp>
+#include <stan/io/empty_var_context.hpp>
+#include <stan/services/sample/hmc_nuts_diag_e.hpp>
+#include <stan/services/sample/hmc_nuts_diag_e_adapt.hpp>
+#include <stan/services/util/create_unit_e_diag_inv_metric.hpp>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// forward declaration for function defined in another translation unit
+stan::model::model_base &new_model(stan::io::var_context &data_context,
+                                   unsigned int seed, std::ostream *msg_stream);
+
+namespace cmdstan {
+
+std::shared_ptr<stan::model::model_base> load_model(
+    stan::io::var_context &data, unsigned int seed,
+    std::ostream *msg_stream) {
+  return std::shared_ptr<stan::model::model_base>(
+      &new_model(data, seed, msg_stream));
+}
+
+namespace {
+using context_vector = std::vector<std::shared_ptr<stan::io::var_context>>;
+
+/*
+ * Return one context per chain, repeating a single context, or the
+ * default if there is none.
+ */
+context_vector contexts_per_chain(
+    const context_vector &contexts, unsigned int num_chains,
+    const std::shared_ptr<stan::io::var_context> &fallback,
+    const std::string &name) {
+  if (contexts.empty())
+    return context_vector(num_chains, fallback);
+  if (contexts.size() == 1)
+    return context_vector(num_chains, contexts[0]);
+  if (contexts.size() != num_chains) {
+    std::stringstream msg;
+    msg << "Found " << contexts.size() << " " << name << " for "
+        << num_chains << " chains";
+    throw std::invalid_argument(msg.str());
+  }
+  return contexts;
+}
+
+}  // namespace
+
+int sample(stan::model::model_base &model, const sample_config &config,
+           const context_vector &inits, const context_vector &inv_metrics,
+           stan::callbacks::logger &logger,
+           std::vector<buffer_writer> &outputs) {
+  unsigned int num_chains = config.num_chains;
+  init_thread_pool(config.num_threads);
+  context_vector init_contexts = contexts_per_chain(
+      inits, num_chains, std::make_shared<stan::io::empty_var_context>(),
+      "initial values");
+  context_vector metric_contexts = contexts_per_chain(
+      inv_metrics, num_chains,
+      std::make_shared<stan::io::dump>(
+          stan::services::util::create_unit_e_diag_inv_metric(
+              model.num_params_r())),
+      "inverse metrics");
+
+  size_t num_warmup_draws
+      = config.save_warmup && config.num_thin > 0
+            ? (config.num_warmup + config.num_thin - 1) / config.num_thin
+            : 0;
+  outputs.assign(num_chains, buffer_writer(num_warmup_draws));
+  std::vector<stan::callbacks::writer> init_writers(num_chains);
+  std::vector<stan::callbacks::writer> diagnostic_writers(num_chains);
+  std::vector<buffer_writer::adaptation_writer> metric_writers;
+  metric_writers.reserve(num_chains);
+  for (auto &output : outputs)
+    metric_writers.emplace_back(output);
+  // no signal handlers: those belong to the program embedding the library
+  stop_interrupt interrupt(config.max_runtime);
+  try {
+    if (config.adapt_engaged)
+      return stan::services::sample::hmc_nuts_diag_e_adapt(
+          model, num_chains, init_contexts, metric_contexts, config.seed,
+          config.id, config.init_radius, config.num_warmup,
+          config.num_samples, config.num_thin, config.save_warmup,
+          config.refresh, config.stepsize, config.stepsize_jitter,
+          config.max_depth, config.delta, config.gamma, config.kappa,
+          config.t0, config.init_buffer, config.term_buffer, config.window,
+          interrupt, logger, init_writers, outputs, diagnostic_writers,
+          metric_writers);
+    return stan::services::sample::hmc_nuts_diag_e(
+        model, num_chains, init_contexts, metric_contexts, config.seed,
+        config.id, config.init_radius, config.num_warmup, config.num_samples,
+        config.num_thin, config.save_warmup, config.refresh, config.stepsize,
+        config.stepsize_jitter, config.max_depth, interrupt, logger,
+        init_writers, outputs, diagnostic_writers);
+  } catch (const stop_exception &e) {
+    logger.info(std::string("Sampling stopped: ") + e.what());
+    return return_codes::INTERRUPTED;
+  }
+}
+
+}  // namespace cmdstan
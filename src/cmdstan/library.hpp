@@ -0,0 +1,218 @@
+#ifndef CMDSTAN_LIBRARY_HPP
+#define CMDSTAN_LIBRARY_HPP
+
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/structured_writer.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/var_context.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/model/model_base.hpp>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * In-process interface to the sampler, for programs which link a
+ * compiled model with the CmdStan library object instead of running
+ * the model executable.  Inputs are passed as var_contexts and outputs
+ * are kept in memory; nothing is read from or written to files.
+ */
+
+namespace cmdstan {
+
+/**
+ * Configuration of a run of the NUTS sampler with a diagonal metric,
+ * with CmdStan's default values.
+ */
+struct sample_config {
+  unsigned int num_chains = 1;
+  int num_threads = 1;  // 1 without STAN_THREADS, fixed by the first run
+  int num_warmup = 1000;
+  int num_samples = 1000;
+  int num_thin = 1;
+  bool save_warmup = false;
+  int refresh = 0;
+  unsigned int seed = 0;
+  unsigned int id = 1;        // chain id of the first chain
+  double init_radius = 2;     // used for parameters without inits
+  double max_runtime = 0;     // seconds, 0 for no limit
+  double stepsize = 1;
+  double stepsize_jitter = 0;
+  int max_depth = 10;
+  bool adapt_engaged = true;
+  double delta = 0.8;
+  double gamma = 0.05;
+  double kappa = 0.75;
+  double t0 = 10;
+  unsigned int init_buffer = 75;
+  unsigned int term_buffer = 50;
+  unsigned int window = 25;
+};
+
+/**
+ * Writer which keeps the output of a chain in memory: the draws in a
+ * single contiguous row-major buffer, the adaptation results, which the
+ * sampler writes to the chain's `adaptation_writer`, and the time spent
+ * in warmup and sampling, measured as the draws are written.  If warmup
+ * draws are saved they are the first rows.
+ */
+class buffer_writer : public stan::callbacks::writer {
+ public:
+  /**
+   * Writer of the adaptation results of a chain to its buffer_writer,
+   * which the sampler calls at the end of warmup.
+   */
+  class adaptation_writer : public stan::callbacks::structured_writer {
+   public:
+    explicit adaptation_writer(buffer_writer &output) : output_(output) {}
+
+    void write(const std::string &key, double value) override {
+      if (key == "stepsize")
+        output_.stepsize_ = value;
+    }
+
+    void write(const std::string &key,
+               const Eigen::Matrix<double, Eigen::Dynamic, 1> &vec) override {
+      if (key == "inv_metric")
+        output_.inv_metric_.assign(vec.data(), vec.data() + vec.size());
+    }
+
+    void end_record() override {
+      output_.adapted_ = true;
+      output_.warmup_end_ = clock::now();
+    }
+
+   private:
+    buffer_writer &output_;
+  };
+
+  /**
+   * @param num_warmup_draws number of warmup draws which are saved
+   */
+  explicit buffer_writer(size_t num_warmup_draws = 0)
+      : num_warmup_draws_(num_warmup_draws) {}
+
+  void operator()(const std::vector<std::string> &names) override {
+    // the sampler writes the column names before warmup
+    names_ = names;
+    start_ = warmup_end_ = end_ = clock::now();
+  }
+
+  void operator()(const std::vector<double> &values) override {
+    end_ = clock::now();
+    // without adaptation, warmup ends with the first sampling draw
+    if (!adapted_ && num_draws() == num_warmup_draws_)
+      warmup_end_ = end_;
+    draws_.insert(draws_.end(), values.begin(), values.end());
+  }
+
+  void operator()() override {}
+
+  void operator()(const std::string &message) override {
+    messages_.push_back(message);
+  }
+
+  /**
+   * Return the column names of the draws.
+   */
+  const std::vector<std::string> &names() const { return names_; }
+
+  /**
+   * Return the draws, row by row.
+   */
+  const std::vector<double> &draws() const { return draws_; }
+
+  size_t num_draws() const {
+    return names_.empty() ? 0 : draws_.size() / names_.size();
+  }
+
+  /**
+   * Return the adapted step size, or 0 if there was no adaptation.
+   */
+  double stepsize() const { return stepsize_; }
+
+  /**
+   * Return the diagonal of the adapted inverse metric, or an empty
+   * vector if there was no adaptation.
+   */
+  const std::vector<double> &inv_metric() const { return inv_metric_; }
+
+  /**
+   * Return the seconds from the start of warmup to the end of
+   * adaptation or, without adaptation, to the first sampling draw.
+   */
+  double warmup_time() const { return seconds(start_, warmup_end_); }
+
+  /**
+   * Return the seconds from the end of warmup to the last draw.
+   */
+  double sampling_time() const { return seconds(warmup_end_, end_); }
+
+  /**
+   * Return all messages written by the sampler, in order.
+   */
+  const std::vector<std::string> &messages() const { return messages_; }
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  static double seconds(clock::time_point from, clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+  }
+
+  size_t num_warmup_draws_;
+  std::vector<std::string> names_;
+  std::vector<double> draws_;
+  std::vector<std::string> messages_;
+  double stepsize_ = 0;
+  std::vector<double> inv_metric_;
+  bool adapted_ = false;
+  clock::time_point start_;
+  clock::time_point warmup_end_;
+  clock::time_point end_;
+};
+
+/**
+ * Construct the model from its data.
+ *
+ * @param data data
+ * @param seed seed for the random numbers drawn in transformed data
+ * @param msg_stream stream for messages from the model constructor
+ * @return model
+ */
+std::shared_ptr<stan::model::model_base> load_model(
+    stan::io::var_context &data, unsigned int seed,
+    std::ostream *msg_stream = nullptr);
+
+/**
+ * Run the NUTS sampler with a diagonal metric, adapted unless
+ * adaptation is disengaged, keeping the output of each chain in memory.
+ * The initial values and inverse metrics are given either for all
+ * chains, one for each chain, or for none; without inverse metrics the
+ * sampler starts from the unit metric.  Throws an exception if the
+ * number of initial values or inverse metrics is not 0, 1, or the
+ * number of chains, or if the number of threads is not valid.  The
+ * thread pool is set up once per process, by the first run, so later
+ * runs must use the same number of threads.
+ *
+ * @param model model
+ * @param config sampler configuration
+ * @param inits initial values
+ * @param inv_metrics inverse metrics, as variable `inv_metric`
+ * @param logger logger for progress and error messages
+ * @param outputs set to the output of each chain
+ * @return return code, `INTERRUPTED` if the maximum runtime was
+ *   exceeded, in which case the outputs hold the draws so far
+ */
+int sample(stan::model::model_base &model, const sample_config &config,
+           const std::vector<std::shared_ptr<stan::io::var_context>> &inits,
+           const std::vector<std::shared_ptr<stan::io::var_context>>
+               &inv_metrics,
+           stan::callbacks::logger &logger,
+           std::vector<buffer_writer> &outputs);
+
+}  // namespace cmdstan
+#endif
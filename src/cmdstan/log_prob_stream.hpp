@@ -0,0 +1,277 @@
+#ifndef CMDSTAN_LOG_PROB_STREAM_HPP
+#define CMDSTAN_LOG_PROB_STREAM_HPP
+
+#include <cmdstan/binary_io.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <stan/model/log_prob_grad.hpp>
+#include <stan/model/model_base.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+namespace internal {
+/*
+ * Restores the buffer of a stream on destruction.
+ */
+struct rdbuf_guard {
+  std::ostream &stream;
+  std::streambuf *buf;
+  ~rdbuf_guard() { stream.rdbuf(buf); }
+};
+}  // namespace internal
+
+/**
+ * Requests understood by the log_prob stream mode.
+ */
+enum class log_prob_request : std::uint8_t {
+  LOG_PROB_GRAD = 0,  // unconstrained params -> lp__ and gradient
+  CONSTRAIN = 1,      // unconstrained params -> constrained params
+  UNCONSTRAIN = 2     // constrained params -> unconstrained params
+};
+
+/**
+ * Evaluates requests on a model, reusing its buffers from one request
+ * to the next.
+ *
+ * @tparam RNG type of random number generator, used by `write_array`
+ */
+template <typename RNG>
+class log_prob_evaluator {
+ public:
+  log_prob_evaluator(const stan::model::model_base &model, bool jacobian,
+                     RNG &rng)
+      : model_(model), jacobian_(jacobian), rng_(rng) {
+    std::vector<std::string> names;
+    model.constrained_param_names(names, false, false);
+    num_constrained_ = names.size();
+    gradient_.reserve(model.num_params_r());
+    result_.reserve(model.num_params_r() + 1);
+  }
+
+  /**
+   * Evaluate a request.  Throws an exception if the number of values
+   * does not match the model or the model cannot be evaluated at them.
+   *
+   * @param request request
+   * @param values unconstrained parameters, or constrained parameters
+   *   for `UNCONSTRAIN`
+   * @return for `LOG_PROB_GRAD`, `lp__` followed by the gradient,
+   *   otherwise the transformed parameters
+   */
+  const std::vector<double> &operator()(log_prob_request request,
+                                        std::vector<double> &values) {
+    size_t expected = request == log_prob_request::UNCONSTRAIN
+                          ? num_constrained_
+                          : model_.num_params_r();
+    if (values.size() != expected) {
+      std::stringstream msg;
+      msg << "Expected " << expected << " parameter values, found "
+          << values.size();
+      throw std::invalid_argument(msg.str());
+    }
+    std::stringstream msgs;
+    switch (request) {
+      case log_prob_request::LOG_PROB_GRAD: {
+        double lp
+            = jacobian_ ? stan::model::log_prob_grad<true, true>(
+                  model_, values, params_i_, gradient_, &msgs)
+                        : stan::model::log_prob_grad<true, false>(
+                            model_, values, params_i_, gradient_, &msgs);
+        result_.assign(1, lp);
+        result_.insert(result_.end(), gradient_.begin(), gradient_.end());
+        break;
+      }
+      case log_prob_request::CONSTRAIN:
+        model_.write_array(rng_, values, params_i_, result_, false, false,
+                           &msgs);
+        break;
+      case log_prob_request::UNCONSTRAIN:
+        result_.resize(model_.num_params_r());
+        model_.unconstrain_array(values, result_, &msgs);
+        break;
+      default:
+        throw std::invalid_argument("Unknown request");
+    }
+    return result_;
+  }
+
+  /**
+   * Return the largest number of values a request can have.
+   */
+  size_t max_num_values() const {
+    return std::max(model_.num_params_r(), num_constrained_);
+  }
+
+ private:
+  const stan::model::model_base &model_;
+  bool jacobian_;
+  RNG &rng_;
+  size_t num_constrained_;  // number of constrained parameters
+  std::vector<int> params_i_;
+  std::vector<double> gradient_;
+  std::vector<double> result_;
+};
+
+/**
+ * Serve log density requests in text format until the end of the
+ * input.  Each request is a line of parameter values separated by
+ * whitespace or commas, optionally preceded by `constrain` or
+ * `unconstrain`; a line of unconstrained parameters alone asks for the
+ * log density and its gradient.  Each response is a line of comma
+ * separated values, `lp__` first for the log density, or `error: `
+ * followed by a message if the request failed.  The output is flushed
+ * after each response.
+ *
+ * @tparam RNG type of random number generator
+ * @param model model
+ * @param jacobian whether to include the Jacobian adjustment
+ * @param rng random number generator, used by `constrain`
+ * @param sig_figs significant figures of output values, or -1 for as
+ *   many as are needed to read them back exactly
+ * @param in stream of requests
+ * @param out stream for responses
+ * @return return code
+ */
+template <typename RNG>
+int services_log_prob_stream_text(const stan::model::model_base &model,
+                                  bool jacobian, RNG &rng, int sig_figs,
+                                  std::istream &in, std::ostream &out) {
+  log_prob_evaluator<RNG> evaluate(model, jacobian, rng);
+  out << std::setprecision(sig_figs > 0
+                               ? sig_figs
+                               : std::numeric_limits<double>::max_digits10);
+  std::string line;
+  std::vector<double> values;
+  while (std::getline(in, line)) {
+    for (auto &c : line)
+      if (c == ',')
+        c = ' ';
+    std::istringstream words(line);
+    std::string word;
+    if (!(words >> word))
+      continue;
+    log_prob_request request = log_prob_request::LOG_PROB_GRAD;
+    if (word == "constrain")
+      request = log_prob_request::CONSTRAIN;
+    else if (word == "unconstrain")
+      request = log_prob_request::UNCONSTRAIN;
+    else
+      words.seekg(0);
+    values.clear();
+    try {
+      while (words >> word)
+        values.push_back(std::stod(word));
+      const std::vector<double> &result = evaluate(request, values);
+      for (size_t i = 0; i < result.size(); ++i)
+        out << (i > 0 ? "," : "") << result[i];
+      out << std::endl;
+    } catch (const std::exception &e) {
+      std::string what(e.what());
+      for (auto &c : what)
+        if (c == '\n')
+          c = ' ';
+      out << "error: " << what << std::endl;
+    }
+  }
+  return return_codes::OK;
+}
+
+namespace internal {
+/**
+ * Skip a number of bytes of a stream without storing them.
+ *
+ * @param in stream
+ * @param bytes number of bytes
+ * @return false if the stream ends first
+ */
+inline bool skip_bytes(std::istream &in, std::uint64_t bytes) {
+  constexpr std::uint64_t chunk = std::uint64_t(1) << 20;
+  while (bytes > 0) {
+    std::uint64_t n = std::min(bytes, chunk);
+    in.ignore(static_cast<std::streamsize>(n));
+    if (static_cast<std::uint64_t>(in.gcount()) != n)
+      return false;
+    bytes -= n;
+  }
+  return true;
+}
+}  // namespace internal
+
+/**
+ * Serve log density requests in binary format until the end of the
+ * input.  Values are in native byte order.  Each request is a
+ * `log_prob_request` byte followed by a `uint64` count and that many
+ * doubles.  Each response is a status byte: 0 followed by a `uint64`
+ * count and the doubles of the result, as for the text format, or 1
+ * followed by an error message written by `write_binary`.  A request
+ * with more values than any request of the model can have is answered
+ * with an error and its values are skipped.  The output is flushed
+ * after each response.
+ *
+ * @tparam RNG type of random number generator
+ * @param model model
+ * @param jacobian whether to include the Jacobian adjustment
+ * @param rng random number generator, used by `CONSTRAIN`
+ * @param in stream of requests
+ * @param out stream for responses
+ * @return return code, `NOT_OK` if the input ends inside a request
+ */
+template <typename RNG>
+int services_log_prob_stream_binary(const stan::model::model_base &model,
+                                    bool jacobian, RNG &rng,
+                                    std::istream &in, std::ostream &out) {
+  log_prob_evaluator<RNG> evaluate(model, jacobian, rng);
+  std::vector<double> values;
+  std::uint8_t request;
+  while (in.read(reinterpret_cast<char *>(&request), 1)) {
+    std::uint64_t size = 0;
+    read_binary(in, size);
+    // a bound on the count, so that a corrupt request can't exhaust memory
+    if (!in)
+      return return_codes::NOT_OK;
+    // skip oversized requests rather than allocate for them, so that a
+    // corrupt count can't exhaust memory
+    if (size > evaluate.max_num_values()) {
+      if (size > std::numeric_limits<std::uint64_t>::max() / sizeof(double)
+          || !internal::skip_bytes(in, sizeof(double) * size))
+        return return_codes::NOT_OK;
+      std::stringstream msg;
+      msg << "Expected at most " << evaluate.max_num_values()
+          << " parameter values, found " << size;
+      write_binary(out, std::uint8_t(1));
+      write_binary(out, msg.str());
+      out.flush();
+      continue;
+    }
+    values.resize(size);
+    in.read(reinterpret_cast<char *>(values.data()), sizeof(double) * size);
+    if (!in)
+      return return_codes::NOT_OK;
+    try {
+      const std::vector<double> &result
+          = evaluate(static_cast<log_prob_request>(request), values);
+      write_binary(out, std::uint8_t(0));
+      write_binary(out, static_cast<std::uint64_t>(result.size()));
+      out.write(reinterpret_cast<const char *>(result.data()),
+                sizeof(double) * result.size());
+    } catch (const std::exception &e) {
+      write_binary(out, std::uint8_t(1));
+      write_binary(out, std::string(e.what()));
+    }
+    out.flush();
+  }
+  return return_codes::OK;
+}
+
+}  // namespace cmdstan
+#endif
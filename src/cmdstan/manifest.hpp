@@ -0,0 +1,277 @@
+#ifndef CMDSTAN_MANIFEST_HPP
+#define CMDSTAN_MANIFEST_HPP
+
+#include <cmdstan/arguments/arg_num_threads.hpp>
+#include <cmdstan/command_helper.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <cmdstan/serve.hpp>
+#include <cmdstan/stop_interrupt.hpp>
+#include <cmdstan/thread_pool.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * A job of a manifest: the data file, seed, and output file prefix of
+ * one run.
+ */
+struct manifest_job {
+  std::string data_file;
+  unsigned int seed;
+  std::string output_prefix;
+};
+
+/**
+ * Result of a job of a manifest, as written to the index.
+ */
+struct manifest_result {
+  int return_code = return_codes::NOT_OK;
+  double elapsed = 0;
+  std::string error = "not run";
+};
+
+/**
+ * Read a manifest: one job per line, given by its data file, seed and
+ * output file prefix, separated by whitespace.  Empty lines and lines
+ * starting with '#' are skipped.  Throws an exception if a line is
+ * malformed.
+ *
+ * @param in manifest
+ * @return jobs
+ */
+inline std::vector<manifest_job> read_manifest(std::istream &in) {
+  std::vector<manifest_job> jobs;
+  std::string line;
+  for (int line_number = 1; std::getline(in, line); ++line_number) {
+    std::istringstream fields(line);
+    std::string data_file;
+    if (!(fields >> data_file) || data_file[0] == '#')
+      continue;
+    manifest_job job{data_file, 0, ""};
+    std::string seed;
+    std::string extra;
+    if (!(fields >> seed >> job.output_prefix) || (fields >> extra)
+        || seed.find_first_not_of("0123456789") != std::string::npos) {
+      std::stringstream msg;
+      msg << "manifest: line " << line_number
+          << " must be a data file, a seed and an output prefix";
+      throw std::invalid_argument(msg.str());
+    }
+    job.seed = static_cast<unsigned int>(std::stoul(seed));
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+/**
+ * Add a value to the arguments of a category, inserting it after the
+ * category if it is already given, otherwise appending both.
+ *
+ * @param args command line arguments
+ * @param category category, e.g. "output"
+ * @param value value, e.g. "file=out.csv"
+ */
+inline void add_category_arg(std::vector<std::string> &args,
+                             const std::string &category,
+                             const std::string &value) {
+  auto it = std::find(args.begin(), args.end(), category);
+  if (it != args.end()) {
+    args.insert(it + 1, value);
+  } else {
+    args.push_back(category);
+    args.push_back(value);
+  }
+}
+
+/**
+ * Return the arguments of a job: the arguments common to all jobs
+ * with its data file, seed and output file.
+ *
+ * @param common arguments common to all jobs
+ * @param job job
+ * @return arguments, without the program name
+ */
+inline std::vector<std::string> manifest_job_args(
+    const std::vector<std::string> &common, const manifest_job &job) {
+  std::vector<std::string> args(common);
+  add_category_arg(args, "data", "file=" + job.data_file);
+  add_category_arg(args, "random", "seed=" + std::to_string(job.seed));
+  add_category_arg(args, "output", "file=" + job.output_prefix + ".csv");
+  return args;
+}
+
+namespace internal {
+/*
+ * Quote a CSV field if needed.
+ */
+inline std::string csv_field(const std::string &field) {
+  if (field.find_first_of(",\"\n") == std::string::npos)
+    return field;
+  std::string quoted = "\"";
+  for (char c : field) {
+    if (c == '"')
+      quoted += '"';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+}  // namespace internal
+
+/**
+ * Write the summary index of a manifest as CSV, one row per job in the
+ * order of the manifest.
+ *
+ * @param out stream for the index
+ * @param jobs jobs
+ * @param results results of the jobs
+ */
+inline void write_manifest_index(std::ostream &out,
+                                 const std::vector<manifest_job> &jobs,
+                                 const std::vector<manifest_result> &results) {
+  out << "job,data_file,seed,output_file,return_code,elapsed,error\n";
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    out << (i + 1) << "," << internal::csv_field(jobs[i].data_file) << ","
+        << jobs[i].seed << ","
+        << internal::csv_field(jobs[i].output_prefix + ".csv") << ","
+        << results[i].return_code << "," << results[i].elapsed << ","
+        << internal::csv_field(results[i].error) << "\n";
+  }
+}
+
+/**
+ * Run the jobs of a manifest on the TBB thread pool, one job per task.
+ * After a stop signal no more jobs are started.
+ *
+ * @param program program name, passed to the argument parser
+ * @param common arguments common to all jobs
+ * @param jobs jobs
+ * @return results of the jobs
+ */
+inline std::vector<manifest_result> run_manifest_jobs(
+    const std::string &program, const std::vector<std::string> &common,
+    const std::vector<manifest_job> &jobs) {
+  std::vector<manifest_result> results(jobs.size());
+  stop_interrupt stop;
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, jobs.size(), 1),
+      [&](const tbb::blocked_range<size_t> &r) {
+        for (size_t i = r.begin(); i != r.end(); ++i) {
+          if (stop.stop_requested())
+            return;
+          auto start = std::chrono::steady_clock::now();
+          results[i].error.clear();
+          // each job has its own data, so models are not cached
+          results[i].return_code = run_job(
+              program, manifest_job_args(common, jobs[i]), nullptr,
+              results[i].error);
+          results[i].elapsed = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+        }
+      },
+      tbb::simple_partitioner());
+  return results;
+}
+
+/**
+ * Entry point of the manifest mode, run as
+ *
+ *   <model> manifest file=<manifest> [index=<file>] [log=<file>]
+ *       [num_threads=<n>] <arguments>...
+ *
+ * Runs the jobs of the manifest in this process, on a thread pool of
+ * `num_threads` threads (default 1, the only valid value without
+ * STAN_THREADS), each with the given arguments and its own data file,
+ * seed and output file `<prefix>.csv`.  Jobs of models with profile
+ * blocks fail, as the profiling data is shared by the process.  The
+ * console output of the jobs goes to the log file if given, otherwise
+ * it is discarded.  The summary index, by default `<manifest>_index.csv`,
+ * lists the return code, elapsed time and error of each job.
+ *
+ * @param argc number of arguments
+ * @param argv arguments, `argv[1]` being "manifest"
+ * @return return code, `OK` if all jobs succeeded
+ */
+inline int manifest(int argc, const char *argv[]) {
+#ifdef STAN_MPI
+  throw std::invalid_argument("manifest is not supported with MPI");
+#endif
+  std::string manifest_file;
+  std::string index_file;
+  std::string log_file;
+  int num_threads = 1;
+  std::vector<std::string> common;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg(argv[i]);
+    size_t eq = arg.find('=');
+    std::string key = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    if (!common.empty() || value.empty()) {
+      common.push_back(arg);
+    } else if (key == "file") {
+      manifest_file = value;
+    } else if (key == "index") {
+      index_file = value;
+    } else if (key == "log") {
+      log_file = value;
+    } else if (key == "num_threads") {
+      num_threads = parse_num_threads(value);
+    } else {
+      common.push_back(arg);
+    }
+  }
+  if (manifest_file.empty())
+    throw std::invalid_argument("manifest: no manifest file=<file> given");
+  if (index_file.empty())
+    index_file = get_basename_suffix(manifest_file).first + "_index.csv";
+
+  std::ifstream manifest_stream(manifest_file);
+  if (!manifest_stream.good())
+    throw std::invalid_argument("manifest: can't open manifest file \""
+                                + manifest_file + "\"");
+  std::vector<manifest_job> jobs = read_manifest(manifest_stream);
+  std::ofstream index(index_file);
+  if (!index.good())
+    throw std::invalid_argument("manifest: can't open index file \""
+                                + index_file + "\"");
+  init_thread_pool(num_threads);
+
+  std::ofstream log;
+  if (!log_file.empty()) {
+    log.open(log_file, std::ios::app);
+    if (!log.good())
+      throw std::invalid_argument("manifest: can't open log file \""
+                                  + log_file + "\"");
+  }
+  internal::locked_streambuf console(log_file.empty() ? nullptr
+                                                      : log.rdbuf());
+  std::vector<manifest_result> results;
+  {
+    internal::rdbuf_guard guard{std::cout, std::cout.rdbuf(&console)};
+    results = run_manifest_jobs(argv[0], common, jobs);
+  }
+  write_manifest_index(index, jobs, results);
+
+  size_t num_failed = std::count_if(
+      results.begin(), results.end(), [](const manifest_result &result) {
+        return result.return_code != return_codes::OK;
+      });
+  std::cout << "Ran " << jobs.size() - num_failed << " of " << jobs.size()
+            << " jobs successfully; index written to " << index_file
+            << std::endl;
+  if (internal::stop_signal() != 0)
+    return return_codes::INTERRUPTED;
+  return num_failed == 0 ? return_codes::OK : return_codes::NOT_OK;
+}
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,96 @@
+#ifndef CMDSTAN_MODEL_CACHE_HPP
+#define CMDSTAN_MODEL_CACHE_HPP
+
+#include <cmdstan/command_helper.hpp>
+#include <cmdstan/file_fingerprint.hpp>
+#include <stan/io/var_context.hpp>
+#include <stan/model/model_base.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+
+// forward declaration for function defined in another translation unit
+stan::model::model_base &new_model(stan::io::var_context &data_context,
+                                   unsigned int seed, std::ostream *msg_stream);
+
+namespace cmdstan {
+
+/**
+ * Models constructed from data files, kept so that a process which runs
+ * many jobs reads the data and constructs the model once per data file
+ * and seed.  The seed is part of the key because it seeds the random
+ * numbers drawn in transformed data, so only jobs which give a seed
+ * should take their model from the cache.  A model is constructed again
+ * if its data file has changed.  When the cache is full, the least
+ * recently used model is dropped.  Safe to use from several threads.
+ */
+class model_cache {
+ public:
+  /**
+   * @param max_size maximum number of models kept
+   */
+  explicit model_cache(size_t max_size = 16) : max_size_(max_size) {}
+
+  /**
+   * Return the model for a data file and seed, constructing it if it
+   * is not in the cache or its data file has changed.
+   *
+   * @param data_file name of data file, empty if the model has no data
+   * @param seed seed for the random numbers drawn in transformed data
+   * @param msg_stream stream for messages from the model constructor
+   * @return model
+   */
+  std::shared_ptr<stan::model::model_base> get(const std::string &data_file,
+                                               unsigned int seed,
+                                               std::ostream *msg_stream) {
+    file_fingerprint fingerprint;
+    if (!data_file.empty())
+      fingerprint = get_file_fingerprint(data_file);
+    auto key = std::make_pair(data_file, seed);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = models_.find(key);
+      if (found != models_.end() && found->second.fingerprint == fingerprint) {
+        found->second.last_used = ++uses_;
+        return found->second.model;
+      }
+    }
+    // jobs for other data files are not held up while this one is read
+    std::shared_ptr<stan::model::model_base> model(
+        &new_model(*get_var_context(data_file), seed, msg_stream));
+    std::lock_guard<std::mutex> lock(mutex_);
+    models_[key] = {fingerprint, model, ++uses_};
+    while (models_.size() > max_size_) {
+      auto oldest = models_.begin();
+      for (auto it = models_.begin(); it != models_.end(); ++it)
+        if (it->second.last_used < oldest->second.last_used)
+          oldest = it;
+      // jobs still running with the model keep it alive
+      models_.erase(oldest);
+    }
+    return model;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return models_.size();
+  }
+
+ private:
+  struct entry {
+    file_fingerprint fingerprint;
+    std::shared_ptr<stan::model::model_base> model;
+    size_t last_used;
+  };
+
+  size_t max_size_;
+  size_t uses_ = 0;
+  std::mutex mutex_;
+  std::map<std::pair<std::string, unsigned int>, entry> models_;
+};
+
+}  // namespace cmdstan
+#endif
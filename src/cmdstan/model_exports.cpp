@@ -0,0 +1,29 @@
+#include <cmdstan/shared_model.hpp>
+
+// defined by the generated code of the model, linked into the library
+stan::model::model_base &new_model(stan::io::var_context &data_context,
+                                   unsigned int seed, std::ostream *msg_stream);
+stan::math::profile_map &get_stan_profile_data();
+
+/*
+ * Functions of a model library which the driver looks up by name.
+ * The library is linked with -Bsymbolic-functions where supported, so
+ * these call the model's functions rather than the driver's.
+ */
+extern "C" {
+
+const char *cmdstan_model_abi() {
+  static const std::string abi = cmdstan::shared_model_abi();
+  return abi.c_str();
+}
+
+stan::model::model_base *cmdstan_new_model(
+    stan::io::var_context &data_context, unsigned int seed,
+    std::ostream *msg_stream) {
+  return &new_model(data_context, seed, msg_stream);
+}
+
+stan::math::profile_map *cmdstan_profile_data() {
+  return &get_stan_profile_data();
+}
+}
@@ -0,0 +1,562 @@
+#ifndef CMDSTAN_NUTS_CHAINS_HPP
+#define CMDSTAN_NUTS_CHAINS_HPP
+
+#include <cmdstan/command_helper.hpp>
+#include <cmdstan/convergence_monitor.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <cmdstan/sample_checkpoint.hpp>
+#include <cmdstan/stop_interrupt.hpp>
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <stan/io/var_context.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/math/prim/fun/welford_var_estimator.hpp>
+#include <stan/mcmc/hmc/nuts/adapt_diag_e_nuts.hpp>
+#include <stan/mcmc/sample.hpp>
+#include <stan/mcmc/stepsize_adaptation.hpp>
+#include <stan/mcmc/var_adaptation.hpp>
+#include <stan/services/error_codes.hpp>
+#include <stan/services/util/create_rng.hpp>
+#include <stan/services/util/generate_transitions.hpp>
+#include <stan/services/util/initialize.hpp>
+#include <stan/services/util/mcmc_writer.hpp>
+#include <stan/services/util/read_diag_inv_metric.hpp>
+#include <stan/services/util/validate_diag_inv_metric.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Settings of the NUTS sampler with a diagonal metric, as given by the
+ * arguments of the sample method.
+ */
+struct nuts_config {
+  int num_warmup = 1000;
+  int num_samples = 1000;
+  int num_thin = 1;
+  bool save_warmup = false;
+  int refresh = 100;
+  double stepsize = 1;
+  double stepsize_jitter = 0;
+  int max_depth = 10;
+  bool adapt_engaged = true;
+  double delta = 0.8;
+  double gamma = 0.05;
+  double kappa = 0.75;
+  double t0 = 10;
+  unsigned int init_buffer = 75;
+  unsigned int term_buffer = 50;
+  unsigned int window = 25;
+  int checkpoint_every = 0;  // iterations between checkpoints, 0 for none
+  bool early_stop = false;
+  double target_rhat = 1.01;
+  double target_ess = 400;
+  int check_every = 100;  // iterations between convergence checks
+};
+
+namespace internal {
+
+/*
+ * Stan's adaptation classes keep their state in protected members;
+ * these classes are never instantiated and only give access to it.
+ */
+struct stepsize_adaptation_access : stan::mcmc::stepsize_adaptation {
+  using base = stan::mcmc::stepsize_adaptation;
+  static void save(base &a, chain_checkpoint &cp) {
+    cp.counter = a.*(&stepsize_adaptation_access::counter_);
+    cp.s_bar = a.*(&stepsize_adaptation_access::s_bar_);
+    cp.x_bar = a.*(&stepsize_adaptation_access::x_bar_);
+    cp.mu = a.get_mu();
+  }
+  static void restore(base &a, const chain_checkpoint &cp) {
+    a.*(&stepsize_adaptation_access::counter_) = cp.counter;
+    a.*(&stepsize_adaptation_access::s_bar_) = cp.s_bar;
+    a.*(&stepsize_adaptation_access::x_bar_) = cp.x_bar;
+    a.set_mu(cp.mu);
+  }
+};
+
+struct welford_var_access : stan::math::welford_var_estimator {
+  using base = stan::math::welford_var_estimator;
+  static void save(base &e, chain_checkpoint &cp) {
+    cp.estimator_num_samples = e.*(&welford_var_access::num_samples_);
+    cp.estimator_mean = e.*(&welford_var_access::m_);
+    cp.estimator_m2 = e.*(&welford_var_access::m2_);
+  }
+  static void restore(base &e, const chain_checkpoint &cp) {
+    e.*(&welford_var_access::num_samples_) = cp.estimator_num_samples;
+    e.*(&welford_var_access::m_) = cp.estimator_mean;
+    e.*(&welford_var_access::m2_) = cp.estimator_m2;
+  }
+};
+
+struct var_adaptation_access : stan::mcmc::var_adaptation {
+  using base = stan::mcmc::var_adaptation;
+  static void save(base &a, chain_checkpoint &cp) {
+    cp.adapt_window_counter
+        = a.*(&var_adaptation_access::adapt_window_counter_);
+    cp.adapt_window_size = a.*(&var_adaptation_access::adapt_window_size_);
+    cp.adapt_next_window = a.*(&var_adaptation_access::adapt_next_window_);
+    welford_var_access::save(a.*(&var_adaptation_access::estimator_), cp);
+  }
+  static void restore(base &a, const chain_checkpoint &cp) {
+    a.*(&var_adaptation_access::adapt_window_counter_)
+        = cp.adapt_window_counter;
+    a.*(&var_adaptation_access::adapt_window_size_) = cp.adapt_window_size;
+    a.*(&var_adaptation_access::adapt_next_window_) = cp.adapt_next_window;
+    welford_var_access::restore(a.*(&var_adaptation_access::estimator_), cp);
+  }
+};
+
+}  // namespace internal
+
+/**
+ * One chain of the NUTS sampler with a diagonal metric, run in steps.
+ * The chain follows `stan::services::sample::hmc_nuts_diag_e_adapt`
+ * and `hmc_nuts_diag_e` iteration for iteration, but can be stopped at
+ * any iteration boundary, saved to a checkpoint, and restored from one.
+ *
+ * @tparam Model type of model
+ */
+template <class Model>
+class nuts_chain {
+ public:
+  using rng_t = decltype(stan::services::util::create_rng(0, 0));
+  using sampler_t = stan::mcmc::adapt_diag_e_nuts<Model, rng_t>;
+
+  nuts_chain(Model &model, const nuts_config &config, unsigned int random_seed,
+             unsigned int chain_id, size_t num_chains,
+             stan::callbacks::logger &logger,
+             stan::callbacks::writer &sample_writer,
+             stan::callbacks::writer &diagnostic_writer)
+      : model_(model),
+        config_(config),
+        chain_id_(chain_id),
+        num_chains_(num_chains),
+        logger_(logger),
+        sample_writer_(sample_writer),
+        rng_(stan::services::util::create_rng(random_seed, chain_id)),
+        sampler_(model, rng_),
+        writer_(sample_writer, diagnostic_writer, logger),
+        s_(Eigen::VectorXd(0), 0, 0) {
+    sampler_.set_stepsize_jitter(config.stepsize_jitter);
+    sampler_.set_max_depth(config.max_depth);
+    auto &stepsize_adaptation = sampler_.get_stepsize_adaptation();
+    stepsize_adaptation.set_delta(config.delta);
+    stepsize_adaptation.set_gamma(config.gamma);
+    stepsize_adaptation.set_kappa(config.kappa);
+    stepsize_adaptation.set_t0(config.t0);
+    if (config.adapt_engaged)
+      sampler_.set_window_params(config.num_warmup, config.init_buffer,
+                                 config.term_buffer, config.window, logger);
+  }
+
+  nuts_chain(const nuts_chain &) = delete;
+  nuts_chain &operator=(const nuts_chain &) = delete;
+
+  /**
+   * Initialize the chain and write the CSV headers.  Throws an exception
+   * if no initial values can be found or the metric is invalid.
+   *
+   * @param init initial values
+   * @param inv_metric var context holding the inverse metric,
+   *   null for the unit metric
+   * @param init_radius radius for random inits
+   * @param init_writer writer for the initial values
+   */
+  void initialize(const stan::io::var_context &init,
+                  const stan::io::var_context *inv_metric, double init_radius,
+                  stan::callbacks::writer &init_writer) {
+    std::vector<double> cont_vector = stan::services::util::initialize(
+        model_, init, rng_, init_radius, true, logger_, init_writer);
+    Eigen::VectorXd inv_metric_vector
+        = Eigen::VectorXd::Ones(model_.num_params_r());
+    if (inv_metric != nullptr) {
+      inv_metric_vector = stan::services::util::read_diag_inv_metric(
+          *inv_metric, model_.num_params_r(), logger_);
+      stan::services::util::validate_diag_inv_metric(inv_metric_vector,
+                                                     logger_);
+    }
+    sampler_.set_metric(inv_metric_vector);
+    sampler_.set_nominal_stepsize(config_.stepsize);
+    sampler_.get_stepsize_adaptation().set_mu(std::log(10 * config_.stepsize));
+
+    Eigen::Map<Eigen::VectorXd> cont_params(cont_vector.data(),
+                                            cont_vector.size());
+    s_ = stan::mcmc::sample(cont_params, 0, 0);
+    if (config_.adapt_engaged) {
+      sampler_.engage_adaptation();
+      sampler_.z().q = cont_params;
+      sampler_.init_stepsize(logger_);
+    }
+    writer_.write_sample_names(s_, sampler_, model_);
+    writer_.write_diagnostic_names(s_, sampler_, model_);
+    if (config_.num_warmup == 0)
+      end_warmup();
+  }
+
+  /**
+   * Run up to `num_iterations` iterations, stopping early at the end of
+   * warmup, so that the thinning of saved draws restarts with sampling
+   * as it does in Stan's services.  If the interrupt callback throws a
+   * `stop_exception`, the chain stops at that iteration boundary and
+   * records the reason.
+   *
+   * @param num_iterations maximum number of iterations
+   * @param interrupt interrupt callback
+   * @return number of iterations run
+   */
+  int run(int num_iterations, stan::callbacks::interrupt &interrupt) {
+    int num_warmup = config_.num_warmup;
+    int finish = num_warmup + config_.num_samples;
+    bool warmup = iteration_ < num_warmup;
+    int end = std::min(iteration_ + num_iterations,
+                       warmup ? num_warmup : finish);
+    int n = std::max(end - iteration_, 0);
+    auto start = std::chrono::steady_clock::now();
+    counting_interrupt counter(interrupt);
+    try {
+      stan::services::util::generate_transitions(
+          sampler_, n, iteration_, finish, config_.num_thin, config_.refresh,
+          warmup ? config_.save_warmup : true, warmup, writer_, s_, model_,
+          rng_, counter, logger_, chain_id_, num_chains_);
+    } catch (const stop_exception &e) {
+      n = counter.count;
+      stop_reason_ = e.what();
+    }
+    double elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count()
+                     / 1000.0;
+    (warmup ? warmup_time_ : sampling_time_) += elapsed;
+    iteration_ += n;
+    if (warmup && iteration_ == num_warmup)
+      end_warmup();
+    return n;
+  }
+
+  /**
+   * Write the elapsed times of warmup and sampling.
+   */
+  void finish() { writer_.write_timing(warmup_time_, sampling_time_); }
+
+  /**
+   * Return true if all warmup and sampling iterations have been run.
+   */
+  bool done() const {
+    return iteration_ >= config_.num_warmup + config_.num_samples;
+  }
+
+  /**
+   * Return the number of iterations run, including warmup.
+   */
+  int iteration() const { return iteration_; }
+
+  /**
+   * Return the reason the chain was stopped by its interrupt callback,
+   * or an empty string if it was not.
+   */
+  const std::string &stop_reason() const { return stop_reason_; }
+
+  /**
+   * Return true if the number of iterations run in the current phase is
+   * a multiple of the thinning period, so that a run resumed from here
+   * saves the same draws.
+   */
+  bool thin_aligned() const {
+    int n = iteration_ < config_.num_warmup ? iteration_
+                                            : iteration_ - config_.num_warmup;
+    return n % config_.num_thin == 0;
+  }
+
+  /**
+   * Save the state of the chain.  The sizes of the output files
+   * are filled in when the checkpoint is written.
+   *
+   * @param cp output, checkpoint
+   */
+  void save(chain_checkpoint &cp) {
+    cp.model_name = model_.model_name();
+    cp.chain_id = chain_id_;
+    cp.num_warmup = config_.num_warmup;
+    cp.num_samples = config_.num_samples;
+    cp.num_thin = config_.num_thin;
+    cp.iteration = iteration_;
+    cp.warmup_time = warmup_time_;
+    cp.sampling_time = sampling_time_;
+    std::stringstream rng_state;
+    rng_state << rng_;
+    cp.rng_state = rng_state.str();
+    cp.params = s_.cont_params();
+    cp.log_prob = s_.log_prob();
+    cp.accept_stat = s_.accept_stat();
+    cp.stepsize = sampler_.get_nominal_stepsize();
+    cp.inv_metric = sampler_.z().inv_e_metric_;
+    cp.adapting = sampler_.adapting();
+    internal::stepsize_adaptation_access::save(
+        sampler_.get_stepsize_adaptation(), cp);
+    internal::var_adaptation_access::save(sampler_.get_var_adaptation(), cp);
+  }
+
+  /**
+   * Restore the state of the chain from a checkpoint, in place of
+   * `initialize`.  The CSV headers are already in the output files.
+   *
+   * @param cp checkpoint
+   */
+  void restore(const chain_checkpoint &cp) {
+    iteration_ = cp.iteration;
+    warmup_time_ = cp.warmup_time;
+    sampling_time_ = cp.sampling_time;
+    std::stringstream rng_state(cp.rng_state);
+    rng_state >> rng_;
+    s_ = stan::mcmc::sample(cp.params, cp.log_prob, cp.accept_stat);
+    sampler_.z().q = cp.params;
+    sampler_.set_metric(cp.inv_metric);
+    sampler_.set_nominal_stepsize(cp.stepsize);
+    if (cp.adapting)
+      sampler_.engage_adaptation();
+    else
+      sampler_.disengage_adaptation();
+    internal::stepsize_adaptation_access::restore(
+        sampler_.get_stepsize_adaptation(), cp);
+    internal::var_adaptation_access::restore(sampler_.get_var_adaptation(),
+                                             cp);
+  }
+
+ private:
+  // counts the iterations started, i.e., completed before a stop
+  struct counting_interrupt : public stan::callbacks::interrupt {
+    explicit counting_interrupt(stan::callbacks::interrupt &interrupt)
+        : interrupt_(interrupt) {}
+    void operator()() override {
+      interrupt_();
+      ++count;
+    }
+    stan::callbacks::interrupt &interrupt_;
+    int count = 0;
+  };
+
+  void end_warmup() {
+    if (config_.adapt_engaged)
+      sampler_.disengage_adaptation();
+    writer_.write_adapt_finish(sampler_);
+    sampler_.write_sampler_state(sample_writer_);
+  }
+
+  Model &model_;
+  nuts_config config_;
+  unsigned int chain_id_;
+  size_t num_chains_;
+  stan::callbacks::logger &logger_;
+  stan::callbacks::writer &sample_writer_;
+  rng_t rng_;
+  sampler_t sampler_;
+  stan::services::util::mcmc_writer writer_;
+  stan::mcmc::sample s_;
+  int iteration_ = 0;
+  double warmup_time_ = 0;
+  double sampling_time_ = 0;
+  std::string stop_reason_;
+};
+
+/**
+ * Run the NUTS sampler with a diagonal metric for all chains, in rounds
+ * of `checkpoint_every` or `check_every` iterations, whichever is less,
+ * with the chains of each round run in parallel.  After each round the
+ * checkpoint of every chain is written and, with early stopping, the
+ * convergence diagnostics of the draws of all chains are computed from
+ * the draws kept in memory; once they meet their targets sampling stops
+ * and the reason is written at the end of each chain's output.
+ * When resuming, each chain is restored from its checkpoint instead of
+ * being initialized, and continues appending to its output files,
+ * which must already be truncated to their sizes at the checkpoint.
+ * If the interrupt callback stops the chains, each chain writes its
+ * timing, the reason for stopping, and, when aligned with thinning,
+ * its checkpoint, and its output is flushed.
+ *
+ * @tparam Model type of model
+ * @param model model
+ * @param config sampler settings
+ * @param num_chains number of chains
+ * @param init_contexts initial values, one per chain
+ * @param metric_contexts inverse metric, one per chain, empty for the
+ *   unit metric
+ * @param random_seed random seed
+ * @param id chain id of the first chain
+ * @param init_radius radius for random inits
+ * @param checkpoints checkpoints to resume from, empty to start afresh
+ * @param files checkpoint and output files, one per chain
+ * @param interrupt interrupt callback
+ * @param logger logger
+ * @param init_writers writers for initial values, one per chain
+ * @param sample_writers writers for the draws, one per chain
+ * @param diagnostic_writers writers for diagnostics, one per chain
+ * @return error_codes::OK on success, return_codes::INTERRUPTED if
+ *   the chains were stopped by the interrupt callback
+ */
+template <class Model, class InitWriter, class SampleWriter,
+          class DiagnosticWriter>
+int run_nuts_chains(Model &model, const nuts_config &config,
+                    size_t num_chains, const context_vector &init_contexts,
+                    const context_vector &metric_contexts,
+                    unsigned int random_seed, unsigned int id,
+                    double init_radius,
+                    const std::vector<chain_checkpoint> &checkpoints,
+                    const std::vector<checkpoint_files> &files,
+                    stan::callbacks::interrupt &interrupt,
+                    stan::callbacks::logger &logger,
+                    std::vector<InitWriter> &init_writers,
+                    std::vector<SampleWriter> &sample_writers,
+                    std::vector<DiagnosticWriter> &diagnostic_writers) {
+  std::vector<draws_recorder> recorders;
+  recorders.reserve(num_chains);
+  std::vector<std::unique_ptr<nuts_chain<Model>>> chains;
+  for (size_t i = 0; i < num_chains; ++i) {
+    recorders.emplace_back(sample_writers[i]);
+    chains.push_back(std::make_unique<nuts_chain<Model>>(
+        model, config, random_seed, id + i, num_chains, logger, recorders[i],
+        diagnostic_writers[i]));
+  }
+
+  // exceptions are reported per chain, as in Stan's services
+  auto guarded = [&logger](auto &&f) {
+    return [&logger, f](size_t i) {
+      try {
+        f(i);
+      } catch (const stop_exception &e) {
+        throw;
+      } catch (const std::exception &e) {
+        logger.error(e.what());
+        return stan::services::error_codes::SOFTWARE;
+      }
+      return stan::services::error_codes::OK;
+    };
+  };
+
+  int return_code = run_chains_parallel(
+      num_chains, guarded([&](size_t i) {
+        if (!checkpoints.empty())
+          chains[i]->restore(checkpoints[i]);
+        else
+          chains[i]->initialize(
+              *init_contexts[i],
+              metric_contexts.empty() ? nullptr : metric_contexts[i].get(),
+              init_radius, init_writers[i]);
+      }));
+  if (return_code != stan::services::error_codes::OK)
+    return return_code;
+  if (config.early_stop && !checkpoints.empty()) {
+    // the draws sampled before the checkpoint are only in the output files
+    for (size_t i = 0; i < num_chains; ++i) {
+      int num_sampled = checkpoints[i].iteration - config.num_warmup;
+      if (num_sampled <= 0)
+        continue;
+      std::ifstream csv_stream(files[i].sample);
+      std::stringstream msgs;
+      stan::io::stan_csv csv
+          = stan::io::stan_csv_reader::parse(csv_stream, &msgs);
+      Eigen::Index num_saved
+          = std::min<Eigen::Index>((num_sampled + config.num_thin - 1)
+                                       / config.num_thin,
+                                   csv.samples.rows());
+      recorders[i].add(csv.header, csv.samples.bottomRows(num_saved));
+    }
+  }
+
+  int round_size = config.num_warmup + config.num_samples;
+  if (config.checkpoint_every > 0)
+    round_size = config.checkpoint_every;
+  if (config.early_stop)
+    round_size = std::min(round_size, config.check_every);
+  std::string stop_reason;
+  std::string interrupt_reason;
+  auto all_done = [&chains]() {
+    return std::all_of(chains.begin(), chains.end(),
+                       [](const auto &chain) { return chain->done(); });
+  };
+  while (!all_done()) {
+    for (size_t i = 0; i < num_chains; ++i)
+      recorders[i].record(chains[i]->iteration() >= config.num_warmup);
+    return_code = run_chains_parallel(
+        num_chains, guarded([&](size_t i) {
+          chains[i]->run(round_size, interrupt);
+          bool stopped = !chains[i]->stop_reason().empty();
+          if (config.checkpoint_every > 0
+              && (!stopped || chains[i]->thin_aligned())) {
+            chain_checkpoint cp;
+            chains[i]->save(cp);
+            write_checkpoint(files[i], cp);
+          }
+        }));
+    if (return_code != stan::services::error_codes::OK)
+      return return_code;
+    for (const auto &chain : chains)
+      if (!chain->stop_reason().empty())
+        interrupt_reason = chain->stop_reason();
+    if (!interrupt_reason.empty())
+      break;
+    if (!config.early_stop || chains[0]->iteration() <= config.num_warmup)
+      continue;
+    convergence_status status = check_convergence(recorders);
+    if (status.converged(config.target_rhat, config.target_ess)) {
+      std::stringstream reason;
+      reason << "Sampling stopped early after "
+             << chains[0]->iteration() - config.num_warmup
+             << " iterations: R-hat " << std::setprecision(4)
+             << status.max_rhat << " (" << status.max_rhat_name
+             << ") <= " << config.target_rhat << ", bulk ESS "
+             << std::setprecision(6) << status.min_ess << " ("
+             << status.min_ess_name << ") >= " << config.target_ess;
+      stop_reason = reason.str();
+      break;
+    }
+  }
+  if (config.early_stop && stop_reason.empty() && interrupt_reason.empty()) {
+    convergence_status status = check_convergence(recorders);
+    std::stringstream reason;
+    reason << "Sampling completed without meeting the early stopping "
+           << "targets: R-hat " << std::setprecision(4) << status.max_rhat
+           << " (" << status.max_rhat_name << "), bulk ESS "
+           << std::setprecision(6) << status.min_ess << " ("
+           << status.min_ess_name << ")";
+    stop_reason = reason.str();
+  }
+  for (size_t i = 0; i < num_chains; ++i) {
+    chains[i]->finish();
+    if (!interrupt_reason.empty()) {
+      recorders[i]("Sampling stopped after "
+                   + std::to_string(chains[i]->iteration())
+                   + " iterations: " + interrupt_reason);
+      recorders[i]();
+    } else if (!stop_reason.empty()) {
+      recorders[i](stop_reason);
+      recorders[i]();
+    }
+    if (files[i].sample_stream != nullptr)
+      files[i].sample_stream->flush();
+    if (files[i].diagnostic_stream != nullptr)
+      files[i].diagnostic_stream->flush();
+  }
+  if (!interrupt_reason.empty()) {
+    logger.info("Sampling stopped: " + interrupt_reason);
+    return return_codes::INTERRUPTED;
+  }
+  if (!stop_reason.empty())
+    logger.info(stop_reason);
+  return stan::services::error_codes::OK;
+}
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,238 @@
+#ifndef CMDSTAN_OUTPUT_STREAM_HPP
+#define CMDSTAN_OUTPUT_STREAM_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace cmdstan {
+
+/**
+ * Magic bytes which start a framed stream of the output of several
+ * chains.  Each frame which follows is the chain id and the number of
+ * bytes of the payload, as 32-bit little-endian unsigned integers, and
+ * the payload: one or more complete lines of the chain's CSV output.
+ */
+constexpr char framed_stream_magic[] = "STANCSV1";
+constexpr size_t framed_stream_magic_size = sizeof(framed_stream_magic) - 1;
+
+/**
+ * Return true if output to this file is streamed, i.e., the file is
+ * "-", for standard output, or an existing named pipe.
+ */
+inline bool is_output_stream(const std::string &file) {
+  if (file == "-")
+    return true;
+#ifndef _WIN32
+  struct stat status;
+  return stat(file.c_str(), &status) == 0 && S_ISFIFO(status.st_mode);
+#else
+  return false;
+#endif
+}
+
+namespace internal {
+inline void put_uint32_le(char *bytes, std::uint32_t x) {
+  for (int i = 0; i < 4; ++i)
+    bytes[i] = static_cast<char>((x >> (8 * i)) & 0xff);
+}
+
+inline std::uint32_t get_uint32_le(const char *bytes) {
+  std::uint32_t x = 0;
+  for (int i = 0; i < 4; ++i)
+    x |= static_cast<std::uint32_t>(static_cast<unsigned char>(bytes[i]))
+         << (8 * i);
+  return x;
+}
+}  // namespace internal
+
+/**
+ * Stream buffer of one chain's output to a shared framed stream.
+ * Output is buffered and written in frames of complete lines, so the
+ * lines of different chains are never interleaved.
+ */
+class frame_streambuf : public std::streambuf {
+ public:
+  /**
+   * @param out shared stream
+   * @param mutex mutex guarding the shared stream
+   * @param chain_id chain id tagging the frames
+   */
+  frame_streambuf(std::ostream &out, std::mutex &mutex,
+                  std::uint32_t chain_id)
+      : out_(out), mutex_(mutex), chain_id_(chain_id), buffer_(1 << 16) {
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+  }
+
+  ~frame_streambuf() { emit(pptr()); }
+
+ protected:
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+    if (!emit_lines()) {
+      // a single line longer than the buffer
+      size_t size = pptr() - pbase();
+      buffer_.resize(2 * buffer_.size());
+      setp(buffer_.data(), buffer_.data() + buffer_.size());
+      pbump(static_cast<int>(size));
+    }
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+  }
+
+  int sync() override {
+    emit_lines();
+    std::lock_guard<std::mutex> lock(mutex_);
+    out_.flush();
+    return out_ ? 0 : -1;
+  }
+
+ private:
+  std::ostream &out_;
+  std::mutex &mutex_;
+  std::uint32_t chain_id_;
+  std::vector<char> buffer_;
+
+  /*
+   * Write the complete lines in the buffer as a frame and move the
+   * rest to its start.  Return false if there is no complete line.
+   */
+  bool emit_lines() {
+    char *end = pptr();
+    while (end > pbase() && *(end - 1) != '\n')
+      --end;
+    if (end == pbase())
+      return false;
+    emit(end);
+    return true;
+  }
+
+  void emit(char *end) {
+    size_t size = end - pbase();
+    if (size == 0)
+      return;
+    char header[8];
+    internal::put_uint32_le(header, chain_id_);
+    internal::put_uint32_le(header + 4, static_cast<std::uint32_t>(size));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      out_.write(header, sizeof(header));
+      out_.write(pbase(), size);
+    }
+    size_t rest = pptr() - end;
+    std::copy(end, pptr(), buffer_.data());
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+    pbump(static_cast<int>(rest));
+  }
+};
+
+/**
+ * Read the next frame of a framed stream, after its magic bytes.
+ *
+ * @param in framed stream
+ * @param chain_id set to the chain id of the frame
+ * @param payload set to the payload of the frame
+ * @return false at the end of the stream
+ */
+inline bool read_frame(std::istream &in, std::uint32_t &chain_id,
+                       std::string &payload) {
+  char header[8];
+  if (!in.read(header, sizeof(header)))
+    return false;
+  chain_id = internal::get_uint32_le(header);
+  payload.resize(internal::get_uint32_le(header + 4));
+  return static_cast<bool>(in.read(&payload[0], payload.size()));
+}
+
+/**
+ * Output of the chains streamed to standard output or a named pipe
+ * instead of files.  A single chain writes its CSV output unchanged;
+ * several chains write a framed stream, tagged by chain id.  The
+ * writers' streams are file streams which write to stream buffers
+ * owned by this object, so it must outlive the writers.
+ */
+class output_stream {
+ public:
+  /**
+   * @param file "-" or the path of a named pipe
+   * @param stdout_buf stream buffer of standard output
+   */
+  output_stream(const std::string &file, std::streambuf *stdout_buf)
+      : out_(stdout_buf) {
+    if (file != "-") {
+      pipe_ = std::make_unique<std::ofstream>(file, std::ios::binary);
+      if (!*pipe_)
+        throw std::invalid_argument("Can't open named pipe \"" + file + "\"");
+      out_.rdbuf(pipe_->rdbuf());
+    }
+  }
+
+  output_stream(const output_stream &) = delete;
+  output_stream &operator=(const output_stream &) = delete;
+
+  ~output_stream() {
+    buffers_.clear();  // writes the chains' remaining output
+    out_.flush();
+  }
+
+  /**
+   * Open one writer per chain on the stream.
+   *
+   * @param writers output, writers
+   * @param num_chains number of chains
+   * @param id chain id of the first chain
+   * @param sig_figs precision of the streams, -1 for the default
+   * @param args further arguments of the writers' constructor
+   * @return streams of the writers
+   */
+  template <typename T, typename... Ts>
+  std::vector<std::ofstream *> open_writers(std::vector<T> &writers,
+                                            unsigned int num_chains,
+                                            unsigned int id, int sig_figs,
+                                            Ts &&... args) {
+    if (num_chains > 1)
+      out_.write(framed_stream_magic, framed_stream_magic_size);
+    std::vector<std::ofstream *> streams;
+    writers.reserve(num_chains);
+    for (unsigned int i = 0; i < num_chains; ++i) {
+      std::streambuf *buf = out_.rdbuf();
+      if (num_chains > 1) {
+        buffers_.push_back(
+            std::make_unique<frame_streambuf>(out_, mutex_, id + i));
+        buf = buffers_.back().get();
+      }
+      // a file stream which is never opened, writing to the stream buffer
+      auto ofs = std::make_unique<std::ofstream>();
+      ofs->std::ios::rdbuf(buf);
+      if (sig_figs > -1)
+        ofs->precision(sig_figs);
+      streams.push_back(ofs.get());
+      writers.emplace_back(std::move(ofs), std::forward<Ts>(args)...);
+    }
+    return streams;
+  }
+
+ private:
+  std::unique_ptr<std::ofstream> pipe_;
+  std::ostream out_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<frame_streambuf>> buffers_;
+};
+
+}  // namespace cmdstan
+#endif
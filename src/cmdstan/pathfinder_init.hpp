@@ -0,0 +1,161 @@
+#ifndef CMDSTAN_PATHFINDER_INIT_HPP
+#define CMDSTAN_PATHFINDER_INIT_HPP
+
+#include <cmdstan/arguments/arg_pathfinder.hpp>
+#include <cmdstan/command_helper.hpp>
+#include <stan/callbacks/interrupt.hpp>
+#include <stan/callbacks/json_writer.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/callbacks/unique_stream_writer.hpp>
+#include <stan/callbacks/writer.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/model/model_base.hpp>
+#include <stan/services/error_codes.hpp>
+#include <stan/services/pathfinder/multi.hpp>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Estimate an inverse metric from draws on the unconstrained scale,
+ * regularized towards the identity in the same way as Stan's
+ * windowed adaptation, and return it as a var context holding
+ * the variable `inv_metric`.
+ *
+ * @param draws unconstrained draws, one row per draw
+ * @param dense true for a dense metric, false for a diagonal one
+ * @return var context for the metric
+ */
+inline shared_context_ptr draws_metric_context(const Eigen::MatrixXd &draws,
+                                               bool dense) {
+  double n = draws.rows();
+  Eigen::MatrixXd centered = draws.rowwise() - draws.colwise().mean();
+  Eigen::MatrixXd cov = centered.transpose() * centered / std::max(n - 1, 1.0);
+  cov = (n / (n + 5.0)) * cov;
+  cov.diagonal().array() += 1e-3 * (5.0 / (n + 5.0));
+  return metric_var_context(cov, dense);
+}
+
+/**
+ * Run multi-path pathfinder with its default settings and use the
+ * approximate draws to initialize the sampler: chain i is initialized
+ * from draw i * D / num_chains of the D importance-resampled draws,
+ * and the inverse metric of every chain is estimated from all of
+ * the draws on the unconstrained scale.  The paths use the chain ids
+ * following those of the chains so their RNG streams differ from the
+ * sampler's.  The draws are kept in memory.
+ *
+ * @param model model
+ * @param init name of init file, empty for random inits
+ * @param random_seed random seed
+ * @param id chain id of the first chain
+ * @param init_radius radius for random inits
+ * @param num_chains number of chains
+ * @param metric sampler metric, one of "unit_e", "diag_e", "dense_e"
+ * @param refresh refresh rate
+ * @param interrupt interrupt callback
+ * @param logger logger
+ * @param init_contexts output, one init context per chain
+ * @param metric_contexts output, one metric context per chain, left empty
+ *   for the unit metric
+ * @return error_codes::OK on success
+ */
+inline int pathfinder_inits(stan::model::model_base &model,
+                            const std::string &init, unsigned int random_seed,
+                            unsigned int id, double init_radius,
+                            unsigned int num_chains, const std::string &metric,
+                            int refresh, stan::callbacks::interrupt &interrupt,
+                            stan::callbacks::logger &logger,
+                            context_vector &init_contexts,
+                            context_vector &metric_contexts) {
+  arg_pathfinder defaults;
+  int history_size = get_arg_val<int_argument>(defaults, "history_size");
+  double init_alpha = get_arg_val<real_argument>(defaults, "init_alpha");
+  double tol_obj = get_arg_val<real_argument>(defaults, "tol_obj");
+  double tol_rel_obj = get_arg_val<real_argument>(defaults, "tol_rel_obj");
+  double tol_grad = get_arg_val<real_argument>(defaults, "tol_grad");
+  double tol_rel_grad = get_arg_val<real_argument>(defaults, "tol_rel_grad");
+  double tol_param = get_arg_val<real_argument>(defaults, "tol_param");
+  int max_lbfgs_iters = get_arg_val<int_argument>(defaults, "max_lbfgs_iters");
+  int num_elbo_draws = get_arg_val<int_argument>(defaults, "num_elbo_draws");
+  int num_draws = get_arg_val<int_argument>(defaults, "num_draws");
+  int num_psis_draws = get_arg_val<int_argument>(defaults, "num_psis_draws");
+  unsigned int num_paths = std::max<unsigned int>(
+      num_chains, get_arg_val<int_argument>(defaults, "num_paths"));
+  num_psis_draws = std::max<int>(num_psis_draws, num_chains);
+  unsigned int path_id = id + num_chains;
+
+  context_vector path_inits = get_vec_var_context(init, num_paths, path_id);
+  std::vector<stan::callbacks::writer> init_writers(num_paths);
+  std::vector<stan::callbacks::unique_stream_writer<std::ofstream>>
+      single_path_writers;
+  std::vector<stan::callbacks::json_writer<std::ofstream>>
+      single_path_json_writers;
+  init_null_writers(single_path_writers, num_paths);
+  init_null_writers(single_path_json_writers, num_paths);
+  stan::callbacks::json_writer<std::ofstream> dummy_json_writer;
+  auto draws_ss = std::make_unique<std::stringstream>();
+  std::stringstream *draws_stream = draws_ss.get();
+  stan::callbacks::unique_stream_writer<std::stringstream> draws_writer(
+      std::move(draws_ss), "# ");
+
+  logger.info("Running pathfinder to initialize the sampler");
+  int return_code = stan::services::pathfinder::pathfinder_lbfgs_multi<
+      stan::model::model_base>(
+      model, path_inits, random_seed, path_id, init_radius, history_size,
+      init_alpha, tol_obj, tol_rel_obj, tol_grad, tol_rel_grad, tol_param,
+      max_lbfgs_iters, num_elbo_draws, num_draws, num_psis_draws, num_paths,
+      false, refresh, interrupt, logger, init_writers, single_path_writers,
+      single_path_json_writers, draws_writer, dummy_json_writer);
+  if (return_code != stan::services::error_codes::OK)
+    return return_code;
+
+  draws_stream->seekg(0);
+  std::stringstream parse_msgs;
+  stan::io::stan_csv pathfinder_csv
+      = stan::io::stan_csv_reader::parse(*draws_stream, &parse_msgs);
+  std::vector<std::string> param_names;
+  model.constrained_param_names(param_names, false, false);
+  auto first = std::find(pathfinder_csv.header.begin(),
+                         pathfinder_csv.header.end(), param_names[0]);
+  size_t num_draws_out = pathfinder_csv.samples.rows();
+  if (first == pathfinder_csv.header.end() || num_draws_out == 0) {
+    logger.error("Pathfinder did not produce any draws");
+    return stan::services::error_codes::SOFTWARE;
+  }
+  Eigen::Index offset = first - pathfinder_csv.header.begin();
+  Eigen::MatrixXd constrained = pathfinder_csv.samples.middleCols(
+      offset, param_names.size());
+
+  init_contexts.clear();
+  for (size_t i = 0; i < num_chains; ++i) {
+    size_t row = i * num_draws_out / num_chains;
+    init_contexts.push_back(
+        params_var_context(model, constrained.row(row).transpose()));
+  }
+
+  metric_contexts.clear();
+  if (metric == "unit_e")
+    return stan::services::error_codes::OK;
+  Eigen::MatrixXd unconstrained(num_draws_out, model.num_params_r());
+  Eigen::VectorXd theta;
+  for (size_t m = 0; m < num_draws_out; ++m) {
+    model.unconstrain_array(constrained.row(m).transpose(), theta,
+                            &parse_msgs);
+    unconstrained.row(m) = theta.transpose();
+  }
+  auto metric_context
+      = draws_metric_context(unconstrained, metric == "dense_e");
+  metric_contexts.assign(num_chains, metric_context);
+  return stan::services::error_codes::OK;
+}
+
+}  // namespace cmdstan
+#endif
@@ -4,7 +4,7 @@
 namespace cmdstan {
 
 struct return_codes {
-  enum { OK = 0, NOT_OK = 1 };
+  enum { OK = 0, NOT_OK = 1, INTERRUPTED = 2 };
 };
 
 }  // namespace cmdstan
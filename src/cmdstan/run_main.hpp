@@ -0,0 +1,50 @@
+#ifndef CMDSTAN_RUN_MAIN_HPP
+#define CMDSTAN_RUN_MAIN_HPP
+
+#include <cmdstan/command.hpp>
+#include <cmdstan/manifest.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <cmdstan/serve.hpp>
+#include <cmdstan/stop_interrupt.hpp>
+#include <exception>
+#include <iostream>
+#include <string>
+
+namespace cmdstan {
+
+/**
+ * Run the program of a model: the server or manifest mode if the
+ * first argument names it, otherwise the method given by the
+ * arguments.  Exceptions are reported on standard error.  SIGINT and
+ * SIGTERM stop the run at the next iteration for its duration.
+ *
+ * @param argc number of arguments
+ * @param argv arguments, `argv[0]` being the program name
+ * @return return code
+ */
+inline int run_main(int argc, const char *argv[]) {
+  stop_signal_guard signals;
+  try {
+    if (argc > 1 && std::string(argv[1]) == "serve")
+      return serve(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "manifest")
+      return manifest(argc, argv);
+    int err_code = command(argc, argv);
+    if (err_code == 0)
+      return return_codes::OK;
+    else if (err_code == return_codes::INTERRUPTED)
+      return return_codes::INTERRUPTED;
+    else
+      return return_codes::NOT_OK;
+  } catch (const stop_exception &e) {
+    // output written so far is flushed as the writers are destroyed
+    std::cerr << "Stopped: " << e.what() << std::endl;
+    return return_codes::INTERRUPTED;
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return return_codes::NOT_OK;
+  }
+}
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,343 @@
+#ifndef CMDSTAN_SAMPLE_CHECKPOINT_HPP
+#define CMDSTAN_SAMPLE_CHECKPOINT_HPP
+
+#include <cmdstan/arguments/argument_parser.hpp>
+#include <cmdstan/binary_io.hpp>
+#include <cmdstan/command_helper.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/model/model_base.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace cmdstan {
+
+constexpr std::uint64_t checkpoint_magic = 0x544e50434b48434eULL;
+constexpr std::uint32_t checkpoint_version = 1;
+
+/**
+ * State of one NUTS chain between iterations: the position and RNG
+ * state, the step size and inverse metric, the state of step size and
+ * metric adaptation, the number of iterations completed, and the sizes
+ * of the chain's output files when the checkpoint was taken.
+ */
+struct chain_checkpoint {
+  std::string model_name;
+  std::uint32_t chain_id = 0;
+  std::int32_t num_warmup = 0;
+  std::int32_t num_samples = 0;
+  std::int32_t num_thin = 1;
+  std::int32_t iteration = 0;  // iterations completed, including warmup
+  double warmup_time = 0;
+  double sampling_time = 0;
+  std::uint64_t sample_offset = 0;
+  std::uint64_t diagnostic_offset = 0;
+
+  std::string rng_state;
+  Eigen::VectorXd params;  // unconstrained
+  double log_prob = 0;
+  double accept_stat = 0;
+  double stepsize = 0;
+  Eigen::VectorXd inv_metric;
+
+  // step size adaptation
+  bool adapting = false;
+  double counter = 0;
+  double s_bar = 0;
+  double x_bar = 0;
+  double mu = 0;
+  // windowed metric adaptation
+  std::uint32_t adapt_window_counter = 0;
+  std::uint32_t adapt_window_size = 0;
+  std::uint32_t adapt_next_window = 0;
+  double estimator_num_samples = 0;
+  Eigen::VectorXd estimator_mean;
+  Eigen::VectorXd estimator_m2;
+};
+
+/**
+ * Output files of a chain, flushed and measured when its checkpoint
+ * is written.  The streams are owned by the chain's writers; the
+ * diagnostic stream is null if no diagnostic file is written.
+ */
+struct checkpoint_files {
+  std::string checkpoint;
+  std::ofstream *sample_stream = nullptr;
+  std::string sample;
+  std::ofstream *diagnostic_stream = nullptr;
+  std::string diagnostic;
+};
+
+/**
+ * Return the size of a file, or 0 if it cannot be opened.
+ *
+ * @param filename name of file
+ * @return size in bytes
+ */
+inline std::uint64_t file_size(const std::string &filename) {
+  std::ifstream in(filename, std::ios::binary | std::ios::ate);
+  if (!in.good())
+    return 0;
+  return static_cast<std::uint64_t>(in.tellg());
+}
+
+/**
+ * Shorten a file to its first `size` bytes, in place, so that the
+ * contents before `size` are neither copied nor at risk.
+ * Throws an exception if the file is shorter or cannot be truncated.
+ *
+ * @param filename name of file
+ * @param size new size in bytes
+ */
+inline void truncate_file(const std::string &filename, std::uint64_t size) {
+  if (file_size(filename) < size) {
+    std::stringstream msg;
+    msg << "Output file \"" << filename << "\" is shorter than at the "
+        << "checkpoint" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+#ifdef _WIN32
+  int fd = _open(filename.c_str(), _O_RDWR | _O_BINARY);
+  bool truncated = fd != -1 && _chsize_s(fd, size) == 0;
+  if (fd != -1)
+    _close(fd);
+#else
+  bool truncated = ::truncate(filename.c_str(), static_cast<off_t>(size)) == 0;
+#endif
+  if (!truncated) {
+    std::stringstream msg;
+    msg << "Can't truncate output file \"" << filename << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+}
+
+/**
+ * Read a chain checkpoint.
+ * Throws an exception if the file cannot be read or is not a
+ * checkpoint file.
+ *
+ * @param filename name of checkpoint file
+ * @return checkpoint
+ */
+inline chain_checkpoint read_checkpoint(const std::string &filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in.good()) {
+    std::stringstream msg;
+    msg << "Can't open checkpoint file \"" << filename << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  std::uint64_t magic = 0;
+  std::uint32_t version = 0;
+  std::uint8_t adapting = 0;
+  chain_checkpoint cp;
+  read_binary(in, magic);
+  read_binary(in, version);
+  if (in && magic == checkpoint_magic && version == checkpoint_version) {
+    read_binary(in, cp.model_name);
+    read_binary(in, cp.chain_id);
+    read_binary(in, cp.num_warmup);
+    read_binary(in, cp.num_samples);
+    read_binary(in, cp.num_thin);
+    read_binary(in, cp.iteration);
+    read_binary(in, cp.warmup_time);
+    read_binary(in, cp.sampling_time);
+    read_binary(in, cp.sample_offset);
+    read_binary(in, cp.diagnostic_offset);
+    read_binary(in, cp.rng_state);
+    read_binary(in, cp.params);
+    read_binary(in, cp.log_prob);
+    read_binary(in, cp.accept_stat);
+    read_binary(in, cp.stepsize);
+    read_binary(in, cp.inv_metric);
+    read_binary(in, adapting);
+    read_binary(in, cp.counter);
+    read_binary(in, cp.s_bar);
+    read_binary(in, cp.x_bar);
+    read_binary(in, cp.mu);
+    read_binary(in, cp.adapt_window_counter);
+    read_binary(in, cp.adapt_window_size);
+    read_binary(in, cp.adapt_next_window);
+    read_binary(in, cp.estimator_num_samples);
+    read_binary(in, cp.estimator_mean);
+    read_binary(in, cp.estimator_m2);
+  }
+  Eigen::Index N = cp.params.size();
+  if (!in || magic != checkpoint_magic || version != checkpoint_version
+      || cp.inv_metric.size() != N || cp.estimator_mean.size() != N
+      || cp.estimator_m2.size() != N) {
+    std::stringstream msg;
+    msg << "File \"" << filename << "\" is not a valid checkpoint file"
+        << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  cp.adapting = adapting != 0;
+  return cp;
+}
+
+/**
+ * Write a chain checkpoint.  The chain's output streams are flushed
+ * and the sizes of its output files are recorded in the checkpoint,
+ * which is written to a temporary name and then renamed, so that an
+ * interrupted write leaves the previous checkpoint in place.
+ * Throws an exception if the checkpoint file cannot be written.
+ *
+ * @param files checkpoint and output files of the chain
+ * @param cp checkpoint, without file sizes
+ */
+inline void write_checkpoint(const checkpoint_files &files,
+                             chain_checkpoint cp) {
+  if (files.sample_stream != nullptr) {
+    files.sample_stream->flush();
+    cp.sample_offset = file_size(files.sample);
+  }
+  if (files.diagnostic_stream != nullptr) {
+    files.diagnostic_stream->flush();
+    cp.diagnostic_offset = file_size(files.diagnostic);
+  }
+  std::string tmp_filename = files.checkpoint + ".tmp";
+  std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+  write_binary(out, checkpoint_magic);
+  write_binary(out, checkpoint_version);
+  write_binary(out, cp.model_name);
+  write_binary(out, cp.chain_id);
+  write_binary(out, cp.num_warmup);
+  write_binary(out, cp.num_samples);
+  write_binary(out, cp.num_thin);
+  write_binary(out, cp.iteration);
+  write_binary(out, cp.warmup_time);
+  write_binary(out, cp.sampling_time);
+  write_binary(out, cp.sample_offset);
+  write_binary(out, cp.diagnostic_offset);
+  write_binary(out, cp.rng_state);
+  write_binary(out, cp.params);
+  write_binary(out, cp.log_prob);
+  write_binary(out, cp.accept_stat);
+  write_binary(out, cp.stepsize);
+  write_binary(out, cp.inv_metric);
+  write_binary(out, static_cast<std::uint8_t>(cp.adapting));
+  write_binary(out, cp.counter);
+  write_binary(out, cp.s_bar);
+  write_binary(out, cp.x_bar);
+  write_binary(out, cp.mu);
+  write_binary(out, cp.adapt_window_counter);
+  write_binary(out, cp.adapt_window_size);
+  write_binary(out, cp.adapt_next_window);
+  write_binary(out, cp.estimator_num_samples);
+  write_binary(out, cp.estimator_mean);
+  write_binary(out, cp.estimator_m2);
+  out.close();
+  if (!out
+      || std::rename(tmp_filename.c_str(), files.checkpoint.c_str()) != 0) {
+    std::remove(tmp_filename.c_str());
+    std::stringstream msg;
+    msg << "Can't write checkpoint file \"" << files.checkpoint << "\""
+        << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+}
+
+/**
+ * Check the checkpoint and early stopping arguments of the sample
+ * method, which are only supported by NUTS with a diagonal metric run
+ * in steps by `run_nuts_chains`, and, if the run resumes from a
+ * checkpoint, read the checkpoint of each chain.  As for
+ * init files, chain i is read from `<base>_<id + i>.bin` when there is
+ * more than one chain.  A checkpoint can only be resumed with the same
+ * model, chain ids, number of warmup iterations and thinning period; the
+ * number of sampling iterations may be increased to extend a run.
+ * Throws an exception if the arguments are inconsistent or a checkpoint
+ * cannot be used.
+ *
+ * @param parser argument parser
+ * @param model model
+ * @param num_chains number of chains
+ * @param id chain id of the first chain
+ * @return checkpoints, empty if the run does not resume
+ */
+inline std::vector<chain_checkpoint> get_checkpoints(
+    argument_parser &parser, const stan::model::model_base &model,
+    unsigned int num_chains, unsigned int id) {
+  std::vector<chain_checkpoint> checkpoints;
+  int checkpoint_every = get_arg_val<int_argument>(parser, "method", "sample",
+                                                   "checkpoint_every");
+  std::string resume
+      = get_arg_val<string_argument>(parser, "method", "sample", "resume");
+  bool early_stop = get_arg_val<bool_argument>(parser, "method", "sample",
+                                               "early_stop", "engaged");
+  int check_every = get_arg_val<int_argument>(parser, "method", "sample",
+                                              "early_stop", "check_every");
+  if (checkpoint_every == 0 && resume.empty() && !early_stop)
+    return checkpoints;
+
+  std::stringstream msg;
+  bool nuts_diag_e
+      = get_arg_val<list_argument>(parser, "method", "sample", "algorithm")
+            == "hmc"
+        && get_arg_val<list_argument>(parser, "method", "sample", "algorithm",
+                                      "hmc", "engine")
+               == "nuts"
+        && get_arg_val<list_argument>(parser, "method", "sample", "algorithm",
+                                      "hmc", "metric")
+               == "diag_e";
+  if (!nuts_diag_e || model.num_params_r() == 0) {
+    msg << "Checkpoints and early stopping are only supported for the "
+        << "NUTS sampler with the diag_e metric." << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  int num_warmup
+      = get_arg_val<int_argument>(parser, "method", "sample", "num_warmup");
+  int num_samples
+      = get_arg_val<int_argument>(parser, "method", "sample", "num_samples");
+  int num_thin = get_arg_val<int_argument>(parser, "method", "sample", "thin");
+  if (checkpoint_every % num_thin != 0
+      || (early_stop && check_every % num_thin != 0)) {
+    msg << "checkpoint_every and check_every must be multiples of thin."
+        << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  if (get_arg_val<bool_argument>(parser, "method", "sample", "adapt",
+                                 "save_metric")) {
+    msg << "Argument 'save_metric' cannot be used with checkpoints or "
+        << "early stopping." << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  if (resume.empty())
+    return checkpoints;
+
+  std::vector<std::string> filenames(1, resume);
+  if (num_chains > 1)
+    filenames = make_filenames(resume, "", ".bin", num_chains, id);
+  for (size_t i = 0; i < num_chains; ++i) {
+    chain_checkpoint cp = read_checkpoint(filenames[i]);
+    int num_sampled = cp.iteration - cp.num_warmup;
+    if (cp.model_name != model.model_name() || cp.chain_id != id + i
+        || cp.params.size() != static_cast<int>(model.num_params_r())
+        || cp.num_warmup != num_warmup || cp.num_thin != num_thin
+        || num_sampled > num_samples
+        || (num_sampled > 0 && num_sampled < num_samples
+            && num_sampled % num_thin != 0)) {
+      msg << "Checkpoint file \"" << filenames[i] << "\" does not match "
+          << "this run; it was written for model " << cp.model_name
+          << ", chain " << cp.chain_id << ", num_warmup=" << cp.num_warmup
+          << ", thin=" << cp.num_thin << ", after " << cp.iteration
+          << " iterations." << std::endl;
+      throw std::invalid_argument(msg.str());
+    }
+    checkpoints.push_back(std::move(cp));
+  }
+  return checkpoints;
+}
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,434 @@
+#ifndef CMDSTAN_SERVE_HPP
+#define CMDSTAN_SERVE_HPP
+
+#include <cmdstan/arguments/arg_num_threads.hpp>
+#include <cmdstan/command.hpp>
+#include <cmdstan/model_cache.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <cmdstan/stop_interrupt.hpp>
+#include <cmdstan/thread_pool.hpp>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <tbb/task_group.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace cmdstan {
+
+/**
+ * A job read by the server: an id, echoed in the response, and the
+ * command line arguments of a run, without the program name.
+ */
+struct serve_job {
+  std::string id;
+  std::vector<std::string> args;
+};
+
+/**
+ * Parse a job request, a JSON object on a single line such as
+ *
+ *   {"id": "fit-1", "args": ["optimize", "data", "file=d.json",
+ *                            "output", "file=fit-1.csv"]}
+ *
+ * The arguments are either an array of strings or a single string
+ * which is split at whitespace.  The id is optional and may be a
+ * string or an integer.  Throws an exception if the request is
+ * malformed.
+ *
+ * @param line request
+ * @return job
+ */
+inline serve_job parse_serve_job(const std::string &line) {
+  rapidjson::Document doc;
+  doc.Parse(line.c_str());
+  if (doc.HasParseError() || !doc.IsObject())
+    throw std::invalid_argument("Job request is not a JSON object");
+  serve_job job;
+  if (doc.HasMember("id")) {
+    const rapidjson::Value &id = doc["id"];
+    if (id.IsString())
+      job.id = id.GetString();
+    else if (id.IsInt64())
+      job.id = std::to_string(id.GetInt64());
+    else
+      throw std::invalid_argument("Job id must be a string or an integer");
+  }
+  if (!doc.HasMember("args"))
+    throw std::invalid_argument("Job request has no \"args\"");
+  const rapidjson::Value &args = doc["args"];
+  if (args.IsString()) {
+    std::istringstream words(args.GetString());
+    std::string word;
+    while (words >> word)
+      job.args.push_back(word);
+  } else if (args.IsArray()) {
+    for (const auto &arg : args.GetArray()) {
+      if (!arg.IsString())
+        throw std::invalid_argument("Job arguments must be strings");
+      job.args.push_back(arg.GetString());
+    }
+  } else {
+    throw std::invalid_argument(
+        "Job \"args\" must be a string or an array of strings");
+  }
+  return job;
+}
+
+/**
+ * Format the response to a job as a JSON object on a single line.
+ *
+ * @param id job id
+ * @param return_code return code of the run
+ * @param elapsed wall time of the run in seconds
+ * @param error message of the exception which ended the run, if any
+ * @return response, without a trailing newline
+ */
+inline std::string serve_response(const std::string &id, int return_code,
+                                  double elapsed, const std::string &error) {
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("id");
+  writer.String(id.c_str());
+  writer.Key("return_code");
+  writer.Int(return_code);
+  writer.Key("elapsed");
+  writer.Double(elapsed);
+  if (!error.empty()) {
+    writer.Key("error");
+    writer.String(error.c_str());
+  }
+  writer.EndObject();
+  return buffer.GetString();
+}
+
+/**
+ * Run CmdStan with the given arguments in this process, as a job of
+ * serve or manifest.  The job runs on the thread pool of the process,
+ * with its number of threads unless the arguments give one, which
+ * must be the same.  Exceptions which end the run are caught and
+ * their message returned.
+ *
+ * @param program program name, passed to the argument parser
+ * @param args arguments, without the program name
+ * @param models model cache, or null to construct the model
+ * @param error set to the message of the exception which ended the run
+ * @return return code, `OK`, `INTERRUPTED` or `NOT_OK`
+ */
+inline int run_job(const std::string &program,
+                   const std::vector<std::string> &args, model_cache *models,
+                   std::string &error) {
+  try {
+    std::string threads_arg
+        = "num_threads=" + std::to_string(thread_pool_size());
+    std::vector<const char *> argv{program.c_str()};
+    if (std::none_of(args.begin(), args.end(), [](const std::string &arg) {
+          return arg.compare(0, 12, "num_threads=") == 0;
+        }))
+      argv.push_back(threads_arg.c_str());
+    for (const auto &arg : args)
+      argv.push_back(arg.c_str());
+    int return_code = command(argv.size(), argv.data(), models, true);
+    if (return_code != return_codes::OK
+        && return_code != return_codes::INTERRUPTED)
+      return_code = return_codes::NOT_OK;
+    return return_code;
+  } catch (const stop_exception &e) {
+    error = e.what();
+    return return_codes::INTERRUPTED;
+  } catch (const std::exception &e) {
+    error = e.what();
+    return return_codes::NOT_OK;
+  }
+}
+
+/**
+ * Run a job request, taking models from the cache.
+ *
+ * @param program program name, passed to the argument parser
+ * @param line request
+ * @param models model cache
+ * @return response
+ */
+inline std::string run_serve_job(const std::string &program,
+                                 const std::string &line,
+                                 model_cache &models) {
+  auto start = std::chrono::steady_clock::now();
+  std::string id;
+  std::string error;
+  int return_code = return_codes::NOT_OK;
+  try {
+    serve_job job = parse_serve_job(line);
+    id = job.id;
+    return_code = run_job(program, job.args, &models, error);
+  } catch (const std::exception &e) {
+    error = e.what();
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return serve_response(id, return_code, elapsed, error);
+}
+
+/**
+ * Read job requests, one per line, until the end of the input or a
+ * stop signal, and run them concurrently on the TBB thread pool.  Each
+ * response is written as a single line when its job finishes, so
+ * responses need not be in the order of the requests.  Returns once
+ * all jobs have finished.
+ *
+ * @param program program name, passed to the argument parser
+ * @param in stream of requests
+ * @param out stream for responses
+ * @param models model cache
+ */
+inline void serve_jobs(const std::string &program, std::istream &in,
+                       std::ostream &out, model_cache &models) {
+  std::mutex out_mutex;
+  tbb::task_group jobs;
+  stop_interrupt stop;
+  std::string line;
+  while (!stop.stop_requested() && std::getline(in, line)) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+    jobs.run([&, line]() {
+      std::string response = run_serve_job(program, line, models);
+      std::lock_guard<std::mutex> lock(out_mutex);
+      out << response << std::endl;
+    });
+  }
+  jobs.wait();
+}
+
+namespace internal {
+/*
+ * Stream buffer which serializes writes to another buffer, or
+ * discards them if there is none.  It has no put area of its own, so
+ * every write goes through the lock.
+ */
+class locked_streambuf : public std::streambuf {
+ public:
+  explicit locked_streambuf(std::streambuf *buf) : buf_(buf) {}
+
+ protected:
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buf_ ? buf_->sputc(traits_type::to_char_type(c)) : c;
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buf_ ? buf_->sputn(s, n) : n;
+  }
+
+  int sync() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buf_ ? buf_->pubsync() : 0;
+  }
+
+ private:
+  std::streambuf *buf_;
+  std::mutex mutex_;
+};
+
+#ifndef _WIN32
+/*
+ * Unbuffered stream buffer reading from and writing to a file
+ * descriptor.
+ */
+class fd_streambuf : public std::streambuf {
+ public:
+  explicit fd_streambuf(int fd) : fd_(fd) { setg(buffer_, buffer_, buffer_); }
+
+ protected:
+  int_type underflow() override {
+    ssize_t n;
+    do {
+      n = ::read(fd_, buffer_, sizeof(buffer_));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+      return traits_type::eof();
+    setg(buffer_, buffer_, buffer_ + n);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+    char ch = traits_type::to_char_type(c);
+    return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    std::streamsize written = 0;
+    while (written < n) {
+      ssize_t k = ::write(fd_, s + written, n - written);
+      if (k < 0 && errno == EINTR)
+        continue;
+      if (k <= 0)
+        break;
+      written += k;
+    }
+    return written;
+  }
+
+ private:
+  int fd_;
+  char buffer_[4096];
+};
+#endif
+}  // namespace internal
+
+/**
+ * Accept connections on a Unix domain socket, one at a time, and serve
+ * the jobs sent on each connection, responding on the same connection.
+ * Returns after a stop signal.  Throws an exception if the socket
+ * cannot be created.
+ *
+ * @param program program name, passed to the argument parser
+ * @param path path of the socket, which must not exist
+ * @param models model cache
+ */
+inline void serve_socket(const std::string &program, const std::string &path,
+                         model_cache &models) {
+#ifdef _WIN32
+  throw std::invalid_argument("serve: sockets are not supported on Windows");
+#else
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    throw std::invalid_argument("serve: socket path \"" + path
+                                + "\" is too long");
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0
+      || ::bind(server, reinterpret_cast<sockaddr *>(&address),
+                sizeof(address))
+             != 0
+      || ::listen(server, 8) != 0) {
+    std::string reason = std::strerror(errno);
+    if (server >= 0)
+      ::close(server);
+    throw std::invalid_argument("serve: can't listen on socket \"" + path
+                                + "\": " + reason);
+  }
+  stop_interrupt stop;
+  while (!stop.stop_requested()) {
+    int connection = ::accept(server, nullptr, nullptr);
+    if (connection < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    internal::fd_streambuf buf(connection);
+    std::iostream stream(&buf);
+    serve_jobs(program, stream, stream, models);
+    ::close(connection);
+  }
+  ::close(server);
+  ::unlink(path.c_str());
+#endif
+}
+
+/**
+ * Entry point of the server, run as
+ *
+ *   <model> serve [socket=<path>] [log=<file>] [num_threads=<n>]
+ *       [cache_size=<n>]
+ *
+ * Jobs are read from the socket if given, otherwise from standard
+ * input, with the responses written to standard output.  Jobs share
+ * a thread pool of `num_threads` threads (default 1, the only valid
+ * value without STAN_THREADS) and a cache of up to `cache_size`
+ * (default 16) constructed models, keyed by data file and seed.  Only
+ * jobs which give `random seed=<n>` use the cache, as the model of a
+ * job without one is constructed with a new seed.  A job runs with
+ * the threads of the server and fails if it gives another
+ * `num_threads`, or if its model has profile blocks, as the profiling
+ * data is shared by the process.  The console output of the jobs goes
+ * to the log file if given, otherwise it is discarded; messages on
+ * standard error are not redirected.
+ *
+ * @param argc number of arguments
+ * @param argv arguments, `argv[1]` being "serve"
+ * @return return code
+ */
+inline int serve(int argc, const char *argv[]) {
+#ifdef STAN_MPI
+  throw std::invalid_argument("serve is not supported with MPI");
+#endif
+  std::string socket_path;
+  std::string log_file;
+  int num_threads = 1;
+  int cache_size = 16;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg(argv[i]);
+    size_t eq = arg.find('=');
+    std::string key = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    if (key == "socket" && !value.empty()) {
+      socket_path = value;
+    } else if (key == "log" && !value.empty()) {
+      log_file = value;
+    } else if (key == "num_threads" && !value.empty()) {
+      num_threads = parse_num_threads(value);
+    } else if (key == "cache_size" && !value.empty()) {
+      size_t end = 0;
+      try {
+        cache_size = std::stoi(value, &end);
+      } catch (const std::logic_error &e) {
+      }
+      if (end == 0 || end != value.size() || cache_size < 1)
+        throw std::invalid_argument("serve: cache_size must be a positive "
+                                    "integer, not \""
+                                    + value + "\"");
+    } else {
+      throw std::invalid_argument("serve: unrecognized argument \"" + arg
+                                  + "\"");
+    }
+  }
+  init_thread_pool(num_threads);
+
+  std::ofstream log;
+  if (!log_file.empty()) {
+    log.open(log_file, std::ios::app);
+    if (!log.good())
+      throw std::invalid_argument("serve: can't open log file \"" + log_file
+                                  + "\"");
+  }
+  internal::locked_streambuf console(log_file.empty() ? nullptr
+                                                      : log.rdbuf());
+  std::ostream responses(std::cout.rdbuf());
+  internal::rdbuf_guard guard{std::cout, std::cout.rdbuf(&console)};
+
+  model_cache models(cache_size);
+  if (!socket_path.empty())
+    serve_socket(argv[0], socket_path, models);
+  else
+    serve_jobs(argv[0], std::cin, responses, models);
+  return internal::stop_signal() == 0 ? return_codes::OK
+                                      : return_codes::INTERRUPTED;
+}
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,106 @@
+#ifndef CMDSTAN_SHARED_MODEL_HPP
+#define CMDSTAN_SHARED_MODEL_HPP
+
+#include <stan/io/var_context.hpp>
+#include <stan/math/rev/core/profiling.hpp>
+#include <stan/model/model_base.hpp>
+#include <stan/version.hpp>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+/*
+ * Interface of a model compiled into a shared library, which the
+ * generic driver bin/cmdstan_driver loads at runtime instead of
+ * linking a model executable.  The library exports the functions
+ * below with C linkage, so that they can be looked up by name.
+ */
+
+namespace cmdstan {
+
+/**
+ * Return the configuration which the model library and the driver
+ * must share: the Stan version and the flags which change the layout
+ * of the autodiff stack or the services.
+ */
+inline std::string shared_model_abi() {
+  std::string abi = "stan " + stan::MAJOR_VERSION + "." + stan::MINOR_VERSION
+                    + "." + stan::PATCH_VERSION;
+#ifdef STAN_THREADS
+  abi += " threads";
+#endif
+#ifdef STAN_MPI
+  abi += " mpi";
+#endif
+#ifdef STAN_OPENCL
+  abi += " opencl";
+#endif
+#ifdef STAN_NO_RANGE_CHECKS
+  abi += " no_range_checks";
+#endif
+  return abi;
+}
+
+using shared_model_abi_fn = const char *(*)();
+using shared_new_model_fn = stan::model::model_base *(*)(
+    stan::io::var_context &, unsigned int, std::ostream *);
+using shared_profile_data_fn = stan::math::profile_map *(*)();
+
+/**
+ * A model library loaded at runtime.  The library is never unloaded,
+ * as the models it constructs may be used until the program exits.
+ */
+class shared_model_library {
+ public:
+  /**
+   * Load the library and check that it was compiled with the same
+   * configuration as this program.  Throws an exception if it can't
+   * be loaded or doesn't match.
+   *
+   * @param path path of the library
+   */
+  explicit shared_model_library(const std::string &path) {
+#ifdef _WIN32
+    throw std::invalid_argument("Can't load model library \"" + path
+                                + "\": not supported on Windows");
+#else
+    void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr)
+      throw std::invalid_argument("Can't load model library \"" + path
+                                  + "\": " + dlerror());
+    auto abi = reinterpret_cast<shared_model_abi_fn>(
+        dlsym(handle, "cmdstan_model_abi"));
+    new_model_ = reinterpret_cast<shared_new_model_fn>(
+        dlsym(handle, "cmdstan_new_model"));
+    profile_data_ = reinterpret_cast<shared_profile_data_fn>(
+        dlsym(handle, "cmdstan_profile_data"));
+    if (abi == nullptr || new_model_ == nullptr || profile_data_ == nullptr)
+      throw std::invalid_argument("\"" + path
+                                  + "\" is not a CmdStan model library");
+    if (abi() != shared_model_abi())
+      throw std::invalid_argument("Model library \"" + path
+                                  + "\" was compiled for " + abi()
+                                  + ", this driver for "
+                                  + shared_model_abi());
+#endif
+  }
+
+  stan::model::model_base &new_model(stan::io::var_context &data_context,
+                                     unsigned int seed,
+                                     std::ostream *msg_stream) const {
+    return *new_model_(data_context, seed, msg_stream);
+  }
+
+  stan::math::profile_map &profile_data() const { return *profile_data_(); }
+
+ private:
+  shared_new_model_fn new_model_ = nullptr;
+  shared_profile_data_fn profile_data_ = nullptr;
+};
+
+}  // namespace cmdstan
+#endif
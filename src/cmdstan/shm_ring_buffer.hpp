@@ -0,0 +1,356 @@
+#ifndef CMDSTAN_SHM_RING_BUFFER_HPP
+#define CMDSTAN_SHM_RING_BUFFER_HPP
+
+#include <stan/callbacks/writer.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace cmdstan {
+
+/**
+ * Layout of a shared-memory ring buffer of draws.  The header is
+ * followed by the column names, each terminated by a null character,
+ * and then, from `data_offset`, by `capacity` rows of `num_cols`
+ * doubles.  Row i of the output is stored in slot `i % capacity`.
+ * The writer stores `magic` last, once the header and names are
+ * complete, and increments `write_index` after each row is stored, so
+ * a reader which sees `write_index == n` can read rows up to n - 1,
+ * provided they have not been overwritten: the writer may be storing
+ * row i + capacity once `write_index >= i + capacity`.  As in a
+ * seqlock, the cells are relaxed atomics, the writer fences before it
+ * stores a row and the reader fences after it loads rows, so a reader
+ * which loaded a cell of a row being overwritten sees the advanced
+ * `write_index` when it loads it again.  Values are in native byte
+ * order.
+ */
+struct shm_ring_header {
+  std::atomic<std::uint64_t> magic;
+  std::uint32_t version;
+  std::uint32_t data_offset;
+  std::uint64_t num_cols;
+  std::uint64_t capacity;
+  std::atomic<std::uint64_t> write_index;
+  std::atomic<std::uint32_t> finished;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free
+                  && std::atomic<std::uint32_t>::is_always_lock_free
+                  && std::atomic<double>::is_always_lock_free,
+              "shared-memory ring buffers need lock-free atomics");
+static_assert(sizeof(std::atomic<double>) == sizeof(double),
+              "shared-memory ring buffers store doubles as atomics");
+
+constexpr std::uint64_t shm_ring_magic = 0x474e495244534d43;  // CMSDRING
+constexpr std::uint32_t shm_ring_version = 1;
+
+namespace internal {
+inline std::string shm_error(const std::string &what,
+                             const std::string &name) {
+#ifdef _WIN32
+  return what + " \"" + name + "\": not supported on Windows";
+#else
+  return what + " \"" + name + "\": " + std::strerror(errno);
+#endif
+}
+}  // namespace internal
+
+/**
+ * Writer which publishes the draws written to it in a shared-memory
+ * ring buffer, so that a process on the same machine can read them
+ * while they are being produced.  The segment is created when the
+ * column names are written, replacing any segment of the same name,
+ * and marked finished when the writer is destroyed.  It is not
+ * removed: the reader removes it with `shm_ring_reader::unlink`.
+ * Messages are not published.
+ */
+class shm_ring_writer : public stan::callbacks::writer {
+ public:
+  /**
+   * @param name name of the shared memory object, starting with '/'
+   * @param capacity number of rows held
+   */
+  shm_ring_writer(const std::string &name, size_t capacity)
+      : name_(name), capacity_(capacity) {}
+
+  shm_ring_writer(const shm_ring_writer &) = delete;
+  shm_ring_writer &operator=(const shm_ring_writer &) = delete;
+
+  ~shm_ring_writer() {
+#ifndef _WIN32
+    if (header_ == nullptr)
+      return;
+    header_->finished.store(1, std::memory_order_release);
+    munmap(header_, size_);
+#endif
+  }
+
+  /**
+   * Create the segment for draws with these columns.  Throws an
+   * exception if it cannot be created.
+   */
+  void operator()(const std::vector<std::string> &names) override {
+#ifdef _WIN32
+    throw std::invalid_argument(
+        internal::shm_error("Can't create shared memory", name_));
+#else
+    if (header_ != nullptr)
+      return;
+    size_t names_size = 0;
+    for (const auto &name : names)
+      names_size += name.size() + 1;
+    size_t data_offset
+        = (sizeof(shm_ring_header) + names_size + 63) / 64 * 64;
+    size_ = data_offset + sizeof(double) * names.size() * capacity_;
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+      throw std::invalid_argument(
+          internal::shm_error("Can't create shared memory", name_));
+    void *address = MAP_FAILED;
+    if (ftruncate(fd, size_) == 0)
+      address
+          = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+      std::string msg
+          = internal::shm_error("Can't map shared memory", name_);
+      shm_unlink(name_.c_str());
+      throw std::invalid_argument(msg);
+    }
+    header_ = static_cast<shm_ring_header *>(address);
+    header_->version = shm_ring_version;
+    header_->data_offset = data_offset;
+    header_->num_cols = names.size();
+    header_->capacity = capacity_;
+    header_->write_index.store(0, std::memory_order_relaxed);
+    header_->finished.store(0, std::memory_order_relaxed);
+    char *names_block = reinterpret_cast<char *>(header_ + 1);
+    for (const auto &name : names) {
+      std::memcpy(names_block, name.c_str(), name.size() + 1);
+      names_block += name.size() + 1;
+    }
+    data_ = reinterpret_cast<std::atomic<double> *>(
+        static_cast<char *>(address) + data_offset);
+    num_cols_ = names.size();
+    header_->magic.store(shm_ring_magic, std::memory_order_release);
+#endif
+  }
+
+  /**
+   * Publish a row of draws.  Rows of other lengths, such as the
+   * adaptation results written as values by some services, are
+   * skipped.
+   */
+  void operator()(const std::vector<double> &values) override {
+    if (header_ == nullptr || values.size() != num_cols_)
+      return;
+    std::uint64_t index
+        = header_->write_index.load(std::memory_order_relaxed);
+    // orders the stores of the row after the store of `write_index`
+    // which announced that its slot may be overwritten
+    std::atomic_thread_fence(std::memory_order_release);
+    std::atomic<double> *cells = data_ + (index % capacity_) * num_cols_;
+    for (size_t n = 0; n < num_cols_; ++n)
+      cells[n].store(values[n], std::memory_order_relaxed);
+    header_->write_index.store(index + 1, std::memory_order_release);
+  }
+
+  using stan::callbacks::writer::operator();
+
+ private:
+  std::string name_;
+  size_t capacity_;
+  size_t size_ = 0;
+  size_t num_cols_ = 0;
+  shm_ring_header *header_ = nullptr;
+  std::atomic<double> *data_ = nullptr;
+};
+
+/**
+ * Reader of a shared-memory ring buffer written by `shm_ring_writer`.
+ * Rows are read in place from the mapped segment; a reader which falls
+ * more than the capacity behind the writer loses the rows which were
+ * overwritten.
+ */
+class shm_ring_reader {
+ public:
+  /**
+   * Map the segment.  Throws an exception if it does not exist or is
+   * not yet complete; callers waiting for a writer retry.
+   *
+   * @param name name of the shared memory object
+   */
+  explicit shm_ring_reader(const std::string &name) : name_(name) {
+#ifdef _WIN32
+    throw std::invalid_argument(
+        internal::shm_error("Can't open shared memory", name_));
+#else
+    int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      throw std::invalid_argument(
+          internal::shm_error("Can't open shared memory", name_));
+    struct stat status;
+    void *address = MAP_FAILED;
+    if (fstat(fd, &status) == 0
+        && static_cast<size_t>(status.st_size) >= sizeof(shm_ring_header)) {
+      size_ = status.st_size;
+      address = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (address == MAP_FAILED)
+      throw std::invalid_argument(
+          internal::shm_error("Can't map shared memory", name_));
+    header_ = static_cast<const shm_ring_header *>(address);
+    if (header_->magic.load(std::memory_order_acquire) != shm_ring_magic
+        || header_->version != shm_ring_version) {
+      munmap(const_cast<shm_ring_header *>(header_), size_);
+      throw std::invalid_argument("Shared memory \"" + name_
+                                  + "\" is not a ring buffer of draws");
+    }
+    const char *names_block = reinterpret_cast<const char *>(header_ + 1);
+    for (std::uint64_t i = 0; i < header_->num_cols; ++i) {
+      names_.emplace_back(names_block);
+      names_block += names_.back().size() + 1;
+    }
+    data_ = reinterpret_cast<const std::atomic<double> *>(
+        static_cast<const char *>(address) + header_->data_offset);
+#endif
+  }
+
+  shm_ring_reader(const shm_ring_reader &) = delete;
+  shm_ring_reader &operator=(const shm_ring_reader &) = delete;
+
+  ~shm_ring_reader() {
+#ifndef _WIN32
+    munmap(const_cast<shm_ring_header *>(header_), size_);
+#endif
+  }
+
+  const std::vector<std::string> &names() const { return names_; }
+
+  size_t num_cols() const { return names_.size(); }
+
+  size_t capacity() const { return header_->capacity; }
+
+  /**
+   * Return the number of rows published so far.
+   */
+  std::uint64_t write_index() const {
+    return header_->write_index.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Return whether the writer has finished; rows published before it
+   * finished are visible once this returns true.
+   */
+  bool finished() const {
+    return header_->finished.load(std::memory_order_acquire) != 0;
+  }
+
+  /**
+   * Return a pointer to the cells of row i in the segment.  The row
+   * must have been published; values loaded from it are valid if
+   * `overwritten(i)` is false after them, so a reader which may have
+   * been overtaken loads the cells with relaxed loads, fences with
+   * `std::atomic_thread_fence(std::memory_order_acquire)` and then
+   * checks `overwritten(i)`.
+   */
+  const std::atomic<double> *row(std::uint64_t i) const {
+    return data_ + (i % header_->capacity) * header_->num_cols;
+  }
+
+  /**
+   * Return whether row i may have been overwritten by the writer, which
+   * may be storing row `write_index()` in the slot of row
+   * `write_index() - capacity`.
+   */
+  bool overwritten(std::uint64_t i) const {
+    return i < first_valid(write_index());
+  }
+
+  /**
+   * Append the rows published since the last call, up to `max_rows`,
+   * to a buffer, skipping the rows which have been overwritten.
+   *
+   * @param rows buffer of rows
+   * @param max_rows maximum number of rows to read
+   * @return number of rows read
+   */
+  size_t read(std::vector<double> &rows,
+              size_t max_rows = std::numeric_limits<size_t>::max()) {
+    std::uint64_t end = write_index();
+    if (first_valid(end) > next_) {
+      lost_ += first_valid(end) - next_;
+      next_ = first_valid(end);
+    }
+    end = std::min<std::uint64_t>(end, next_ + max_rows);
+    size_t num_cols = header_->num_cols;
+    size_t first = rows.size();
+    for (std::uint64_t i = next_; i < end; ++i) {
+      const std::atomic<double> *cells = row(i);
+      for (size_t n = 0; n < num_cols; ++n)
+        rows.push_back(cells[n].load(std::memory_order_relaxed));
+    }
+    // orders the loads of the rows before the load of `write_index`, and
+    // drops the rows the writer may have overwritten while they were copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    std::uint64_t valid_from = first_valid(write_index());
+    if (valid_from > next_) {
+      std::uint64_t dropped = std::min(valid_from, end) - next_;
+      rows.erase(rows.begin() + first,
+                 rows.begin() + first + dropped * num_cols);
+      lost_ += dropped;
+    }
+    size_t num_read = (rows.size() - first) / num_cols;
+    next_ = end;
+    return num_read;
+  }
+
+  /**
+   * Return the number of rows lost because they were overwritten
+   * before they were read.
+   */
+  std::uint64_t lost() const { return lost_; }
+
+  /**
+   * Remove the shared memory object; mapped segments stay valid.
+   */
+  static void unlink(const std::string &name) {
+#ifndef _WIN32
+    shm_unlink(name.c_str());
+#endif
+  }
+
+ private:
+  std::string name_;
+  size_t size_ = 0;
+  const shm_ring_header *header_ = nullptr;
+  const std::atomic<double> *data_ = nullptr;
+  std::vector<std::string> names_;
+  std::uint64_t next_ = 0;
+  std::uint64_t lost_ = 0;
+
+  std::uint64_t first_valid(std::uint64_t write_index) const {
+    return write_index < header_->capacity
+               ? 0
+               : write_index - header_->capacity + 1;
+  }
+};
+
+}  // namespace cmdstan
+#endif
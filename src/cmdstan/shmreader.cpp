@@ -0,0 +1,90 @@
+#include <cmdstan/shm_ring_buffer.hpp>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+void shmreader_usage() {
+  std::cout << "USAGE:  shmreader [--unlink] <name>" << std::endl
+            << std::endl
+            << "Print the draws published by a sampler run with "
+               "\"output shm=<name>\" as CSV,"
+            << std::endl
+            << "as they are sampled, until the run finishes.  "
+               "With --unlink the shared"
+            << std::endl
+            << "memory is removed once all draws have been read." << std::endl
+            << std::endl;
+}
+
+/**
+ * Reference reader of the shared-memory ring buffer of a chain: waits
+ * up to a minute for the sampler to create it, then copies out and
+ * prints the draws as they are published.
+ */
+int main(int argc, const char *argv[]) {
+  bool unlink = false;
+  std::string name;
+  bool usage = false;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--unlink") == 0)
+      unlink = true;
+    else if (name.empty())
+      name = argv[i];
+    else
+      usage = true;
+  }
+  if (usage || name.empty()) {
+    shmreader_usage();
+    return -1;
+  }
+  if (name[0] != '/')
+    name = "/" + name;
+
+  std::unique_ptr<cmdstan::shm_ring_reader> reader;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::minutes(1);
+  while (!reader) {
+    try {
+      reader = std::make_unique<cmdstan::shm_ring_reader>(name);
+    } catch (const std::invalid_argument &e) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  const auto &names = reader->names();
+  for (size_t i = 0; i < names.size(); ++i)
+    std::cout << (i > 0 ? "," : "") << names[i];
+  std::cout << std::endl;
+  std::cout << std::setprecision(std::numeric_limits<double>::max_digits10);
+  std::vector<double> rows;
+  while (true) {
+    // rows published before the writer finished are all visible after
+    bool finished = reader->finished();
+    rows.clear();
+    if (reader->read(rows) > 0) {
+      for (size_t i = 0; i < rows.size(); ++i)
+        std::cout << rows[i] << ((i + 1) % names.size() == 0 ? "\n" : ",");
+      std::cout.flush();
+    } else if (finished) {
+      break;
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  if (reader->lost() > 0)
+    std::cerr << "Lost " << reader->lost()
+              << " draws overwritten before they were read" << std::endl;
+  if (unlink)
+    cmdstan::shm_ring_reader::unlink(name);
+  return 0;
+}
@@ -1,12 +1,15 @@
 #include <cmdstan/return_codes.hpp>
+#include <cmdstan/stansummary_autocorr.hpp>
+#include <cmdstan/stansummary_cache.hpp>
 #include <cmdstan/stansummary_helper.hpp>
-#include <stan/mcmc/chains.hpp>
+#include <cmdstan/summary_draws.hpp>
 #include <stan/io/ends_with.hpp>
 #include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <ios>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <boost/algorithm/string.hpp>
 #include <CLI11/CLI11.hpp>
@@ -31,17 +34,31 @@ Example:  stansummary model_chain_1.csv model_chain_2.csv
 Options:
   -a, --autocorr [n]          Display the chain autocorrelation for the n-th
                               input file, in addition to statistics.
+      --autocorr_file [file]  Write the autocorrelations of all parameters in
+                              all chains, and the effective sample sizes
+                              computed from them, to a csv file, or to a
+                              binary file if the filename ends in ".bin".
   -c, --csv_filename [file]   Write statistics to a csv file.
+      --cache_file [file]     Save statistics for all parameters to a binary
+                              cache file, or reuse them if the file was created
+                              from the same, unmodified input files with the
+                              same percentiles.
   -h, --help                  Produce help message, then exit.
+      --max_lag [n]           Maximum lag for --autocorr_file. Default is 100.
   -p, --percentiles [values]  Percentiles to report as ordered set of
                               comma-separated numbers from (0.1,99.9), inclusive.
                               Default is 5,50,95.
+      --single_precision      Store the draws in single precision to halve
+                              memory use. Statistics are still accumulated in
+                              double precision.
   -s, --sig_figs [n]          Significant figures reported. Default is 2.
                               Must be an integer from (1, 18), inclusive.
   -i, --include_param [name]  Include the named parameter in the summary output.
                               By default, all parameters in the file are summarized,
                               passing this argument one or more times will filter
                               the output down to just the requested arguments.
+                              Naming a container variable includes all of its
+                              elements.
 )";
   if (argc < 2) {
     std::cout << usage << std::endl;
@@ -51,7 +68,11 @@ Options:
   // Command-line arguments
   int sig_figs = 2;
   int autocorr_idx;
+  std::string autocorr_filename;
+  int max_lag = 100;
   std::string csv_filename;
+  std::string cache_filename;
+  bool single_precision = false;
   std::string percentiles_spec = "5,50,95";
   std::vector<std::string> filenames;
   std::vector<std::string> requested_params_vec;
@@ -63,9 +84,17 @@ Options:
   app.add_option("--autocorr,-a", autocorr_idx,
                  "Display the chain autocorrelation.", true)
       ->check(CLI::PositiveNumber);
+  app.add_option("--autocorr_file", autocorr_filename,
+                 "Write autocorrelations for all chains to a file.", true);
+  app.add_option("--max_lag", max_lag, "Maximum lag, default 100.", true)
+      ->check(CLI::NonNegativeNumber);
   app.add_option("--csv_filename,-c", csv_filename,
                  "Write statistics to a csv.", true)
       ->check(CLI::NonexistentPath);
+  app.add_option("--cache_file", cache_filename,
+                 "Read or write cached statistics.", true);
+  app.add_flag("--single_precision", single_precision,
+               "Store draws in single precision.");
   app.add_option("--percentiles,-p", percentiles_spec, "Percentiles to report.",
                  true);
   app.add_option("--include_param,-i", requested_params_vec,
@@ -132,24 +161,47 @@ Options:
   }
 
   try {
-    // Parse csv files into sample, metadata
-    stan::io::stan_csv_metadata metadata;
-    Eigen::VectorXd warmup_times(filenames.size());
-    Eigen::VectorXd sampling_times(filenames.size());
-    Eigen::VectorXi thin(filenames.size());
+    std::vector<std::string> header = get_header(percentiles);
+    bool use_cache = app.count("--cache_file");
 
-    // check for stan csv file parse errors written to output stream
-    std::stringstream cout_ss;
-    stan::mcmc::chains<> chains = parse_csv_files(
-        filenames, metadata, warmup_times, sampling_times, thin, &std::cout);
+    // Reuse cached statistics, or parse csv files into sample, metadata
+    chains_summary summary;
+    std::unique_ptr<cmdstan::summary_draws<>> chains;
+    bool from_cache = use_cache
+                      && cmdstan::read_summary_cache(cache_filename, filenames,
+                                                     percentiles,
+                                                     single_precision, summary);
+    if (!from_cache) {
+      summary.warmup_times.resize(filenames.size());
+      summary.sampling_times.resize(filenames.size());
+      summary.thin.resize(filenames.size());
+      if (single_precision) {
+        // draws stored as float, statistics for all params computed here
+        auto draws = parse_csv_files<cmdstan::summary_draws<float>>(
+            filenames, summary.metadata, summary.warmup_times,
+            summary.sampling_times, summary.thin, &std::cout);
+        init_summary(draws, header.size(), summary);
+        std::vector<int> all_idxes(draws.num_params());
+        std::iota(all_idxes.begin(), all_idxes.end(), 0);
+        get_stats(draws, probs, all_idxes, summary);
+      } else {
+        chains = std::make_unique<cmdstan::summary_draws<>>(
+            parse_csv_files<cmdstan::summary_draws<>>(
+                filenames, summary.metadata, summary.warmup_times,
+                summary.sampling_times, summary.thin, &std::cout));
+        init_summary(*chains, header.size(), summary);
+      }
+    }
+    const std::vector<std::string> &param_names = summary.param_names;
+    header_index param_index = make_header_index(param_names);
 
     // Get column headers for sampler, model params
     size_t max_name_length = 0;
     size_t num_sampler_params = -1;  // don't count name 'lp__'
-    for (int i = 0; i < chains.num_params(); ++i) {
-      if (chains.param_name(i).length() > max_name_length)
-        max_name_length = chains.param_name(i).length();
-      if (stan::io::ends_with("__", chains.param_name(i)))
+    for (size_t i = 0; i < param_names.size(); ++i) {
+      if (param_names[i].length() > max_name_length)
+        max_name_length = param_names[i].length();
+      if (stan::io::ends_with("__", param_names[i]))
         num_sampler_params++;
     }
 
@@ -167,12 +219,11 @@ Options:
       std::set<std::string> requested_params(requested_params_vec.begin(),
                                              requested_params_vec.end());
 
-      for (int i = model_params_offset; i < chains.num_params(); ++i) {
-        if (requested_params.erase(chains.param_name(i)) > 0) {
+      for (size_t i = model_params_offset; i < param_names.size(); ++i) {
+        if (requested_params.erase(param_names[i]) > 0)
           model_param_idxes.emplace_back(i);
-          num_model_params++;
-        }
       }
+      num_model_params = model_param_idxes.size();
       // some params were requested but not found by above loop
       if (requested_params.size() > 0) {
         std::cout << "--include_param: Unrecognized parameter(s): ";
@@ -185,23 +236,38 @@ Options:
 
     } else {
       // if none were requested, get all of the model parameters
-      num_model_params = chains.num_params() - num_sampler_params - 1;
+      num_model_params = param_names.size() - num_sampler_params - 1;
       model_param_idxes.resize(num_model_params);
       std::iota(model_param_idxes.begin(), model_param_idxes.end(),
                 model_params_offset);
     }
 
-    std::vector<std::string> header = get_header(percentiles);
-
-    // Compute statistics for sampler and model params
-    Eigen::MatrixXd lp_param(1, header.size());
-    Eigen::MatrixXd sampler_params(num_sampler_params, header.size());
-    Eigen::MatrixXd model_params(num_model_params, header.size());
-
-    get_stats(chains, sampling_times, probs, {0}, lp_param);
-    get_stats(chains, sampling_times, probs, sampler_params_idxes,
-              sampler_params);
-    get_stats(chains, sampling_times, probs, model_param_idxes, model_params);
+    // Compute statistics for sampler and model params,
+    // or for all params when they are saved to the cache
+    if (chains) {
+      if (use_cache) {
+        std::vector<int> all_idxes(param_names.size());
+        std::iota(all_idxes.begin(), all_idxes.end(), 0);
+        get_stats(*chains, probs, all_idxes, summary);
+      } else {
+        get_stats(*chains, probs, {0}, summary);
+        get_stats(*chains, probs, sampler_params_idxes, summary);
+        get_stats(*chains, probs, model_param_idxes, summary);
+      }
+    }
+    if (use_cache && !from_cache) {
+      try {
+        cmdstan::write_summary_cache(cache_filename, filenames, percentiles,
+                                     single_precision, summary);
+      } catch (const std::invalid_argument &e) {
+        std::cout << "Warning: " << e.what();
+      }
+    }
+    Eigen::MatrixXd lp_param = select_rows(summary.stats, {0});
+    Eigen::MatrixXd sampler_params
+        = select_rows(summary.stats, sampler_params_idxes);
+    Eigen::MatrixXd model_params
+        = select_rows(summary.stats, model_param_idxes);
 
     // Console output formatting
     Eigen::VectorXi column_sig_figs(header.size());
@@ -223,58 +289,81 @@ Options:
                                                              : model_widths[i];
 
     // Print to console
-    write_timing(chains, metadata, warmup_times, sampling_times, thin, "",
-                 &std::cout);
+    write_timing(summary.num_kept_samples, summary.num_warmup, summary.metadata,
+                 summary.warmup_times, summary.sampling_times, summary.thin,
+                 "", &std::cout);
     std::cout << std::endl;
 
     write_header(header, column_widths, max_name_length, false, &std::cout);
     std::cout << std::endl;
-    write_params(chains, lp_param, column_widths, model_formats,
+    write_params(param_names, lp_param, column_widths, model_formats,
                  max_name_length, sig_figs, {0}, false, &std::cout);
-    write_params(chains, sampler_params, column_widths, sampler_formats,
+    write_params(param_names, sampler_params, column_widths, sampler_formats,
                  max_name_length, sig_figs, sampler_params_idxes, false,
                  &std::cout);
     std::cout << std::endl;
     if (model_params_subset)
-      write_params(chains, model_params, column_widths, model_formats,
+      write_params(param_names, model_params, column_widths, model_formats,
                    max_name_length, sig_figs, model_param_idxes, false,
                    &std::cout);
     else
-      write_all_model_params(chains, model_params, column_widths, model_formats,
-                             max_name_length, sig_figs, model_params_offset,
-                             false, &std::cout);
+      write_all_model_params(param_names, param_index, model_params,
+                             column_widths, model_formats, max_name_length,
+                             sig_figs, model_params_offset, false, &std::cout);
     std::cout << std::endl;
-    write_sampler_info(metadata, "", &std::cout);
+    write_sampler_info(summary.metadata, "", &std::cout);
 
     if (app.count("--autocorr")) {
-      autocorrelation(chains, metadata, autocorr_idx, max_name_length);
+      if (!chains)
+        chains = std::make_unique<cmdstan::summary_draws<>>(
+            parse_csv_files<cmdstan::summary_draws<>>(
+                filenames, summary.metadata, summary.warmup_times,
+                summary.sampling_times, summary.thin, &std::cout));
+      autocorrelation(*chains, summary.metadata, autocorr_idx,
+                      max_name_length);
       std::cout << std::endl;
     }
 
+    // Write autocorrelations for all chains (optional)
+    if (app.count("--autocorr_file")) {
+      if (!chains)
+        chains = std::make_unique<cmdstan::summary_draws<>>(
+            parse_csv_files<cmdstan::summary_draws<>>(
+                filenames, summary.metadata, summary.warmup_times,
+                summary.sampling_times, summary.thin, &std::cout));
+      std::vector<Eigen::MatrixXd> acfs
+          = cmdstan::compute_autocorrelations(*chains, max_lag);
+      cmdstan::write_autocorrelations(
+          autocorr_filename, param_names, acfs,
+          cmdstan::compute_autocorrelation_ess(*chains, acfs),
+          app.count("--sig_figs") ? sig_figs : 6);
+    }
+
     // Write to csv file (optional)
     if (app.count("--csv_filename")) {
       std::ofstream csv_file(csv_filename.c_str(), std::ios_base::app);
       csv_file << std::setprecision(app.count("--sig_figs") ? sig_figs : 6);
 
       write_header(header, column_widths, max_name_length, true, &csv_file);
-      write_params(chains, lp_param, column_widths, model_formats,
+      write_params(param_names, lp_param, column_widths, model_formats,
                    max_name_length, sig_figs, {0}, true, &csv_file);
-      write_params(chains, sampler_params, column_widths, sampler_formats,
+      write_params(param_names, sampler_params, column_widths, sampler_formats,
                    max_name_length, sig_figs, sampler_params_idxes, true,
                    &csv_file);
 
       if (model_params_subset)
-        write_params(chains, model_params, column_widths, model_formats,
+        write_params(param_names, model_params, column_widths, model_formats,
                      max_name_length, sig_figs, model_param_idxes, true,
                      &csv_file);
       else
-        write_all_model_params(chains, model_params, column_widths,
-                               model_formats, max_name_length, sig_figs,
-                               model_params_offset, true, &csv_file);
+        write_all_model_params(param_names, param_index, model_params,
+                               column_widths, model_formats, max_name_length,
+                               sig_figs, model_params_offset, true, &csv_file);
 
-      write_timing(chains, metadata, warmup_times, sampling_times, thin, "# ",
-                   &csv_file);
-      write_sampler_info(metadata, "# ", &csv_file);
+      write_timing(summary.num_kept_samples, summary.num_warmup,
+                   summary.metadata, summary.warmup_times,
+                   summary.sampling_times, summary.thin, "# ", &csv_file);
+      write_sampler_info(summary.metadata, "# ", &csv_file);
       csv_file.close();
     }
   } catch (const std::invalid_argument &e) {
@@ -0,0 +1,295 @@
+#ifndef CMDSTAN_STANSUMMARY_AUTOCORR_HPP
+#define CMDSTAN_STANSUMMARY_AUTOCORR_HPP
+
+#include <cmdstan/binary_io.hpp>
+#include <stan/math/prim.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <unsupported/Eigen/FFT>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+constexpr std::uint64_t autocorr_file_magic = 0x4353414353524f43ULL;
+constexpr std::uint32_t autocorr_file_version = 2;
+
+/**
+ * Compute the autocorrelations of all parameters in all chains,
+ * truncated at a maximum lag.  Parameters are processed in parallel;
+ * each task reuses one FFT object, and with it the FFT plans,
+ * for all of the columns in its range.  As in `stan::math::autocorrelation`
+ * the centered draws are zero-padded to twice the next good FFT size.
+ *
+ * @tparam Chains type of container for the draws
+ * @param in set of samples from one or more chains
+ * @param in maximum lag, non-negative
+ * @return for each chain, matrix of autocorrelations with one row
+ *   per parameter and one column per lag, from 0 to the smaller of
+ *   max_lag and the number of kept draws less one
+ */
+template <typename Chains>
+std::vector<Eigen::MatrixXd> compute_autocorrelations(const Chains &chains,
+                                                      int max_lag) {
+  if (max_lag < 0)
+    throw std::invalid_argument("max_lag must be non-negative");
+  int num_chains = chains.num_chains();
+  int num_params = chains.num_params();
+  std::vector<Eigen::MatrixXd> acfs(num_chains);
+  for (int chain = 0; chain < num_chains; ++chain) {
+    int num_lags = std::min(max_lag + 1, chains.num_kept_samples(chain));
+    acfs[chain] = Eigen::MatrixXd::Zero(num_params, std::max(num_lags, 0));
+  }
+
+  tbb::parallel_for(
+      tbb::blocked_range<int>(0, num_chains * num_params),
+      [&](const tbb::blocked_range<int> &r) {
+        Eigen::FFT<double> fft;
+        fft.SetFlag(fft.HalfSpectrum);
+        Eigen::VectorXd padded;
+        Eigen::VectorXcd freq;
+        Eigen::VectorXd acov;
+        for (int k = r.begin(); k < r.end(); ++k) {
+          int chain = k / num_params;
+          int i = k % num_params;
+          Eigen::MatrixXd &acf = acfs[chain];
+          if (acf.cols() == 0)
+            continue;
+          Eigen::VectorXd y = chains.samples(chain, i);
+          size_t n = y.size();
+          size_t m = 2 * stan::math::internal::fft_next_good_size(n);
+          padded.setZero(m);
+          padded.head(n) = y.array() - y.mean();
+          fft.fwd(freq, padded);
+          freq = freq.cwiseAbs2().cast<std::complex<double>>();
+          fft.inv(acov, freq, m);
+          acf.row(i) = acov.head(acf.cols()).transpose() / acov(0);
+        }
+      });
+  return acfs;
+}
+
+/**
+ * Compute the effective sample size of a chain from its autocorrelations
+ * using Geyer's initial monotone sequence, as in
+ * `stan::analyze::compute_effective_sample_size`, but with the
+ * autocorrelations of the chain alone.  The sum of autocorrelations is
+ * truncated at the first pair of lags with a negative sum or at the
+ * largest lag available, whichever comes first.
+ *
+ * @param in autocorrelations from lag 0
+ * @param in number of draws of the chain
+ * @return effective sample size and the lag of truncation, both NaN if
+ *   there are fewer than 4 draws or 3 lags or the draws are constant
+ */
+inline Eigen::Vector2d autocorrelation_ess(const Eigen::RowVectorXd &acf,
+                                           int num_draws) {
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  int num_lags = acf.size();
+  if (num_draws < 4 || num_lags < 3 || !std::isfinite(acf(1)))
+    return Eigen::Vector2d(nan, nan);
+  Eigen::VectorXd rho = Eigen::VectorXd::Zero(num_lags);
+  rho(0) = 1;
+  rho(1) = acf(1);
+  double rho_even = 1;
+  double rho_odd = acf(1);
+  int s = 1;
+  while (s + 2 < num_lags && s < num_draws - 4 && rho_even + rho_odd > 0) {
+    rho_even = acf(s + 1);
+    rho_odd = acf(s + 2);
+    if (rho_even + rho_odd >= 0) {
+      rho(s + 1) = rho_even;
+      rho(s + 2) = rho_odd;
+    }
+    s += 2;
+  }
+  int max_s = s;
+  for (s = 1; s <= max_s - 3; s += 2) {
+    if (rho(s + 1) + rho(s + 2) > rho(s - 1) + rho(s)) {
+      rho(s + 1) = (rho(s - 1) + rho(s)) / 2;
+      rho(s + 2) = rho(s + 1);
+    }
+  }
+  double tau = -1 + 2 * rho.head(max_s).sum() + std::max(rho_even, 0.0);
+  double ess = std::min(num_draws / tau, num_draws * std::log10(num_draws));
+  return Eigen::Vector2d(ess, static_cast<double>(max_s));
+}
+
+/**
+ * Compute the effective sample sizes of all parameters in all chains
+ * from their autocorrelations.
+ *
+ * @tparam Chains type of container for the draws
+ * @param in set of samples from one or more chains
+ * @param in autocorrelations for each chain, as computed by
+ *   `compute_autocorrelations`
+ * @return for each chain, matrix with one row per parameter and two
+ *   columns, the effective sample size and the lag of truncation, as
+ *   computed by `autocorrelation_ess`
+ */
+template <typename Chains>
+std::vector<Eigen::MatrixXd> compute_autocorrelation_ess(
+    const Chains &chains, const std::vector<Eigen::MatrixXd> &acfs) {
+  std::vector<Eigen::MatrixXd> ess(acfs.size());
+  for (size_t chain = 0; chain < acfs.size(); ++chain) {
+    ess[chain].resize(acfs[chain].rows(), 2);
+    int num_draws = chains.num_kept_samples(chain);
+    for (int i = 0; i < acfs[chain].rows(); ++i)
+      ess[chain].row(i)
+          = autocorrelation_ess(acfs[chain].row(i), num_draws).transpose();
+  }
+  return ess;
+}
+
+/**
+ * Write autocorrelations to a csv file with one row per chain and lag
+ * and one column per parameter.  The rows of each chain are followed by
+ * a row "ess" of effective sample sizes and a row "ess_lag" of the lags
+ * at which their sums of autocorrelations are truncated.
+ *
+ * @param in parameter names
+ * @param in autocorrelations for each chain, as computed by
+ *   `compute_autocorrelations`
+ * @param in effective sample sizes for each chain, as computed by
+ *   `compute_autocorrelation_ess`
+ * @param in significant digits
+ * @param out output stream
+ */
+inline void write_autocorrelations_csv(
+    const std::vector<std::string> &names,
+    const std::vector<Eigen::MatrixXd> &acfs,
+    const std::vector<Eigen::MatrixXd> &ess, int sig_figs,
+    std::ostream *out) {
+  *out << "chain,lag";
+  for (const auto &name : names)
+    *out << ",\"" << name << "\"";
+  *out << std::endl;
+  *out << std::setprecision(sig_figs);
+  for (size_t chain = 0; chain < acfs.size(); ++chain) {
+    for (int lag = 0; lag < acfs[chain].cols(); ++lag) {
+      *out << chain + 1 << "," << lag;
+      for (int i = 0; i < acfs[chain].rows(); ++i)
+        *out << "," << acfs[chain](i, lag);
+      *out << "\n";
+    }
+    for (int j = 0; j < 2; ++j) {
+      *out << chain + 1 << "," << (j == 0 ? "ess" : "ess_lag");
+      for (int i = 0; i < ess[chain].rows(); ++i)
+        *out << "," << ess[chain](i, j);
+      *out << "\n";
+    }
+  }
+  out->flush();
+}
+
+/**
+ * Write autocorrelations in binary format: a magic number and version,
+ * the parameter names, the number of chains, and for each chain
+ * the matrix of autocorrelations (parameters x lags, column-major)
+ * followed by the matrix of effective sample sizes and lags of
+ * truncation (parameters x 2).
+ *
+ * @param in parameter names
+ * @param in autocorrelations for each chain
+ * @param in effective sample sizes for each chain
+ * @param out binary output stream
+ */
+inline void write_autocorrelations_binary(
+    const std::vector<std::string> &names,
+    const std::vector<Eigen::MatrixXd> &acfs,
+    const std::vector<Eigen::MatrixXd> &ess, std::ostream &out) {
+  write_binary(out, autocorr_file_magic);
+  write_binary(out, autocorr_file_version);
+  write_binary(out, names);
+  write_binary(out, static_cast<std::uint64_t>(acfs.size()));
+  for (size_t chain = 0; chain < acfs.size(); ++chain) {
+    write_binary(out, acfs[chain]);
+    write_binary(out, ess[chain]);
+  }
+}
+
+/**
+ * Read autocorrelations written by `write_autocorrelations_binary`.
+ * Throws an exception if the file is not a valid autocorrelation file.
+ *
+ * @param in binary input stream
+ * @param out parameter names
+ * @param out autocorrelations for each chain
+ * @param out effective sample sizes for each chain
+ */
+inline void read_autocorrelations_binary(std::istream &in,
+                                         std::vector<std::string> &names,
+                                         std::vector<Eigen::MatrixXd> &acfs,
+                                         std::vector<Eigen::MatrixXd> &ess) {
+  std::uint64_t magic = 0;
+  std::uint32_t version = 0;
+  std::uint64_t num_chains = 0;
+  read_binary(in, magic);
+  read_binary(in, version);
+  read_binary(in, names);
+  read_binary(in, num_chains);
+  if (!in || magic != autocorr_file_magic || version != autocorr_file_version
+      || num_chains > (std::uint64_t{1} << 20))
+    throw std::invalid_argument("Invalid autocorrelation file");
+  acfs.resize(num_chains);
+  ess.resize(num_chains);
+  for (size_t chain = 0; chain < num_chains; ++chain) {
+    read_binary(in, acfs[chain]);
+    read_binary(in, ess[chain]);
+    if (!in
+        || acfs[chain].rows() != static_cast<Eigen::Index>(names.size())
+        || ess[chain].rows() != acfs[chain].rows() || ess[chain].cols() != 2)
+      throw std::invalid_argument("Invalid autocorrelation file");
+  }
+}
+
+/**
+ * Write autocorrelations to a file, in binary format if the filename
+ * ends in ".bin" and as csv otherwise.
+ * Throws an exception if the file cannot be written.
+ *
+ * @param in name of output file
+ * @param in parameter names
+ * @param in autocorrelations for each chain
+ * @param in effective sample sizes for each chain
+ * @param in significant digits for csv output
+ */
+inline void write_autocorrelations(const std::string &filename,
+                                   const std::vector<std::string> &names,
+                                   const std::vector<Eigen::MatrixXd> &acfs,
+                                   const std::vector<Eigen::MatrixXd> &ess,
+                                   int sig_figs) {
+  bool binary = filename.size() >= 4
+                && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+  std::ofstream out(filename, binary ? std::ios::binary : std::ios::out);
+  if (!out.good()) {
+    std::stringstream msg;
+    msg << "Can't write autocorrelation file, \"" << filename << "\""
+        << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  if (binary)
+    write_autocorrelations_binary(names, acfs, ess, out);
+  else
+    write_autocorrelations_csv(names, acfs, ess, sig_figs, &out);
+  out.close();
+  if (!out) {
+    std::stringstream msg;
+    msg << "Can't write autocorrelation file, \"" << filename << "\""
+        << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+}
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,150 @@
+#ifndef CMDSTAN_STANSUMMARY_CACHE_HPP
+#define CMDSTAN_STANSUMMARY_CACHE_HPP
+
+#include <cmdstan/binary_io.hpp>
+#include <cmdstan/file_fingerprint.hpp>
+#include <cmdstan/stansummary_helper.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+constexpr std::uint64_t summary_cache_magic = 0x4353554d43414348ULL;
+constexpr std::uint32_t summary_cache_version = 2;
+
+/**
+ * Write the summary of a set of Stan csv files to a binary cache file,
+ * keyed by the fingerprints of the input files, the requested
+ * percentiles, and the precision of the draws the statistics were
+ * computed from.  The file is written to a temporary name and then
+ * renamed so that a concurrent reader never sees a partial cache.
+ * Throws an exception if the cache file cannot be written.
+ *
+ * @param in name of cache file
+ * @param in vector of filenames of stan csv files
+ * @param in vector of percentile values as strings
+ * @param in whether the draws were stored in single precision
+ * @param in summary, statistics computed for all columns
+ */
+inline void write_summary_cache(const std::string &cache_filename,
+                                const std::vector<std::string> &filenames,
+                                const std::vector<std::string> &percentiles,
+                                bool single_precision,
+                                const chains_summary &summary) {
+  std::string tmp_filename = cache_filename + ".tmp";
+  std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+  if (!out.good()) {
+    std::stringstream msg;
+    msg << "Can't write cache file, \"" << cache_filename << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  write_binary(out, summary_cache_magic);
+  write_binary(out, summary_cache_version);
+  write_binary(out, filenames);
+  for (const auto &fname : filenames)
+    write_binary(out, get_file_fingerprint(fname));
+  write_binary(out, percentiles);
+  write_binary(out, single_precision);
+  write_binary(out, summary.metadata.model);
+  write_binary(out, summary.metadata.algorithm);
+  write_binary(out, summary.metadata.engine);
+  write_binary(out, summary.param_names);
+  write_binary(out, summary.num_kept_samples);
+  write_binary(out, summary.num_warmup);
+  write_binary(out, summary.warmup_times);
+  write_binary(out, summary.sampling_times);
+  write_binary(out, summary.thin);
+  write_binary(out, summary.stats);
+  out.close();
+  if (!out || std::rename(tmp_filename.c_str(), cache_filename.c_str()) != 0) {
+    std::remove(tmp_filename.c_str());
+    std::stringstream msg;
+    msg << "Can't write cache file, \"" << cache_filename << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+}
+
+/**
+ * Read the summary of a set of Stan csv files from a binary cache file.
+ * The cache is only used if it was computed from the same input files,
+ * with unchanged size, modification time and contents,
+ * and for the same percentiles and precision of the draws.
+ *
+ * @param in name of cache file
+ * @param in vector of filenames of stan csv files
+ * @param in vector of percentile values as strings
+ * @param in whether the draws are stored in single precision
+ * @param out summary, statistics for all columns
+ * @return true if the cache is valid, false otherwise
+ */
+inline bool read_summary_cache(const std::string &cache_filename,
+                               const std::vector<std::string> &filenames,
+                               const std::vector<std::string> &percentiles,
+                               bool single_precision,
+                               chains_summary &summary) {
+  std::ifstream in(cache_filename, std::ios::binary);
+  if (!in.good())
+    return false;
+  try {
+    std::uint64_t magic = 0;
+    std::uint32_t version = 0;
+    read_binary(in, magic);
+    read_binary(in, version);
+    if (!in || magic != summary_cache_magic
+        || version != summary_cache_version)
+      return false;
+    std::vector<std::string> cached_filenames;
+    read_binary(in, cached_filenames);
+    if (!in || cached_filenames != filenames)
+      return false;
+    for (const auto &fname : filenames) {
+      file_fingerprint cached;
+      read_binary(in, cached);
+      if (!in || cached != get_file_fingerprint(fname))
+        return false;
+    }
+    std::vector<std::string> cached_percentiles;
+    read_binary(in, cached_percentiles);
+    bool cached_single_precision = false;
+    read_binary(in, cached_single_precision);
+    if (!in || cached_percentiles != percentiles
+        || cached_single_precision != single_precision)
+      return false;
+    chains_summary cached;
+    read_binary(in, cached.metadata.model);
+    read_binary(in, cached.metadata.algorithm);
+    read_binary(in, cached.metadata.engine);
+    read_binary(in, cached.param_names);
+    read_binary(in, cached.num_kept_samples);
+    read_binary(in, cached.num_warmup);
+    read_binary(in, cached.warmup_times);
+    read_binary(in, cached.sampling_times);
+    read_binary(in, cached.thin);
+    read_binary(in, cached.stats);
+    Eigen::Index num_chains = filenames.size();
+    if (!in
+        || cached.stats.rows()
+               != static_cast<Eigen::Index>(cached.param_names.size())
+        || cached.stats.cols()
+               != static_cast<Eigen::Index>(percentiles.size() + 6)
+        || cached.num_kept_samples.size() != num_chains
+        || cached.num_warmup.size() != num_chains
+        || cached.warmup_times.size() != num_chains
+        || cached.sampling_times.size() != num_chains
+        || cached.thin.size() != num_chains)
+      return false;
+    summary = std::move(cached);
+  } catch (const std::exception &e) {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace cmdstan
+#endif
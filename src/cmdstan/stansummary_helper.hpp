@@ -7,9 +7,12 @@
 #include <iomanip>
 #include <ios>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <numeric>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 #include <boost/algorithm/string.hpp>
 
@@ -183,6 +186,18 @@ std::string matrix_index(const stan::mcmc::chains<> &chains, int index) {
   return name.substr(name.find("["));
 }
 
+/**
+ * Return the column labels of a set of samples.
+ *
+ * @param in set of samples from one or more chains
+ * @return vector of column labels
+ */
+template <typename Chains>
+std::vector<std::string> get_param_names(const Chains &chains) {
+  const auto &names = chains.param_names();
+  return std::vector<std::string>(names.data(), names.data() + names.size());
+}
+
 /**
  * Return vector of dimensions for container variable.
  *
@@ -283,6 +298,115 @@ int matrix_index(std::vector<int> &index, const std::vector<int> &dims) {
   return offset;
 }
 
+/**
+ * A variable in the header of a Stan csv file: its name, its container
+ * dimensions (empty for scalars) and the span of columns holding its
+ * elements in column-major order.
+ */
+struct variable_info {
+  std::string name;
+  std::vector<int> dims;
+  int first_column;
+  int num_columns;
+};
+
+/**
+ * Index over the column labels of a Stan csv file, built once by parsing
+ * each label.  For each column it records the variable it belongs to and
+ * the flat column-major offset of the element within that variable.
+ */
+struct header_index {
+  std::vector<variable_info> variables;
+  std::vector<int> column_variable;
+  std::vector<int> column_offset;
+};
+
+/**
+ * Parse the column labels into a header index.  Consecutive columns
+ * with the same base name belong to one variable, whose dimensions
+ * are the indices of its last element.
+ *
+ * @param in vector of column labels
+ * @return header index
+ */
+header_index make_header_index(const std::vector<std::string> &names) {
+  header_index index;
+  index.column_variable.resize(names.size());
+  index.column_offset.resize(names.size());
+  for (size_t col = 0; col < names.size(); ++col) {
+    const std::string &name = names[col];
+    size_t bracket = name.find('[');
+    size_t base_length = bracket == std::string::npos ? name.size() : bracket;
+    if (index.variables.empty()
+        || index.variables.back().name.compare(0, std::string::npos, name, 0,
+                                               base_length)
+               != 0) {
+      variable_info var;
+      var.name = name.substr(0, base_length);
+      var.first_column = col;
+      var.num_columns = 0;
+      index.variables.push_back(std::move(var));
+    }
+    variable_info &var = index.variables.back();
+    index.column_variable[col] = index.variables.size() - 1;
+    index.column_offset[col] = var.num_columns++;
+    if (bracket != std::string::npos) {
+      var.dims.clear();
+      const char *p = name.c_str() + bracket;
+      while (*p == '[' || *p == ',') {
+        char *end;
+        var.dims.push_back(std::strtol(p + 1, &end, 10));
+        p = end;
+      }
+    }
+  }
+  return index;
+}
+
+/**
+ * Return the column-major offsets of the elements of a variable,
+ * listed in row-major order.
+ *
+ * @param in variable
+ * @return vector of offsets from the first column of the variable
+ */
+std::vector<int> row_major_offsets(const variable_info &var) {
+  std::vector<int> offsets(var.num_columns);
+  if (var.dims.empty()) {
+    std::iota(offsets.begin(), offsets.end(), 0);
+    return offsets;
+  }
+  size_t n_dims = var.dims.size();
+  std::vector<int> strides(n_dims, 1);
+  for (size_t i = 1; i < n_dims; ++i)
+    strides[i] = strides[i - 1] * var.dims[i - 1];
+  std::vector<int> index(n_dims, 0);
+  int offset = 0;
+  for (int k = 0; k < var.num_columns; ++k) {
+    offsets[k] = offset;
+    // advance last index fastest, carrying into earlier indices
+    for (int i = n_dims - 1; i >= 0; --i) {
+      offset += strides[i];
+      if (++index[i] < var.dims[i] || i == 0)
+        break;
+      offset -= strides[i] * index[i];
+      index[i] = 0;
+    }
+  }
+  return offsets;
+}
+
+/**
+ * Return vector of dimensions for container variable.
+ *
+ * @param in header index
+ * @param in column index of first container element
+ * @return vector of dimensions
+ */
+std::vector<int> dimensions(const header_index &index, int start_index) {
+  return index.variables[index.column_variable[start_index]].dims;
+}
+
 /**
  * Convert percentiles - int values in range (1,99)
  * to probabilities - double values in range (0, 1).
@@ -314,21 +438,24 @@ Eigen::VectorXd percentiles_to_probs(
 }
 
 /**
- * Assemble set of Stan csv files into a stan::mcmc::chains object
+ * Assemble set of Stan csv files into a stan::mcmc::chains object,
+ * or into another container of draws with the same interface.
  *
+ * @tparam Chains type of container for the draws
  * @param in vector of filenames of stan csv files
  * @param in out  metadata
  * @param in out  warmup times for each chain
  * @param in out  sampling times for each chain
  * @param in out  thinning for each chain
  * @param out output stream
- * @return stan::mcmc::chains object
+ * @return container of draws for all chains
  */
-stan::mcmc::chains<> parse_csv_files(const std::vector<std::string> &filenames,
-                                     stan::io::stan_csv_metadata &metadata,
-                                     Eigen::VectorXd &warmup_times,
-                                     Eigen::VectorXd &sampling_times,
-                                     Eigen::VectorXi &thin, std::ostream *out) {
+template <typename Chains = stan::mcmc::chains<>>
+Chains parse_csv_files(const std::vector<std::string> &filenames,
+                       stan::io::stan_csv_metadata &metadata,
+                       Eigen::VectorXd &warmup_times,
+                       Eigen::VectorXd &sampling_times, Eigen::VectorXi &thin,
+                       std::ostream *out) {
   // instantiate stan::mcmc::chains object by parsing first file
   std::ifstream ifstream;
   ifstream.open(filenames[0].c_str());
@@ -342,9 +469,10 @@ stan::mcmc::chains<> parse_csv_files(const std::vector<std::string> &filenames,
   }
   warmup_times(0) = stan_csv.timing.warmup;
   sampling_times(0) = stan_csv.timing.sampling;
-  stan::mcmc::chains<> chains(stan_csv);
   thin(0) = stan_csv.metadata.thin;
   metadata = stan_csv.metadata;
+  // containers which accept an rvalue take over the parsed draws
+  Chains chains(std::move(stan_csv));
 
   // parse rest of input files, add to chains
   for (std::vector<std::string>::size_type chain = 1; chain < filenames.size();
@@ -358,10 +486,10 @@ stan::mcmc::chains<> parse_csv_files(const std::vector<std::string> &filenames,
                      << filenames[chain] << ".";
       throw std::invalid_argument(message_stream.str());
     }
-    chains.add(stan_csv);
     thin(chain) = stan_csv.metadata.thin;
     warmup_times(chain) = stan_csv.timing.warmup;
     sampling_times(chain) = stan_csv.timing.sampling;
+    chains.add(std::move(stan_csv));
   }
   return chains;
 }
@@ -402,8 +530,8 @@ std::vector<std::string> get_header(
  * @param in span length
  * @param in out matrix of model param statistics
  */
-void get_stats(const stan::mcmc::chains<> &chains,
-               const Eigen::VectorXd &sampling_times,
+template <typename Chains>
+void get_stats(const Chains &chains, const Eigen::VectorXd &sampling_times,
                const Eigen::VectorXd &probs, std::vector<int> cols,
                Eigen::MatrixXd &params) {
   params.setZero();
@@ -432,6 +560,78 @@ void get_stats(const stan::mcmc::chains<> &chains,
   }
 }
 
+/**
+ * Statistics and run information for a set of Stan csv files,
+ * everything needed to report the summary without the draws.
+ * Rows of the statistics matrix correspond to the column labels,
+ * its columns to the output labels returned by `get_header`.
+ */
+struct chains_summary {
+  stan::io::stan_csv_metadata metadata;
+  std::vector<std::string> param_names;
+  Eigen::VectorXi num_kept_samples;
+  Eigen::VectorXi num_warmup;
+  Eigen::VectorXd warmup_times;
+  Eigen::VectorXd sampling_times;
+  Eigen::VectorXi thin;
+  Eigen::MatrixXd stats;
+};
+
+/**
+ * Copy column labels and per-chain draw counts from a set of samples
+ * into a summary and allocate its (zeroed) statistics matrix.
+ * Metadata, timing and thinning are filled in by the caller.
+ *
+ * @param in set of samples from one or more chains
+ * @param in number of statistics per column
+ * @param in out summary
+ */
+template <typename Chains>
+void init_summary(const Chains &chains, size_t num_stats,
+                  chains_summary &summary) {
+  summary.param_names = get_param_names(chains);
+  summary.num_kept_samples.resize(chains.num_chains());
+  summary.num_warmup.resize(chains.num_chains());
+  for (int chain = 0; chain < chains.num_chains(); ++chain) {
+    summary.num_kept_samples(chain) = chains.num_kept_samples(chain);
+    summary.num_warmup(chain) = chains.warmup(chain);
+  }
+  summary.stats = Eigen::MatrixXd::Zero(chains.num_params(), num_stats);
+}
+
+/**
+ * Compute statistics for a set of columns,
+ * storing them in the corresponding rows of the summary.
+ *
+ * @param in set of samples from one or more chains
+ * @param in vector of probabilities
+ * @param in vector of column indices in chains object
+ * @param in out summary
+ */
+template <typename Chains>
+void get_stats(const Chains &chains, const Eigen::VectorXd &probs,
+               const std::vector<int> &cols, chains_summary &summary) {
+  Eigen::MatrixXd params(cols.size(), summary.stats.cols());
+  get_stats(chains, summary.sampling_times, probs, cols, params);
+  for (size_t i = 0; i < cols.size(); ++i)
+    summary.stats.row(cols[i]) = params.row(i);
+}
+
+/**
+ * Gather a subset of the rows of a matrix of statistics.
+ *
+ * @param in matrix of statistics
+ * @param in vector of row indices
+ * @return matrix with one row per index
+ */
+Eigen::MatrixXd select_rows(const Eigen::MatrixXd &stats,
+                            const std::vector<int> &rows) {
+  Eigen::MatrixXd selected(rows.size(), stats.cols());
+  for (size_t i = 0; i < rows.size(); ++i)
+    selected.row(i) = stats.row(rows[i]);
+  return selected;
+}
+
 /**
  * Output summary header either as fixed-width text columns or in csv format.
  * Indent header by length of longest parameter name.
@@ -463,17 +663,17 @@ void write_header(const std::vector<std::string> &header,
  * Output statistics for a set of parameters
  * either as fixed-width text columns or in csv format.
  *
- * @param in set of samples from one or more chains
+ * @param in vector of column labels
  * @param in matrix of statistics
  * @param in vector of output column widths
  * @param in vector of output column formats
  * @param in size of longest parameter name - (width of 1st output column)
  * @param in significant digits required
- * @param in vector of column indexes to output from chains
+ * @param in vector of column indexes to output
  * @param in output format flag:  true for csv; false for plain text
  * @param in output stream
  */
-void write_params(const stan::mcmc::chains<> &chains,
+void write_params(const std::vector<std::string> &names,
                   const Eigen::MatrixXd &params,
                   const Eigen::VectorXi &col_widths,
                   const Eigen::Matrix<std::ios_base::fmtflags, Eigen::Dynamic,
@@ -483,13 +683,12 @@ void write_params(const stan::mcmc::chains<> &chains,
   int i = 0;
   for (int i_chains : cols) {
     if (as_csv) {
-      *out << "\"" << chains.param_name(i_chains) << "\"";
+      *out << "\"" << names[i_chains] << "\"";
       for (int j = 0; j < params.cols(); j++) {
         *out << "," << params(i, j);
       }
     } else {
-      *out << std::setw(max_name_length + 1) << std::left
-           << chains.param_name(i_chains);
+      *out << std::setw(max_name_length + 1) << std::left << names[i_chains];
       *out << std::right;
       for (int j = 0; j < params.cols(); j++) {
         std::cout.setf(col_formats(j), std::ios::floatfield);
@@ -507,7 +706,6 @@ void write_params(const stan::mcmc::chains<> &chains,
 /**
  * Output statistics for a set of parameters
  * either as fixed-width text columns or in csv format.
- * Containers are re-ordered as first-index-major order
  *
  * @param in set of samples from one or more chains
  * @param in matrix of statistics
@@ -515,11 +713,39 @@ void write_params(const stan::mcmc::chains<> &chains,
  * @param in vector of output column formats
  * @param in size of longest parameter name - (width of 1st output column)
  * @param in significant digits required
- * @param in index of first column in chains object
+ * @param in vector of column indexes to output from chains
  * @param in output format flag:  true for csv; false for plain text
  * @param in output stream
  */
-void write_all_model_params(const stan::mcmc::chains<> &chains,
+void write_params(const stan::mcmc::chains<> &chains,
+                  const Eigen::MatrixXd &params,
+                  const Eigen::VectorXi &col_widths,
+                  const Eigen::Matrix<std::ios_base::fmtflags, Eigen::Dynamic,
+                                      1> &col_formats,
+                  int max_name_length, int sig_figs, std::vector<int> cols,
+                  bool as_csv, std::ostream *out) {
+  write_params(get_param_names(chains), params, col_widths, col_formats,
+               max_name_length, sig_figs, cols, as_csv, out);
+}
+
+/**
+ * Output statistics for a set of parameters
+ * either as fixed-width text columns or in csv format.
+ * Containers are re-ordered as first-index-major order
+ *
+ * @param in vector of column labels
+ * @param in header index built from the column labels
+ * @param in matrix of statistics
+ * @param in vector of output column widths
+ * @param in vector of output column formats
+ * @param in size of longest parameter name - (width of 1st output column)
+ * @param in significant digits required
+ * @param in index of first column in vector of labels
+ * @param in output format flag:  true for csv; false for plain text
+ * @param in output stream
+ */
+void write_all_model_params(const std::vector<std::string> &names,
+                            const header_index &index,
                             const Eigen::MatrixXd &params,
                             const Eigen::VectorXi &col_widths,
                             const Eigen::Matrix<std::ios_base::fmtflags,
@@ -529,15 +755,16 @@ void write_all_model_params(const stan::mcmc::chains<> &chains,
                             std::ostream *out) {
   for (int i = 0, i_chains = params_start_col; i < params.rows();
        ++i, ++i_chains) {
-    if (!is_container(chains.param_name(i_chains))) {
+    const variable_info &var
+        = index.variables[index.column_variable[i_chains]];
+    if (var.dims.empty()) {
       if (as_csv) {
-        *out << "\"" << chains.param_name(i_chains) << "\"";
+        *out << "\"" << names[i_chains] << "\"";
         for (int j = 0; j < params.cols(); j++) {
           *out << "," << params(i, j);
         }
       } else {
-        *out << std::setw(max_name_length + 1) << std::left
-             << chains.param_name(i_chains);
+        *out << std::setw(max_name_length + 1) << std::left << names[i_chains];
         *out << std::right;
         for (int j = 0; j < params.cols(); j++) {
           out->setf(col_formats(j), std::ios::floatfield);
@@ -551,16 +778,11 @@ void write_all_model_params(const stan::mcmc::chains<> &chains,
     } else {
       // container object columns in csv are last-index-major order
       // output as first-index-major order
-      std::vector<int> dims = dimensions(chains, i_chains);
-      std::vector<int> index(dims.size(), 1);
-      int max = 1;
-      for (size_t j = 0; j < dims.size(); j++)
-        max *= dims[j];
-      for (int k = 0; k < max; k++) {
-        int row_maj_index = i + matrix_index(index, dims);
-        int row_maj_index_chains = i_chains + matrix_index(index, dims);
+      for (int offset : row_major_offsets(var)) {
+        int row_maj_index = i + offset;
+        int row_maj_index_chains = i_chains + offset;
         if (as_csv) {
-          *out << "\"" << chains.param_name(row_maj_index_chains) << "\"";
+          *out << "\"" << names[row_maj_index_chains] << "\"";
           for (int j = 0; j < params.cols(); j++) {
             *out << "," << std::fixed
                  << std::setprecision(compute_precision(
@@ -569,7 +791,7 @@ void write_all_model_params(const stan::mcmc::chains<> &chains,
           }
         } else {
           *out << std::setw(max_name_length + 1) << std::left
-               << chains.param_name(row_maj_index_chains);
+               << names[row_maj_index_chains];
           *out << std::right;
           for (int j = 0; j < params.cols(); j++) {
             out->setf(col_formats(j), std::ios::floatfield);
@@ -580,19 +802,74 @@ void write_all_model_params(const stan::mcmc::chains<> &chains,
           }
         }
         *out << std::endl;
-        if (k < max - 1)
-          next_index(index, dims);
       }
-      i += max - 1;
-      i_chains += max - 1;
+      i += var.num_columns - 1;
+      i_chains += var.num_columns - 1;
     }
   }
 }
 
 /**
- * Output timing statistics for all chains
+ * Output statistics for a set of parameters
+ * either as fixed-width text columns or in csv format.
+ * Containers are re-ordered as first-index-major order
+ *
+ * @param in vector of column labels
+ * @param in matrix of statistics
+ * @param in vector of output column widths
+ * @param in vector of output column formats
+ * @param in size of longest parameter name - (width of 1st output column)
+ * @param in significant digits required
+ * @param in index of first column in vector of labels
+ * @param in output format flag:  true for csv; false for plain text
+ * @param in output stream
+ */
+void write_all_model_params(const std::vector<std::string> &names,
+                            const Eigen::MatrixXd &params,
+                            const Eigen::VectorXi &col_widths,
+                            const Eigen::Matrix<std::ios_base::fmtflags,
+                                                Eigen::Dynamic, 1> &col_formats,
+                            int max_name_length, int sig_figs,
+                            int params_start_col, bool as_csv,
+                            std::ostream *out) {
+  write_all_model_params(names, make_header_index(names), params, col_widths,
+                         col_formats, max_name_length, sig_figs,
+                         params_start_col, as_csv, out);
+}
+
+/**
+ * Output statistics for a set of parameters
+ * either as fixed-width text columns or in csv format.
+ * Containers are re-ordered as first-index-major order
  *
  * @param in set of samples from one or more chains
+ * @param in matrix of statistics
+ * @param in vector of output column widths
+ * @param in vector of output column formats
+ * @param in size of longest parameter name - (width of 1st output column)
+ * @param in significant digits required
+ * @param in index of first column in chains object
+ * @param in output format flag:  true for csv; false for plain text
+ * @param in output stream
+ */
+void write_all_model_params(const stan::mcmc::chains<> &chains,
+                            const Eigen::MatrixXd &params,
+                            const Eigen::VectorXi &col_widths,
+                            const Eigen::Matrix<std::ios_base::fmtflags,
+                                                Eigen::Dynamic, 1> &col_formats,
+                            int max_name_length, int sig_figs,
+                            int params_start_col, bool as_csv,
+                            std::ostream *out) {
+  write_all_model_params(get_param_names(chains), params, col_widths,
+                         col_formats, max_name_length, sig_figs,
+                         params_start_col, as_csv, out);
+}
+
+/**
+ * Output timing statistics for all chains
+ *
+ * @param in number of saved draws for each chain
+ * @param in number of warmup draws for each chain
  * @param in metadata
  * @param in warmup times for each chain
  * @param in sampling times for each chain
@@ -600,27 +877,29 @@ void write_all_model_params(const stan::mcmc::chains<> &chains,
  * @param in prefix string - used to output as comments in csv file
  * @param out output stream
  */
-void write_timing(const stan::mcmc::chains<> &chains,
+void write_timing(const Eigen::VectorXi &num_kept_samples,
+                  const Eigen::VectorXi &num_warmup,
                   const stan::io::stan_csv_metadata &metadata,
                   const Eigen::VectorXd &warmup_times,
                   const Eigen::VectorXd &sampling_times,
                   const Eigen::VectorXi &thin, const std::string &prefix,
                   std::ostream *out) {
+  int num_chains = num_kept_samples.size();
   *out << prefix << "Inference for Stan model: " << metadata.model << std::endl
-       << prefix << chains.num_chains() << " chains: each with iter=("
-       << chains.num_kept_samples(0);
-  for (int chain = 1; chain < chains.num_chains(); chain++)
-    *out << "," << chains.num_kept_samples(chain);
+       << prefix << num_chains << " chains: each with iter=("
+       << num_kept_samples(0);
+  for (int chain = 1; chain < num_chains; chain++)
+    *out << "," << num_kept_samples(chain);
   *out << ")";
-  *out << "; warmup=(" << chains.warmup(0);
-  for (int chain = 1; chain < chains.num_chains(); chain++)
-    *out << "," << chains.warmup(chain);
+  *out << "; warmup=(" << num_warmup(0);
+  for (int chain = 1; chain < num_chains; chain++)
+    *out << "," << num_warmup(chain);
   *out << ")";
   *out << "; thin=(" << thin(0);
-  for (int chain = 1; chain < chains.num_chains(); chain++)
+  for (int chain = 1; chain < num_chains; chain++)
     *out << "," << thin(chain);
   *out << ")";
-  *out << "; " << chains.num_samples() << " iterations saved." << std::endl
+  *out << "; " << num_kept_samples.sum() << " iterations saved." << std::endl
        << prefix << std::endl;
 
   int sig_figs = 2;
@@ -635,7 +914,7 @@ void write_timing(const stan::mcmc::chains<> &chains,
     total_warmup_time /= 60;
     warmup_unit = "minutes";
   }
-  if (chains.num_chains() == 1) {
+  if (num_chains == 1) {
     *out << prefix << "Warmup took " << std::fixed
          << std::setprecision(
                 compute_precision(total_warmup_time, sig_figs, false))
@@ -645,7 +924,7 @@ void write_timing(const stan::mcmc::chains<> &chains,
          << std::setprecision(
                 compute_precision(warmup_times(0), sig_figs, false))
          << warmup_times(0);
-    for (int chain = 1; chain < chains.num_chains(); chain++)
+    for (int chain = 1; chain < num_chains; chain++)
       *out << ", " << std::fixed
            << std::setprecision(
                   compute_precision(warmup_times(chain), sig_figs, false))
@@ -665,7 +944,7 @@ void write_timing(const stan::mcmc::chains<> &chains,
     total_sampling_time /= 60;
     sampling_unit = "minutes";
   }
-  if (chains.num_chains() == 1) {
+  if (num_chains == 1) {
     *out << prefix << "Sampling took " << std::fixed
          << std::setprecision(
                 compute_precision(total_sampling_time, sig_figs, false))
@@ -675,7 +954,7 @@ void write_timing(const stan::mcmc::chains<> &chains,
          << std::setprecision(
                 compute_precision(sampling_times(0), sig_figs, false))
          << sampling_times(0);
-    for (int chain = 1; chain < chains.num_chains(); chain++)
+    for (int chain = 1; chain < num_chains; chain++)
       *out << ", " << std::fixed
            << std::setprecision(
                   compute_precision(sampling_times(chain), sig_figs, false))
@@ -689,6 +968,33 @@ void write_timing(const stan::mcmc::chains<> &chains,
   }
 }
 
+/**
+ * Output timing statistics for all chains
+ *
+ * @param in set of samples from one or more chains
+ * @param in metadata
+ * @param in warmup times for each chain
+ * @param in sampling times for each chain
+ * @param in thinning for each chain
+ * @param in prefix string - used to output as comments in csv file
+ * @param out output stream
+ */
+void write_timing(const stan::mcmc::chains<> &chains,
+                  const stan::io::stan_csv_metadata &metadata,
+                  const Eigen::VectorXd &warmup_times,
+                  const Eigen::VectorXd &sampling_times,
+                  const Eigen::VectorXi &thin, const std::string &prefix,
+                  std::ostream *out) {
+  Eigen::VectorXi num_kept_samples(chains.num_chains());
+  Eigen::VectorXi num_warmup(chains.num_chains());
+  for (int chain = 0; chain < chains.num_chains(); ++chain) {
+    num_kept_samples(chain) = chains.num_kept_samples(chain);
+    num_warmup(chain) = chains.warmup(chain);
+  }
+  write_timing(num_kept_samples, num_warmup, metadata, warmup_times,
+               sampling_times, thin, prefix, out);
+}
+
 /**
  * Output sampler information
  *
@@ -725,7 +1031,8 @@ void write_sampler_info(const stan::io::stan_csv_metadata &metadata,
  * @param in size of longest sampler param name
  */
 // autocorrelation report prints to std::out
-void autocorrelation(const stan::mcmc::chains<> &chains,
+template <typename Chains>
+void autocorrelation(const Chains &chains,
                      const stan::io::stan_csv_metadata &metadata,
                      int autocorr_idx, int max_name_length) {
   int c = autocorr_idx - 1;
@@ -0,0 +1,122 @@
+#ifndef CMDSTAN_STOP_INTERRUPT_HPP
+#define CMDSTAN_STOP_INTERRUPT_HPP
+
+#include <stan/callbacks/interrupt.hpp>
+#include <chrono>
+#include <csignal>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace cmdstan {
+
+/**
+ * Exception thrown by `stop_interrupt` to stop an algorithm.  It is
+ * thrown at the start of an iteration, so the algorithm's state and
+ * output are those at the end of the previous iteration.
+ */
+class stop_exception : public std::runtime_error {
+ public:
+  explicit stop_exception(const std::string &reason)
+      : std::runtime_error(reason) {}
+};
+
+namespace internal {
+inline volatile std::sig_atomic_t &stop_signal() {
+  static volatile std::sig_atomic_t sig = 0;
+  return sig;
+}
+
+/*
+ * Record the signal; a second one has its default effect, so a run
+ * which does not reach an iteration boundary can still be killed.
+ */
+inline void handle_stop_signal(int sig) {
+  stop_signal() = sig;
+  std::signal(sig, SIG_DFL);
+}
+}  // namespace internal
+
+/**
+ * Installs handlers for SIGINT and SIGTERM which request a stop, for
+ * the lifetime of the guard.  The previous handlers are restored and
+ * the stop request is cleared when it is destroyed.  The handlers are
+ * process-wide, so the guard is installed once, by `run_main`, and not
+ * by each run of a method.
+ */
+class stop_signal_guard {
+ public:
+  stop_signal_guard()
+      : previous_int_(std::signal(SIGINT, internal::handle_stop_signal)),
+        previous_term_(std::signal(SIGTERM, internal::handle_stop_signal)) {
+    internal::stop_signal() = 0;
+  }
+
+  stop_signal_guard(const stop_signal_guard &) = delete;
+  stop_signal_guard &operator=(const stop_signal_guard &) = delete;
+
+  ~stop_signal_guard() {
+    if (previous_int_ != SIG_ERR)
+      std::signal(SIGINT, previous_int_);
+    if (previous_term_ != SIG_ERR)
+      std::signal(SIGTERM, previous_term_);
+    internal::stop_signal() = 0;
+  }
+
+ private:
+  using handler = void (*)(int);
+  handler previous_int_;
+  handler previous_term_;
+};
+
+/**
+ * Interrupt callback which stops an algorithm at the next iteration
+ * boundary, by throwing a `stop_exception`, once the maximum runtime
+ * has passed or after SIGINT or SIGTERM, while a `stop_signal_guard`
+ * is installed.  Stan's algorithms call the interrupt callback once per
+ * iteration, from every chain.
+ */
+class stop_interrupt : public stan::callbacks::interrupt {
+ public:
+  /**
+   * @param max_runtime maximum runtime in seconds, counted from
+   *   construction, or 0 for no limit
+   */
+  explicit stop_interrupt(double max_runtime = 0)
+      : max_runtime_(max_runtime), start_(std::chrono::steady_clock::now()) {}
+
+  void operator()() override {
+    if (stop_requested())
+      throw stop_exception(reason());
+  }
+
+  bool stop_requested() const {
+    return internal::stop_signal() != 0
+           || (max_runtime_ > 0
+               && std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start_)
+                          .count()
+                      > max_runtime_);
+  }
+
+  /**
+   * Return the reason for stopping.
+   */
+  std::string reason() const {
+    int sig = internal::stop_signal();
+    if (sig == SIGINT)
+      return "interrupted by SIGINT";
+    if (sig == SIGTERM)
+      return "terminated by SIGTERM";
+    std::stringstream msg;
+    msg << "maximum runtime of " << max_runtime_ << " seconds exceeded";
+    return msg.str();
+  }
+
+ private:
+  double max_runtime_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace cmdstan
+#endif
@@ -0,0 +1,280 @@
+#ifndef CMDSTAN_SUMMARY_DRAWS_HPP
+#define CMDSTAN_SUMMARY_DRAWS_HPP
+
+#include <stan/analyze/mcmc/compute_effective_sample_size.hpp>
+#include <stan/analyze/mcmc/compute_potential_scale_reduction.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <stan/math/prim.hpp>
+#include <boost/accumulators/accumulators.hpp>
+#include <boost/accumulators/statistics/stats.hpp>
+#include <boost/accumulators/statistics/tail_quantile.hpp>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Draws from one or more chains, stored with scalar type `T`.
+ * Provides the subset of the `stan::mcmc::chains` interface used by
+ * stansummary and diagnose, so that draws can be kept in single
+ * precision to halve their memory footprint.  All statistics are
+ * accumulated in double precision with the same estimators as
+ * `stan::mcmc::chains`.  Parsed draws can be moved in, so with `T = double`
+ * they are never copied after the csv file is read.
+ *
+ * @tparam T scalar type used to store the draws
+ */
+template <typename T = double>
+class summary_draws {
+ public:
+  using matrix_t = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+
+  explicit summary_draws(const std::vector<std::string> &param_names)
+      : param_names_(param_names.size()) {
+    for (size_t i = 0; i < param_names.size(); ++i)
+      param_names_(i) = param_names[i];
+  }
+
+  explicit summary_draws(const stan::io::stan_csv &stan_csv)
+      : summary_draws(stan_csv.header) {
+    if (stan_csv.samples.rows() > 0)
+      add(stan_csv);
+  }
+
+  /**
+   * Construct from a parsed csv file, taking over its draws.
+   * The draws of the argument are left empty.
+   */
+  explicit summary_draws(stan::io::stan_csv &&stan_csv)
+      : summary_draws(stan_csv.header) {
+    if (stan_csv.samples.rows() > 0)
+      add(std::move(stan_csv));
+  }
+
+  int num_chains() const { return samples_.size(); }
+
+  int num_params() const { return param_names_.size(); }
+
+  const Eigen::Matrix<std::string, Eigen::Dynamic, 1> &param_names() const {
+    return param_names_;
+  }
+
+  const std::string &param_name(int index) const {
+    return param_names_(index);
+  }
+
+  int warmup(int chain) const { return warmup_[chain]; }
+
+  void set_warmup(int chain, int warmup) { warmup_[chain] = warmup; }
+
+  int num_samples(int chain) const { return samples_[chain].rows(); }
+
+  int num_kept_samples(int chain) const {
+    return num_samples(chain) - warmup(chain);
+  }
+
+  /**
+   * Return the total number of kept draws over all chains.
+   */
+  int num_samples() const {
+    int n = 0;
+    for (int chain = 0; chain < num_chains(); ++chain)
+      n += num_kept_samples(chain);
+    return n;
+  }
+
+  /**
+   * Add a chain of draws, one row per draw, one column per parameter.
+   *
+   * @param sample draws for one chain
+   */
+  void add(const Eigen::MatrixXd &sample) {
+    if (sample.cols() != num_params())
+      throw std::invalid_argument(
+          "add(sample): number of columns in sample does not match chains");
+    samples_.emplace_back(sample.template cast<T>());
+    warmup_.push_back(0);
+  }
+
+  /**
+   * Add a chain of draws, taking ownership of the storage.
+   *
+   * @param sample draws for one chain
+   */
+  void add(matrix_t &&sample) {
+    if (sample.cols() != num_params())
+      throw std::invalid_argument(
+          "add(sample): number of columns in sample does not match chains");
+    samples_.emplace_back(std::move(sample));
+    warmup_.push_back(0);
+  }
+
+  void add(const stan::io::stan_csv &stan_csv) {
+    check_header(stan_csv.header);
+    add(stan_csv.samples);
+    if (stan_csv.metadata.save_warmup)
+      set_warmup(num_chains() - 1, stan_csv.metadata.num_warmup);
+  }
+
+  /**
+   * Add the draws of a parsed csv file.  When the draws are stored in
+   * double precision the sample matrix is moved rather than copied and
+   * the draws of the argument are left empty.
+   */
+  void add(stan::io::stan_csv &&stan_csv) {
+    check_header(stan_csv.header);
+    add(std::move(stan_csv.samples));
+    if (stan_csv.metadata.save_warmup)
+      set_warmup(num_chains() - 1, stan_csv.metadata.num_warmup);
+  }
+
+  /**
+   * Return the kept draws of a parameter for one chain in double precision.
+   *
+   * @param chain chain index
+   * @param index parameter index
+   * @return vector of draws
+   */
+  Eigen::VectorXd samples(int chain, int index) const {
+    return samples_[chain]
+        .col(index)
+        .tail(num_kept_samples(chain))
+        .template cast<double>();
+  }
+
+  /**
+   * Return the kept draws of a parameter for all chains in double precision.
+   *
+   * @param index parameter index
+   * @return vector of draws
+   */
+  Eigen::VectorXd samples(int index) const {
+    Eigen::VectorXd x(num_samples());
+    for (int chain = 0, n = 0; chain < num_chains(); ++chain) {
+      int m = num_kept_samples(chain);
+      x.segment(n, m) = samples_[chain]
+                            .col(index)
+                            .tail(m)
+                            .template cast<double>();
+      n += m;
+    }
+    return x;
+  }
+
+  double mean(int index) const { return mean(samples(index)); }
+
+  double sd(int index) const { return std::sqrt(variance(samples(index))); }
+
+  Eigen::VectorXd quantiles(int index, const Eigen::VectorXd &probs) const {
+    Eigen::VectorXd x = samples(index);
+    Eigen::VectorXd q(probs.size());
+    for (int i = 0; i < probs.size(); ++i)
+      q(i) = quantile(x, probs(i));
+    return q;
+  }
+
+  double effective_sample_size(int index) const {
+    std::vector<Eigen::VectorXd> draws;
+    return stan::analyze::compute_effective_sample_size(
+        chain_pointers(index, draws), chain_sizes());
+  }
+
+  double split_potential_scale_reduction(int index) const {
+    std::vector<Eigen::VectorXd> draws;
+    return stan::analyze::compute_split_potential_scale_reduction(
+        chain_pointers(index, draws), chain_sizes());
+  }
+
+  Eigen::VectorXd autocorrelation(int chain, int index) const {
+    Eigen::VectorXd ac;
+    stan::math::autocorrelation(samples(chain, index), ac);
+    return ac;
+  }
+
+ private:
+  Eigen::Matrix<std::string, Eigen::Dynamic, 1> param_names_;
+  std::vector<matrix_t> samples_;
+  std::vector<int> warmup_;
+
+  static double mean(const Eigen::VectorXd &x) {
+    return (x.array() / x.size()).sum();
+  }
+
+  static double variance(const Eigen::VectorXd &x) {
+    double m = mean(x);
+    return ((x.array() - m) / std::sqrt((x.size() - 1.0))).square().sum();
+  }
+
+  static double quantile(const Eigen::VectorXd &x, double prob) {
+    using boost::accumulators::accumulator_set;
+    using boost::accumulators::left;
+    using boost::accumulators::quantile_probability;
+    using boost::accumulators::right;
+    using boost::accumulators::stats;
+    using boost::accumulators::tag::tail;
+    using boost::accumulators::tag::tail_quantile;
+    size_t cache_size = x.size();
+    if (prob < 0.5) {
+      accumulator_set<double, stats<tail_quantile<left>>> acc(
+          tail<left>::cache_size = cache_size);
+      for (int i = 0; i < x.size(); ++i)
+        acc(x(i));
+      return boost::accumulators::quantile(acc, quantile_probability = prob);
+    }
+    accumulator_set<double, stats<tail_quantile<right>>> acc(
+        tail<right>::cache_size = cache_size);
+    for (int i = 0; i < x.size(); ++i)
+      acc(x(i));
+    return boost::accumulators::quantile(acc, quantile_probability = prob);
+  }
+
+  // double precision draws are used in place
+  static const double *kept_data(const Eigen::MatrixXd &sample, int index,
+                                 int warmup,
+                                 std::vector<Eigen::VectorXd> &draws) {
+    return sample.col(index).data() + warmup;
+  }
+
+  template <typename S>
+  static const double *kept_data(
+      const Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic> &sample,
+      int index, int warmup, std::vector<Eigen::VectorXd> &draws) {
+    draws.emplace_back(sample.col(index)
+                           .tail(sample.rows() - warmup)
+                           .template cast<double>());
+    return draws.back().data();
+  }
+
+  void check_header(const std::vector<std::string> &header) const {
+    if (header.size() != static_cast<size_t>(num_params()))
+      throw std::invalid_argument(
+          "add(stan_csv): number of columns in sample does not match chains");
+    for (int i = 0; i < num_params(); ++i)
+      if (header[i] != param_names_(i))
+        throw std::invalid_argument(
+            "add(stan_csv): header does not match chain's header");
+  }
+
+  std::vector<const double *> chain_pointers(
+      int index, std::vector<Eigen::VectorXd> &draws) const {
+    std::vector<const double *> pointers;
+    draws.reserve(num_chains());
+    for (int chain = 0; chain < num_chains(); ++chain)
+      pointers.push_back(
+          kept_data(samples_[chain], index, warmup(chain), draws));
+    return pointers;
+  }
+
+  std::vector<size_t> chain_sizes() const {
+    std::vector<size_t> sizes;
+    for (int chain = 0; chain < num_chains(); ++chain)
+      sizes.push_back(num_kept_samples(chain));
+    return sizes;
+  }
+};
+
+}  // namespace cmdstan
+#endif
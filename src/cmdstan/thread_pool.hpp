@@ -0,0 +1,60 @@
+#ifndef CMDSTAN_THREAD_POOL_HPP
+#define CMDSTAN_THREAD_POOL_HPP
+
+#include <cmdstan/arguments/arg_num_threads.hpp>
+#include <stan/math/prim/core/init_threadpool_tbb.hpp>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace cmdstan {
+
+namespace internal {
+inline std::mutex &thread_pool_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+inline int &thread_pool_threads() {
+  static int num_threads = 0;
+  return num_threads;
+}
+}  // namespace internal
+
+/**
+ * Set up the thread pool of the process.  Stan sets it up once per
+ * process, so the runs after the first, such as the jobs of serve and
+ * manifest or later runs of the sampling library, only check that
+ * they ask for the same number of threads.  Throws an exception if
+ * the number is not valid or differs from that of the pool.
+ *
+ * @param num_threads number of threads
+ */
+inline void init_thread_pool(int num_threads) {
+  parse_num_threads(std::to_string(num_threads));
+  std::lock_guard<std::mutex> lock(internal::thread_pool_mutex());
+  int &pool_threads = internal::thread_pool_threads();
+  if (pool_threads == 0) {
+    stan::math::init_threadpool_tbb(num_threads);
+    pool_threads = num_threads;
+  } else if (num_threads != pool_threads) {
+    std::stringstream msg;
+    msg << "num_threads=" << num_threads << " differs from num_threads="
+        << pool_threads << " of the thread pool, which is set up once "
+        << "per process";
+    throw std::invalid_argument(msg.str());
+  }
+}
+
+/**
+ * Return the number of threads of the thread pool, or 0 if it has not
+ * been set up.
+ */
+inline int thread_pool_size() {
+  std::lock_guard<std::mutex> lock(internal::thread_pool_mutex());
+  return internal::thread_pool_threads();
+}
+
+}  // namespace cmdstan
+#endif
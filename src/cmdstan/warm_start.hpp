@@ -0,0 +1,107 @@
+#ifndef CMDSTAN_WARM_START_HPP
+#define CMDSTAN_WARM_START_HPP
+
+#include <cmdstan/command_helper.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <stan/math/prim/fun/Eigen.hpp>
+#include <stan/model/model_base.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmdstan {
+
+/**
+ * Adaptation results and final state of one chain of a previous run.
+ */
+struct warm_start_chain {
+  double stepsize;
+  Eigen::MatrixXd inv_metric;  // square; diagonal for a diag_e run
+  Eigen::VectorXd params;      // constrained parameters of the last draw
+};
+
+/**
+ * Read the step size, inverse metric and last draw of a chain
+ * from a Stan CSV file written by the sampler with adaptation.
+ * Throws an exception if the file cannot be read or has
+ * no adaptation information.
+ *
+ * @param model model
+ * @param fname name of Stan CSV file
+ * @return warm start values for the chain
+ */
+inline warm_start_chain read_warm_start(const stan::model::model_base &model,
+                                        const std::string &fname) {
+  std::ifstream in(fname);
+  if (!in.good()) {
+    std::stringstream msg;
+    msg << "Can't open warm start file \"" << fname << "\"" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  std::stringstream parse_msgs;
+  stan::io::stan_csv csv = stan::io::stan_csv_reader::parse(in, &parse_msgs);
+  const Eigen::MatrixXd &metric = csv.adaptation.metric;
+  Eigen::Index N = model.num_params_r();
+  bool diag = metric.rows() == 1 && metric.cols() == N;
+  bool dense = metric.rows() == N && metric.cols() == N;
+  if (!(csv.adaptation.step_size > 0) || !(diag || dense)) {
+    std::stringstream msg;
+    msg << "Warm start file \"" << fname << "\" has no adaptation results "
+        << "for this model" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  std::vector<std::string> param_names;
+  model.constrained_param_names(param_names, false, false);
+  auto first = std::find(csv.header.begin(), csv.header.end(), param_names[0]);
+  size_t offset = first - csv.header.begin();
+  if (first == csv.header.end() || csv.samples.rows() == 0
+      || offset + param_names.size() > csv.header.size()) {
+    std::stringstream msg;
+    msg << "Warm start file \"" << fname << "\" has no draws "
+        << "for this model" << std::endl;
+    throw std::invalid_argument(msg.str());
+  }
+  warm_start_chain chain;
+  chain.stepsize = csv.adaptation.step_size;
+  if (diag)
+    chain.inv_metric = metric.row(0).transpose().asDiagonal();
+  else
+    chain.inv_metric = metric;
+  chain.params = csv.samples.row(csv.samples.rows() - 1)
+                     .segment(offset, param_names.size())
+                     .transpose();
+  return chain;
+}
+
+/**
+ * Read warm start values for all chains from the output of a previous
+ * run.  As for init files, if the file `<base>_<id>.csv` exists then
+ * chain i is read from `<base>_<id + i>.csv`, otherwise all chains
+ * are read from the named file.
+ *
+ * @param model model
+ * @param fname name of Stan CSV output file of the previous run
+ * @param num_chains number of chains
+ * @param id chain id of the first chain
+ * @return warm start values for each chain
+ */
+inline std::vector<warm_start_chain> read_warm_starts(
+    const stan::model::model_base &model, const std::string &fname,
+    unsigned int num_chains, unsigned int id) {
+  std::vector<std::string> filenames(num_chains, fname);
+  if (num_chains > 1) {
+    auto chain_filenames = make_filenames(fname, "", ".csv", num_chains, id);
+    if (std::ifstream(chain_filenames[0]).good())
+      filenames = chain_filenames;
+  }
+  std::vector<warm_start_chain> chains;
+  for (const auto &filename : filenames)
+    chains.push_back(read_warm_start(model, filename));
+  return chains;
+}
+
+}  // namespace cmdstan
+#endif
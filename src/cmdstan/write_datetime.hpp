@@ -9,7 +9,7 @@
 
 namespace cmdstan {
 
-std::string current_datetime() {
+inline std::string current_datetime() {
   const std::time_t current_datetime
       = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
   std::tm* curr_tm = std::gmtime(&current_datetime);
@@ -23,7 +23,7 @@ std::string current_datetime() {
   return current_datetime_msg.str();
 }
 
-void write_datetime(stan::callbacks::writer& writer) {
+inline void write_datetime(stan::callbacks::writer& writer) {
   std::stringstream current_datetime_msg;
   current_datetime_msg << "start_datetime = " << current_datetime();
   writer(current_datetime_msg.str());
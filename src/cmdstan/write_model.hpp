@@ -5,8 +5,8 @@
 #include <string>
 
 namespace cmdstan {
-void write_model(stan::callbacks::writer& writer,
-                 const std::string& model_name) {
+inline void write_model(stan::callbacks::writer& writer,
+                        const std::string& model_name) {
   writer("model = " + model_name);
 }
 }  // namespace cmdstan
@@ -6,16 +6,16 @@
 #include <stan/model/model_base.hpp>
 
 namespace cmdstan {
-void write_compile_info(stan::callbacks::writer& writer,
-                        stan::model::model_base& model) {
+inline void write_compile_info(stan::callbacks::writer& writer,
+                               stan::model::model_base& model) {
   auto compile_info = model.model_compile_info();
   for (auto s : compile_info) {
     writer(s);
   }
 }
 
-void write_compile_info(stan::callbacks::structured_writer& writer,
-                        stan::model::model_base& model) {
+inline void write_compile_info(stan::callbacks::structured_writer& writer,
+                               stan::model::model_base& model) {
   auto compile_info = model.model_compile_info();
   for (auto s : compile_info) {
     // split on "="
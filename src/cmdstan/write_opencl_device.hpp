@@ -10,7 +10,7 @@
 
 namespace cmdstan {
 
-void write_opencl_device(stan::callbacks::writer &writer) {
+inline void write_opencl_device(stan::callbacks::writer &writer) {
 #ifdef STAN_OPENCL
   if ((stan::math::opencl_context.platform().size() > 0)
       && (stan::math::opencl_context.device().size() > 0)) {
@@ -28,7 +28,7 @@ void write_opencl_device(stan::callbacks::writer &writer) {
 #endif
 }
 
-void write_opencl_device(stan::callbacks::structured_writer &writer) {
+inline void write_opencl_device(stan::callbacks::structured_writer &writer) {
 #ifdef STAN_OPENCL
   if ((stan::math::opencl_context.platform().size() > 0)
       && (stan::math::opencl_context.device().size() > 0)) {
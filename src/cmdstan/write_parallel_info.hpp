@@ -7,7 +7,7 @@
 
 namespace cmdstan {
 
-void write_parallel_info(stan::callbacks::writer &writer) {
+inline void write_parallel_info(stan::callbacks::writer &writer) {
 #ifdef STAN_MPI
   writer("mpi_enabled = 1");
 #endif
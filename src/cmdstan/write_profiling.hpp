@@ -16,7 +16,7 @@ namespace cmdstan {
  * @param output stream to write output to
  * @param p reference to the map of profiles
  */
-void write_profiling(std::ostream& output, stan::math::profile_map& p) {
+inline void write_profiling(std::ostream& output, stan::math::profile_map& p) {
   stan::math::profile_map::iterator it;
 
   output << "name,thread_id,total_time,forward_time,reverse_time,chain_"
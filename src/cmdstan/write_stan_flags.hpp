@@ -6,7 +6,7 @@
 
 namespace cmdstan {
 
-void write_stan_flags(stan::callbacks::writer &writer) {
+inline void write_stan_flags(stan::callbacks::writer &writer) {
 #ifdef STAN_THREADS
   writer("STAN_THREADS=true");
 #else
@@ -0,0 +1,95 @@
+#include <cmdstan/return_codes.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+namespace {
+stan::io::stan_csv read_csv(const std::string &filename) {
+  std::ifstream csv_stream(filename);
+  std::stringstream msgs;
+  return stan::io::stan_csv_reader::parse(csv_stream, &msgs);
+}
+}  // namespace
+
+TEST(interface, checkpoint_resume) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "test_model"};
+  std::string model = convert_model_path(model_path);
+  std::string base
+      = model + " id=1 random seed=1234 sample num_warmup=100 num_chains=2"
+        + " checkpoint_every=30";
+
+  // a run of 100 draws extended to 200 from its final checkpoints
+  run_command_output out = run_command(
+      base + " num_samples=100 output file=test/checkpoint_a.csv");
+  ASSERT_EQ(int(cmdstan::return_codes::OK), out.err_code);
+  ASSERT_TRUE(std::ifstream("test/checkpoint_a_checkpoint_1.bin").good());
+  ASSERT_TRUE(std::ifstream("test/checkpoint_a_checkpoint_2.bin").good());
+  out = run_command(base
+                    + " num_samples=200 resume=test/checkpoint_a_checkpoint.bin"
+                    + " output file=test/checkpoint_a.csv");
+  ASSERT_EQ(int(cmdstan::return_codes::OK), out.err_code);
+
+  out = run_command(base
+                    + " num_samples=200 output file=test/checkpoint_b.csv");
+  ASSERT_EQ(int(cmdstan::return_codes::OK), out.err_code);
+
+  for (std::string chain : {"_1.csv", "_2.csv"}) {
+    stan::io::stan_csv resumed = read_csv("test/checkpoint_a" + chain);
+    stan::io::stan_csv single = read_csv("test/checkpoint_b" + chain);
+    ASSERT_EQ(200, resumed.samples.rows());
+    ASSERT_EQ(single.samples.rows(), resumed.samples.rows());
+    ASSERT_EQ(single.samples.cols(), resumed.samples.cols());
+    EXPECT_EQ(single.adaptation.step_size, resumed.adaptation.step_size);
+    for (int i = 0; i < single.samples.size(); ++i)
+      EXPECT_EQ(single.samples(i), resumed.samples(i));
+  }
+
+  // checkpoints only resume a run with the same warmup and thinning
+  out = run_command(model
+                    + " id=1 sample num_warmup=50 num_chains=2"
+                    + " resume=test/checkpoint_a_checkpoint.bin"
+                    + " output file=test/checkpoint_a.csv");
+  EXPECT_EQ(int(cmdstan::return_codes::NOT_OK), out.err_code);
+  out = run_command(model
+                    + " sample checkpoint_every=10 algorithm=hmc engine=static"
+                    + " output file=test/checkpoint_c.csv");
+  EXPECT_EQ(int(cmdstan::return_codes::NOT_OK), out.err_code);
+}
+
+TEST(interface, max_runtime_stop) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "test_model"};
+  std::string model = convert_model_path(model_path);
+
+  // the stepped NUTS sampler writes its timing and the stop reason
+  run_command_output out = run_command(
+      model + " max_runtime=1 sample num_samples=100000000 num_chains=2"
+      + " checkpoint_every=100 output file=test/stopped.csv");
+  EXPECT_EQ(int(cmdstan::return_codes::INTERRUPTED), out.err_code);
+  for (std::string chain : {"_1", "_2"}) {
+    std::ifstream csv_stream("test/stopped" + chain + ".csv");
+    std::stringstream contents;
+    contents << csv_stream.rdbuf();
+    EXPECT_NE(std::string::npos, contents.str().find("Elapsed Time"));
+    EXPECT_NE(std::string::npos,
+              contents.str().find("maximum runtime of 1 seconds exceeded"));
+    EXPECT_TRUE(
+        std::ifstream("test/stopped_checkpoint" + chain + ".bin").good());
+  }
+
+  // other algorithms stop with the same return code
+  out = run_command(model
+                    + " max_runtime=1 sample num_samples=100000000"
+                    + " algorithm=hmc engine=static"
+                    + " output file=test/stopped_static.csv");
+  EXPECT_EQ(int(cmdstan::return_codes::INTERRUPTED), out.err_code);
+}
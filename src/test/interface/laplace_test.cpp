@@ -1,6 +1,8 @@
 #include <test/utility.hpp>
+#include <cmdstan/return_codes.hpp>
 #include <stan/math/prim/fun/Eigen.hpp>
 #include <gtest/gtest.h>
+#include <cstdio>
 
 using cmdstan::test::convert_model_path;
 using cmdstan::test::parse_sample;
@@ -202,3 +204,102 @@ TEST_F(CmdStan, laplace_unconstrain) {
   out = run_command(cmd);
   ASSERT_TRUE(out.hasError);
 }
+
+TEST_F(CmdStan, laplace_reproducible) {
+  // several blocks of draws, which don't depend on the number of threads
+  std::stringstream ss;
+  ss << convert_model_path(multi_normal_model) << " random seed=1234"
+     << " method=laplace mode=" << convert_model_path(multi_normal_mode_csv)
+     << " draws=600 output file=" << convert_model_path(output1_csv);
+  run_command_output out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError);
+  std::vector<std::string> config;
+  std::vector<std::string> header;
+  std::vector<double> values1;
+  parse_sample(convert_model_path(output1_csv), config, header, values1);
+
+  ss.str(std::string());
+  ss << convert_model_path(multi_normal_model) << " random seed=1234"
+#ifdef STAN_THREADS
+     << " num_threads=3"
+#endif
+     << " method=laplace mode=" << convert_model_path(multi_normal_mode_csv)
+     << " draws=600 output file=" << convert_model_path(output2_csv);
+  out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError);
+  std::vector<double> values2;
+  parse_sample(convert_model_path(output2_csv), config, header, values2);
+
+  ASSERT_FALSE(values1.empty());
+  ASSERT_EQ(values1.size(), values2.size());
+  for (size_t n = 0; n < values1.size(); ++n)
+    ASSERT_EQ(values1[n], values2[n]);
+}
+
+TEST_F(CmdStan, laplace_max_runtime) {
+  // the runtime is exceeded before the Hessian is computed
+  std::stringstream ss;
+  ss << convert_model_path(multi_normal_model) << " max_runtime=0.000001"
+     << " method=laplace mode=" << convert_model_path(multi_normal_mode_csv)
+     << " output file=" << convert_model_path(output1_csv);
+  run_command_output out = run_command(ss.str());
+  EXPECT_EQ(int(cmdstan::return_codes::INTERRUPTED), out.err_code);
+  EXPECT_NE(out.output.find("maximum runtime"), std::string::npos);
+}
+
+TEST_F(CmdStan, laplace_hessian_file) {
+  std::vector<std::string> hessian_bin = {"test", "tmp_hessian.bin"};
+  std::remove(convert_model_path(hessian_bin).c_str());
+  std::stringstream ss;
+  ss << convert_model_path(multi_normal_model) << " random seed=1234"
+     << " method=laplace mode=" << convert_model_path(multi_normal_mode_csv)
+     << " draws=100 hessian_file=" << convert_model_path(hessian_bin)
+     << " output file=" << convert_model_path(output1_csv);
+  std::string cmd = ss.str();
+  run_command_output out = run_command(cmd);
+  ASSERT_FALSE(out.hasError);
+  EXPECT_NE(out.output.find("Calculating Hessian"), std::string::npos);
+  std::vector<std::string> config;
+  std::vector<std::string> header;
+  std::vector<double> values1;
+  parse_sample(convert_model_path(output1_csv), config, header, values1);
+
+  out = run_command(cmd);
+  ASSERT_FALSE(out.hasError);
+  EXPECT_EQ(out.output.find("Calculating Hessian"), std::string::npos);
+  EXPECT_NE(out.output.find("Using Hessian from file"), std::string::npos);
+  std::vector<double> values2;
+  parse_sample(convert_model_path(output1_csv), config, header, values2);
+  ASSERT_EQ(values1.size(), values2.size());
+  for (size_t n = 0; n < values1.size(); ++n)
+    ASSERT_EQ(values1[n], values2[n]);
+
+  // a different jacobian setting needs its own Hessian
+  ss.str(std::string());
+  ss << convert_model_path(multi_normal_model) << " random seed=1234"
+     << " method=laplace mode=" << convert_model_path(multi_normal_mode_csv)
+     << " jacobian=0 draws=100 hessian_file="
+     << convert_model_path(hessian_bin)
+     << " output file=" << convert_model_path(output2_csv);
+  out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError);
+  EXPECT_NE(out.output.find("Calculating Hessian"), std::string::npos);
+  out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError);
+  EXPECT_NE(out.output.find("Using Hessian from file"), std::string::npos);
+  out = run_command(cmd);
+  ASSERT_FALSE(out.hasError);
+  EXPECT_NE(out.output.find("Using Hessian from file"), std::string::npos);
+
+  // a Hessian file which can't be written only gives a warning
+  std::vector<std::string> unwritable_bin
+      = {"test", "no_such_dir", "tmp_hessian.bin"};
+  ss.str(std::string());
+  ss << convert_model_path(multi_normal_model) << " random seed=1234"
+     << " method=laplace mode=" << convert_model_path(multi_normal_mode_csv)
+     << " draws=100 hessian_file=" << convert_model_path(unwritable_bin)
+     << " output file=" << convert_model_path(output2_csv);
+  out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError);
+  EXPECT_NE(out.output.find("Can't write Hessian file"), std::string::npos);
+}
@@ -0,0 +1,58 @@
+#include <cmdstan/library.hpp>
+#include <cmdstan/return_codes.hpp>
+#include <stan/callbacks/logger.hpp>
+#include <stan/io/empty_var_context.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+TEST(interface, library_sample) {
+  stan::io::empty_var_context data;
+  auto model = cmdstan::load_model(data, 1234);
+
+  cmdstan::sample_config config;
+  config.num_chains = 2;
+  config.num_samples = 200;
+  config.seed = 1234;
+  stan::callbacks::logger logger;
+  std::vector<cmdstan::buffer_writer> outputs;
+  int return_code = cmdstan::sample(*model, config, {}, {}, logger, outputs);
+  ASSERT_EQ(int(cmdstan::return_codes::OK), return_code);
+  ASSERT_EQ(2, outputs.size());
+  for (const auto &output : outputs) {
+    const auto &names = output.names();
+    EXPECT_EQ("lp__", names[0]);
+    EXPECT_NE(names.end(), std::find(names.begin(), names.end(), "mu1"));
+    EXPECT_EQ(200, output.num_draws());
+    EXPECT_EQ(200 * names.size(), output.draws().size());
+    EXPECT_GT(output.stepsize(), 0);
+    EXPECT_EQ(2, output.inv_metric().size());
+    EXPECT_GT(output.warmup_time(), 0);
+    EXPECT_GT(output.sampling_time(), 0);
+  }
+
+  // the same seed gives the same draws
+  std::vector<cmdstan::buffer_writer> again;
+  cmdstan::sample(*model, config, {}, {}, logger, again);
+  EXPECT_EQ(outputs[1].draws(), again[1].draws());
+
+  // one initial value for each chain, or for all of them
+  std::vector<std::shared_ptr<stan::io::var_context>> inits(
+      3, std::make_shared<stan::io::empty_var_context>());
+  EXPECT_THROW(cmdstan::sample(*model, config, inits, {}, logger, outputs),
+               std::invalid_argument);
+
+  // the thread pool is set up by the first run
+  cmdstan::sample_config threads_config(config);
+  threads_config.num_threads = 2;
+  EXPECT_THROW(
+      cmdstan::sample(*model, threads_config, {}, {}, logger, outputs),
+      std::invalid_argument);
+  threads_config.num_threads = 0;
+  EXPECT_THROW(
+      cmdstan::sample(*model, threads_config, {}, {}, logger, outputs),
+      std::invalid_argument);
+}
@@ -1,8 +1,10 @@
 #include <test/utility.hpp>
 #include <gtest/gtest.h>
+#include <cstdint>
 #include <fstream>
 #include <string>
 #include <stdexcept>
+#include <vector>
 
 using cmdstan::test::convert_model_path;
 using cmdstan::test::multiple_command_separator;
@@ -228,3 +230,72 @@ TEST_F(CmdStan, log_prob_unconstrained_bad_input) {
   run_command_output out = run_command(cmd);
   ASSERT_TRUE(out.hasError);
 }
+
+TEST_F(CmdStan, log_prob_stream_text) {
+  // the model has 19 unconstrained parameters, theta first
+  std::string zeros(18 * 2, ' ');
+  for (size_t i = 1; i < zeros.size(); i += 2)
+    zeros[i] = '0';
+  std::ofstream requests("test/log_prob_requests.txt");
+  requests << "0" << zeros << "\n"
+           << "constrain 0" << zeros << "\n"
+           << "unconstrain 0.5" << zeros << "\n"
+           << "1, 2\n";
+  requests.close();
+
+  std::stringstream ss;
+  ss << convert_model_path(bern_log_prob_model)
+     << " data file=" << convert_model_path(bern_data)
+     << " output file=test/log_prob_stream.csv"
+     << " method=log_prob stream=text < test/log_prob_requests.txt";
+  run_command_output out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError);
+  // the responses are the only output
+  EXPECT_FALSE(std::ifstream("test/log_prob_stream.csv").good());
+  std::string unconstrained = "\n0";
+  for (int i = 0; i < 18; ++i)
+    unconstrained += ",0";
+  EXPECT_NE(std::string::npos, out.output.find("\n0.5,0,0,"));
+  EXPECT_NE(std::string::npos, out.output.find(unconstrained + "\n"));
+  EXPECT_NE(std::string::npos,
+            out.output.find("error: Expected 19 parameter values, found 2"));
+}
+
+TEST_F(CmdStan, log_prob_stream_binary_oversized) {
+  // a request with more values than the model has parameters is
+  // answered with an error and skipped, and the next one is served
+  std::ofstream requests("test/log_prob_requests.bin", std::ios::binary);
+  std::vector<double> values(1000, 0.0);
+  for (std::uint64_t size : {std::uint64_t(1000), std::uint64_t(19)}) {
+    requests.put(0);
+    requests.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    requests.write(reinterpret_cast<const char *>(values.data()),
+                   sizeof(double) * size);
+  }
+  requests.close();
+
+  std::stringstream ss;
+  ss << convert_model_path(bern_log_prob_model)
+     << " data file=" << convert_model_path(bern_data)
+     << " output file=test/log_prob_stream.csv"
+     << " method=log_prob stream=binary < test/log_prob_requests.bin"
+     << " > test/log_prob_responses.bin";
+  run_command_output out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError);
+
+  std::ifstream responses("test/log_prob_responses.bin", std::ios::binary);
+  std::uint64_t size = 0;
+  EXPECT_EQ(1, responses.get());
+  responses.read(reinterpret_cast<char *>(&size), sizeof(size));
+  std::string msg(size, ' ');
+  responses.read(&msg[0], size);
+  EXPECT_EQ("Expected at most 19 parameter values, found 1000", msg);
+  EXPECT_EQ(0, responses.get());
+  responses.read(reinterpret_cast<char *>(&size), sizeof(size));
+  EXPECT_EQ(20u, size);
+  values.resize(size);
+  responses.read(reinterpret_cast<char *>(values.data()),
+                 sizeof(double) * size);
+  EXPECT_TRUE(responses.good());
+  EXPECT_EQ(EOF, responses.get());
+}
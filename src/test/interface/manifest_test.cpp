@@ -0,0 +1,95 @@
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+TEST(interface, manifest_jobs) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "bern_log_prob_model"};
+  std::string model = convert_model_path(model_path);
+  std::string data = convert_model_path(
+      std::vector<std::string>{"src", "test", "test-models", "bern.data.json"});
+
+  std::ofstream manifest("test/manifest.txt");
+  manifest << "# data seed prefix\n"
+           << data << " 1 test/manifest_a\n"
+           << "\n"
+           << data << " 2 test/manifest_b\n"
+           << "no_such_file.json 3 test/manifest_c\n";
+  manifest.close();
+
+#ifdef STAN_THREADS
+  std::string num_threads = "2";
+#else
+  std::string num_threads = "1";
+#endif
+  run_command_output out = run_command(
+      model + " manifest file=test/manifest.txt num_threads=" + num_threads
+      + " sample num_samples=100 output refresh=0");
+  // one job fails, so the run fails
+  EXPECT_EQ(1, out.err_code) << out.output;
+  EXPECT_NE(std::string::npos, out.output.find("Ran 2 of 3 jobs"));
+  // the console output of the jobs is discarded
+  EXPECT_EQ(std::string::npos, out.output.find("Elapsed Time"));
+  EXPECT_TRUE(std::ifstream("test/manifest_a.csv").good());
+  EXPECT_TRUE(std::ifstream("test/manifest_b.csv").good());
+
+  std::ifstream index_stream("test/manifest_index.csv");
+  std::vector<std::string> rows;
+  std::string row;
+  while (std::getline(index_stream, row))
+    rows.push_back(row);
+  ASSERT_EQ(4, rows.size());
+  EXPECT_EQ("job,data_file,seed,output_file,return_code,elapsed,error",
+            rows[0]);
+  EXPECT_EQ(0, rows[1].find("1," + data + ",1,test/manifest_a.csv,0,"));
+  EXPECT_EQ(0, rows[2].find("2," + data + ",2,test/manifest_b.csv,0,"));
+  EXPECT_EQ(0, rows[3].find("3,no_such_file.json,3,test/manifest_c.csv,1,"));
+
+  std::ifstream csv_a("test/manifest_a.csv");
+  std::stringstream contents;
+  contents << csv_a.rdbuf();
+  EXPECT_NE(std::string::npos, contents.str().find("seed = 1"));
+}
+
+TEST(interface, manifest_num_threads) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "bern_log_prob_model"};
+  std::string model = convert_model_path(model_path);
+  run_command_output out = run_command(
+      model + " manifest file=test/manifest.txt num_threads=-3 sample");
+  EXPECT_TRUE(out.hasError);
+  EXPECT_NE(std::string::npos,
+            out.output.find("-3 is not a valid value for \"num_threads\""));
+}
+
+TEST(interface, manifest_log_prob_stream) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "bern_log_prob_model"};
+  std::string model = convert_model_path(model_path);
+  std::string data = convert_model_path(
+      std::vector<std::string>{"src", "test", "test-models", "bern.data.json"});
+  std::ofstream manifest("test/manifest_stream.txt");
+  manifest << data << " 1 test/manifest_stream_a\n"
+           << data << " 2 test/manifest_stream_b\n";
+  manifest.close();
+
+  // jobs share standard input and output, so they can't stream
+  run_command_output out = run_command(
+      model + " manifest file=test/manifest_stream.txt"
+      + " method=log_prob stream=text < " + data);
+  EXPECT_EQ(1, out.err_code) << out.output;
+  EXPECT_NE(std::string::npos, out.output.find("Ran 0 of 2 jobs"));
+  std::ifstream index_stream("test/manifest_stream_index.csv");
+  std::stringstream index;
+  index << index_stream.rdbuf();
+  EXPECT_NE(std::string::npos,
+            index.str().find(
+                "log_prob stream mode can't be run by serve or manifest"));
+}
@@ -90,3 +90,48 @@ TEST(StanUiCommand, metric_file_test) {
     }
   }
 }
+
+TEST(StanUiCommand, warm_start_test) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "test_model"};
+  std::string command = convert_model_path(model_path)
+                        + " method=sample num_samples=10 num_warmup=200"
+                        + " output file=test/warm_start.csv";
+  run_command_output out = run_command(command);
+  ASSERT_EQ(int(cmdstan::return_codes::OK), out.err_code);
+
+  auto adaptation = [](const std::string &filename) {
+    std::ifstream csv_stream(filename);
+    std::stringstream msgs;
+    stan::io::stan_csv csv
+        = stan::io::stan_csv_reader::parse(csv_stream, &msgs);
+    return csv.adaptation;
+  };
+  auto warm = adaptation("test/warm_start.csv");
+  ASSERT_GT(warm.step_size, 0);
+
+  command = convert_model_path(model_path)
+            + " method=sample num_samples=10 num_warmup=0"
+            + " adapt warm_start=test/warm_start.csv"
+            + " output file=test/output.csv";
+  out = run_command(command);
+  ASSERT_EQ(int(cmdstan::return_codes::OK), out.err_code);
+  auto restarted = adaptation("test/output.csv");
+  EXPECT_FLOAT_EQ(warm.step_size, restarted.step_size);
+  ASSERT_EQ(warm.metric.size(), restarted.metric.size());
+  for (int i = 0; i < warm.metric.size(); ++i)
+    EXPECT_FLOAT_EQ(warm.metric(i), restarted.metric(i));
+
+  command = convert_model_path(model_path)
+            + " method=sample num_samples=10 num_warmup=50"
+            + " adapt warm_start=test/warm_start.csv"
+            + " output file=test/output.csv";
+  out = run_command(command);
+  EXPECT_EQ(int(cmdstan::return_codes::OK), out.err_code);
+
+  command = convert_model_path(model_path)
+            + " method=sample adapt warm_start=test/missing.csv"
+            + " output file=test/output.csv";
+  out = run_command(command);
+  EXPECT_EQ(int(cmdstan::return_codes::NOT_OK), out.err_code);
+}
@@ -72,3 +72,102 @@ TEST(interface, output_multi) {
     EXPECT_TRUE(diag_file.good());
   }
 }
+
+TEST(interface, output_multi_static) {
+  std::vector<std::string> model_path;
+  model_path.push_back("src");
+  model_path.push_back("test");
+  model_path.push_back("test-models");
+  model_path.push_back("test_model");
+
+  std::string command
+      = cmdstan::test::convert_model_path(model_path)
+        + " id=20 sample num_warmup=200 num_samples=10 num_chains=3"
+        + " algorithm=hmc engine=static metric=diag_e random seed=1234"
+        + " output file=" + cmdstan::test::convert_model_path(model_path)
+        + "_static.csv";
+
+  cmdstan::test::run_command_output out = cmdstan::test::run_command(command);
+  EXPECT_EQ(int(stan::services::error_codes::OK), out.err_code);
+  EXPECT_FALSE(out.hasError);
+  std::vector<Eigen::MatrixXd> draws;
+  for (int id = 20; id < 23; ++id) {
+    std::string csv_file = cmdstan::test::convert_model_path(model_path)
+                           + "_static_" + std::to_string(id) + ".csv";
+    std::vector<std::string> filenames;
+    filenames.push_back(csv_file);
+    stan::io::stan_csv_metadata metadata;
+    Eigen::VectorXd warmup_times(filenames.size());
+    Eigen::VectorXd sampling_times(filenames.size());
+    Eigen::VectorXi thin(filenames.size());
+    stan::mcmc::chains<> chains = parse_csv_files(
+        filenames, metadata, warmup_times, sampling_times, thin, &std::cout);
+    EXPECT_EQ(id, static_cast<int>(metadata.chain_id));
+    EXPECT_EQ("static", metadata.engine);
+    EXPECT_EQ(10, chains.num_kept_samples(0));
+    draws.push_back(chains.samples(0));
+  }
+  // each chain has its own RNG stream
+  EXPECT_FALSE(draws[0].isApprox(draws[1]));
+  EXPECT_FALSE(draws[1].isApprox(draws[2]));
+}
+
+TEST(interface, output_multi_fixed_param) {
+  std::vector<std::string> model_path;
+  model_path.push_back("src");
+  model_path.push_back("test");
+  model_path.push_back("test-models");
+  model_path.push_back("test_model");
+
+  std::string command
+      = cmdstan::test::convert_model_path(model_path)
+        + " sample algorithm=fixed_param num_samples=10 num_chains=2"
+        + " output file=" + cmdstan::test::convert_model_path(model_path)
+        + "_fixed.csv";
+
+  cmdstan::test::run_command_output out = cmdstan::test::run_command(command);
+  EXPECT_EQ(int(stan::services::error_codes::OK), out.err_code);
+  EXPECT_FALSE(out.hasError);
+  for (int id = 1; id < 3; ++id) {
+    std::string csv_file = cmdstan::test::convert_model_path(model_path)
+                           + "_fixed_" + std::to_string(id) + ".csv";
+    std::ifstream csv(csv_file);
+    EXPECT_TRUE(csv.good());
+  }
+}
+
+TEST(interface, output_multi_early_stop) {
+  std::vector<std::string> model_path;
+  model_path.push_back("src");
+  model_path.push_back("test");
+  model_path.push_back("test-models");
+  model_path.push_back("test_model");
+
+  std::string command
+      = cmdstan::test::convert_model_path(model_path)
+        + " sample num_warmup=200 num_samples=5000 num_chains=4"
+        + " early_stop engaged=1 ess=400 check_every=100"
+        + " random seed=1234 output file="
+        + cmdstan::test::convert_model_path(model_path) + "_stop.csv";
+
+  cmdstan::test::run_command_output out = cmdstan::test::run_command(command);
+  EXPECT_EQ(int(stan::services::error_codes::OK), out.err_code);
+  EXPECT_FALSE(out.hasError);
+  for (int id = 1; id < 5; ++id) {
+    std::string csv_file = cmdstan::test::convert_model_path(model_path)
+                           + "_stop_" + std::to_string(id) + ".csv";
+    std::ifstream csv_stream(csv_file);
+    std::stringstream contents;
+    contents << csv_stream.rdbuf();
+    EXPECT_NE(std::string::npos,
+              contents.str().find("# Sampling stopped early after"));
+    csv_stream.clear();
+    csv_stream.seekg(0);
+    std::stringstream msgs;
+    stan::io::stan_csv csv
+        = stan::io::stan_csv_reader::parse(csv_stream, &msgs);
+    EXPECT_GE(csv.samples.rows(), 100);
+    EXPECT_LT(csv.samples.rows(), 5000);
+    EXPECT_EQ(0, csv.samples.rows() % 100);
+  }
+}
@@ -178,3 +178,41 @@ TEST_F(CmdStan, optimize_jacobian_adjust) {
 
   ASSERT_NEAR(3.3, values2[1], 0.01);
 }
+
+TEST_F(CmdStan, optimize_multi) {
+  std::stringstream ss;
+  ss << convert_model_path(optimization_model)
+     << " output file=" << convert_model_path(output1_csv)
+     << " method=optimize num_chains=3 2>&1";
+  std::string cmd = ss.str();
+  run_command_output out = run_command(cmd);
+  ASSERT_EQ(0, out.err_code);
+
+  std::vector<std::string> config;
+  std::vector<std::string> header;
+  std::vector<double> values;
+  for (int i = 1; i <= 3; ++i) {
+    std::vector<std::string> output_csv
+        = {"test", "output1_" + std::to_string(i) + ".csv"};
+    config.clear();
+    header.clear();
+    values.clear();
+    parse_sample(convert_model_path(output_csv), config, header, values);
+    ASSERT_NEAR(0, values[0], 0.00001);
+    EXPECT_FLOAT_EQ(1, values[1]);
+  }
+
+  // combined output holds the best mode
+  config.clear();
+  header.clear();
+  values.clear();
+  parse_sample(convert_model_path(output1_csv), config, header, values);
+  std::string best = "best of 3 runs";
+  EXPECT_NE(idx_first_match(config, best), -1);
+  ASSERT_EQ(5, values.size());
+  ASSERT_NEAR(0, values[0], 0.00001);
+  EXPECT_FLOAT_EQ(1, values[1]);
+  EXPECT_FLOAT_EQ(100, values[2]);
+  EXPECT_FLOAT_EQ(10000, values[3]);
+  EXPECT_FLOAT_EQ(1000000, values[4]);
+}
@@ -0,0 +1,117 @@
+#include <cmdstan/output_stream.hpp>
+#include <stan/io/stan_csv_reader.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+class CmdStan : public testing::Test {
+ public:
+  void SetUp() {
+    model = convert_model_path(
+        std::vector<std::string>{"src", "test", "test-models", "test_model"});
+    csv_file = convert_model_path(
+        std::vector<std::string>{"test", "output_stream.csv"});
+    framed_file = convert_model_path(
+        std::vector<std::string>{"test", "output_stream.bin"});
+  }
+
+  std::string model;
+  std::string csv_file;
+  std::string framed_file;
+};
+
+stan::io::stan_csv parse_csv(std::istream &in) {
+  std::stringstream msgs;
+  return stan::io::stan_csv_reader::parse(in, &msgs);
+}
+
+TEST_F(CmdStan, output_stream_stdout) {
+  run_command_output out = run_command("(" + model
+                                       + " sample output file=- > "
+                                       + csv_file + ")");
+  ASSERT_FALSE(out.hasError) << out.output;
+  // the console output goes to standard error
+  EXPECT_NE(std::string::npos, out.output.find("Iteration: 2000 / 2000"));
+  std::ifstream csv_stream(csv_file);
+  stan::io::stan_csv csv = parse_csv(csv_stream);
+  EXPECT_EQ("lp__", csv.header[0]);
+  EXPECT_EQ(1000, csv.samples.rows());
+}
+
+TEST_F(CmdStan, output_stream_framed) {
+  run_command_output out = run_command(
+      "(" + model + " sample num_chains=3 id=4 output file=- > "
+      + framed_file + ")");
+  ASSERT_FALSE(out.hasError) << out.output;
+  std::ifstream framed(framed_file, std::ios::binary);
+  std::string magic(cmdstan::framed_stream_magic_size, ' ');
+  framed.read(&magic[0], magic.size());
+  EXPECT_EQ(cmdstan::framed_stream_magic, magic);
+  std::map<std::uint32_t, std::string> chains;
+  std::uint32_t chain_id;
+  std::string payload;
+  while (cmdstan::read_frame(framed, chain_id, payload)) {
+    EXPECT_EQ('\n', payload.back());
+    chains[chain_id] += payload;
+  }
+  ASSERT_EQ(3, chains.size());
+  for (std::uint32_t id = 4; id < 7; ++id) {
+    std::stringstream csv_stream(chains[id]);
+    stan::io::stan_csv csv = parse_csv(csv_stream);
+    EXPECT_EQ(id, csv.metadata.chain_id);
+    EXPECT_EQ(1000, csv.samples.rows());
+  }
+}
+
+TEST_F(CmdStan, output_stream_unsupported) {
+  run_command_output out = run_command(
+      model + " pathfinder output file=- refresh=0");
+  EXPECT_TRUE(out.hasError);
+  out = run_command(model
+                    + " sample num_chains=2 checkpoint_every=100 "
+                      "output file=-");
+  EXPECT_TRUE(out.hasError);
+}
+
+#ifndef _WIN32
+TEST_F(CmdStan, output_stream_named_pipe) {
+  std::string pipe = "test/output_stream.fifo";
+  unlink(pipe.c_str());
+  ASSERT_EQ(0, mkfifo(pipe.c_str(), 0600));
+  std::string draws;
+  std::thread reader([&]() {
+    std::ifstream in(pipe);
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    draws = buffer.str();
+  });
+  run_command_output out
+      = run_command(model + " sample num_samples=500 output file=" + pipe);
+  // release the reader if the sampler failed before opening the pipe
+  int fd = open(pipe.c_str(), O_WRONLY | O_NONBLOCK);
+  if (fd >= 0)
+    close(fd);
+  reader.join();
+  unlink(pipe.c_str());
+  ASSERT_FALSE(out.hasError) << out.output;
+  std::stringstream csv_stream(draws);
+  stan::io::stan_csv csv = parse_csv(csv_stream);
+  EXPECT_EQ(500, csv.samples.rows());
+}
+#endif
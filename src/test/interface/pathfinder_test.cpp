@@ -241,3 +241,26 @@ TEST_F(CmdStan, pathfinder_lbfgs_iterations) {
   EXPECT_EQ(1, count_matches("\"3\":{\"iter\":3,", output));
   EXPECT_EQ(0, count_matches("\"4\":{\"iter\":4,", output));
 }
+
+TEST_F(CmdStan, pathfinder_init_sample) {
+  std::stringstream ss;
+  ss << convert_model_path(eight_schools_model)
+     << " data file=" << convert_model_path(eight_schools_data)
+     << " output refresh=0 file=" << convert_model_path(output_csv)
+     << " method=sample num_warmup=100 num_samples=100 num_chains=2"
+     << " pathfinder_init=1 2>&1";
+  run_command_output out = run_command(ss.str());
+  ASSERT_FALSE(out.hasError);
+  EXPECT_NE(out.output.find("Running pathfinder"), std::string::npos);
+
+  for (int i = 1; i <= 2; ++i) {
+    std::string chain_csv = convert_model_path(arg_output) + "_"
+                            + std::to_string(i) + ".csv";
+    std::vector<std::string> config;
+    std::vector<std::string> header;
+    std::vector<double> values;
+    parse_sample(chain_csv, config, header, values);
+    EXPECT_FALSE(values.empty());
+    std::remove(chain_csv.c_str());
+  }
+}
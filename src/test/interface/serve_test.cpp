@@ -0,0 +1,130 @@
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+TEST(interface, serve_jobs) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "bern_log_prob_model"};
+  std::string model = convert_model_path(model_path);
+  // forward slashes, which need no escaping in JSON, work on all platforms
+  std::string data = "src/test/test-models/bern.data.json";
+
+  std::ofstream requests("test/serve_jobs.jsonl");
+  requests << "{\"id\": \"a\", \"args\": [\"optimize\", \"data\", \"file="
+           << data << "\", \"output\", \"file=test/serve_a.csv\"]}\n"
+           << "{\"id\": 2, \"args\": \"sample num_samples=100 data file="
+           << data << " output file=test/serve_b.csv\"}\n"
+           << "{\"id\": \"c\", \"args\": [\"sample\", \"no_such_arg=1\"]}\n"
+           << "\n"
+           << "not a request\n";
+  requests.close();
+
+#ifdef STAN_THREADS
+  std::string num_threads = "2";
+#else
+  std::string num_threads = "1";
+#endif
+  run_command_output out = run_command(model + " serve num_threads="
+                                       + num_threads
+                                       + " < test/serve_jobs.jsonl");
+  ASSERT_FALSE(out.hasError) << out.output;
+  EXPECT_NE(std::string::npos,
+            out.output.find("{\"id\":\"a\",\"return_code\":0,"));
+  EXPECT_NE(std::string::npos,
+            out.output.find("{\"id\":\"2\",\"return_code\":0,"));
+  EXPECT_NE(std::string::npos,
+            out.output.find("{\"id\":\"c\",\"return_code\":1,"));
+  EXPECT_NE(std::string::npos,
+            out.output.find("\"error\":\"Job request is not a JSON object\""));
+  // the console output of the jobs is not mixed with the responses
+  EXPECT_EQ(std::string::npos, out.output.find("Iteration:"));
+  EXPECT_TRUE(std::ifstream("test/serve_a.csv").good());
+  EXPECT_TRUE(std::ifstream("test/serve_b.csv").good());
+}
+
+TEST(interface, serve_num_threads) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "bern_log_prob_model"};
+  std::string model = convert_model_path(model_path);
+  run_command_output out
+      = run_command(model + " serve num_threads=two < test/serve_jobs.jsonl");
+  EXPECT_TRUE(out.hasError);
+  EXPECT_NE(std::string::npos,
+            out.output.find("two is not a valid value for \"num_threads\""));
+#ifndef STAN_THREADS
+  // without STAN_THREADS the jobs would share one autodiff stack
+  out = run_command(model + " serve num_threads=2 < test/serve_jobs.jsonl");
+  EXPECT_TRUE(out.hasError);
+#else
+  // jobs run on the thread pool of the server
+  std::ofstream requests("test/serve_threads.jsonl");
+  requests << "{\"id\": \"a\", \"args\": \"num_threads=3 sample "
+           << "data file=src/test/test-models/bern.data.json "
+           << "output file=test/serve_threads.csv\"}\n";
+  requests.close();
+  out = run_command(model + " serve num_threads=2 < test/serve_threads.jsonl");
+  ASSERT_FALSE(out.hasError) << out.output;
+  EXPECT_NE(std::string::npos,
+            out.output.find("{\"id\":\"a\",\"return_code\":1,"));
+  EXPECT_NE(std::string::npos,
+            out.output.find("num_threads=3 differs from num_threads=2"));
+#endif
+}
+
+TEST(interface, serve_profiled_model) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "profiled"};
+  std::string model = convert_model_path(model_path);
+  std::ofstream requests("test/serve_profiled.jsonl");
+  requests << "{\"id\": \"a\", \"args\": \"sample num_samples=10 "
+           << "output file=test/serve_profiled.csv\"}\n";
+  requests.close();
+
+  // the profiling data of the process would mix the jobs
+  run_command_output out
+      = run_command(model + " serve < test/serve_profiled.jsonl");
+  ASSERT_FALSE(out.hasError) << out.output;
+  EXPECT_NE(std::string::npos,
+            out.output.find("{\"id\":\"a\",\"return_code\":1,"));
+  EXPECT_NE(std::string::npos,
+            out.output.find("Models with profile blocks can't be run"));
+}
+
+TEST(interface, serve_model_cache) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "printer"};
+  std::string model = convert_model_path(model_path);
+  std::string job = "sample num_warmup=10 num_samples=10 ";
+  std::ofstream requests("test/serve_cache.jsonl");
+  requests << "{\"id\": 1, \"args\": \"" << job
+           << "random seed=5 output file=test/serve_cache_1.csv\"}\n"
+           << "{\"id\": 2, \"args\": \"" << job
+           << "random seed=5 output file=test/serve_cache_2.csv\"}\n"
+           << "{\"id\": 3, \"args\": \"" << job
+           << "output file=test/serve_cache_3.csv\"}\n";
+  requests.close();
+  std::remove("test/serve_cache.log");
+
+  run_command_output out = run_command(
+      model + " serve log=test/serve_cache.log < test/serve_cache.jsonl");
+  ASSERT_FALSE(out.hasError) << out.output;
+  // transformed data prints once per constructed model: the second job
+  // reuses the model of the first, the third, without a seed, doesn't
+  // use the cache
+  std::ifstream log_stream("test/serve_cache.log");
+  std::stringstream log;
+  log << log_stream.rdbuf();
+  size_t constructed = 0;
+  for (size_t pos = log.str().find("x=2"); pos != std::string::npos;
+       pos = log.str().find("x=2", pos + 1))
+    ++constructed;
+  EXPECT_EQ(2, constructed);
+}
@@ -0,0 +1,45 @@
+#include <stan/io/stan_csv_reader.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+#ifndef _WIN32
+stan::io::stan_csv read_csv(const std::string &file) {
+  std::ifstream stream(file);
+  std::stringstream msgs;
+  return stan::io::stan_csv_reader::parse(stream, &msgs);
+}
+
+TEST(interface, shared_model_driver) {
+  std::string driver
+      = convert_model_path(std::vector<std::string>{"bin", "cmdstan_driver"});
+  std::string model = convert_model_path(
+      std::vector<std::string>{"src", "test", "test-models", "test_model"});
+  std::string args = " sample num_warmup=200 num_samples=200 random seed=1234"
+                     " output file=";
+
+  run_command_output out = run_command(driver + " " + model + "_model.so"
+                                       + args + "test/shared_model.csv");
+  ASSERT_FALSE(out.hasError) << out.output;
+  out = run_command(model + args + "test/linked_model.csv");
+  ASSERT_FALSE(out.hasError) << out.output;
+
+  // the model library samples exactly as the model executable
+  stan::io::stan_csv shared = read_csv("test/shared_model.csv");
+  stan::io::stan_csv linked = read_csv("test/linked_model.csv");
+  EXPECT_EQ(linked.header, shared.header);
+  ASSERT_EQ(200, shared.samples.rows());
+  EXPECT_TRUE(linked.samples == shared.samples);
+
+  out = run_command(driver + " " + model + args + "test/not_a_library.csv");
+  EXPECT_TRUE(out.hasError);
+  EXPECT_NE(std::string::npos, out.output.find("Can't load model library"));
+}
+#endif
@@ -0,0 +1,143 @@
+#include <cmdstan/shm_ring_buffer.hpp>
+#include <test/utility.hpp>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using cmdstan::test::convert_model_path;
+using cmdstan::test::run_command;
+using cmdstan::test::run_command_output;
+
+#ifndef _WIN32
+TEST(shm_ring_buffer, throughput) {
+  const std::string name = "/cmdstan_shm_throughput_test";
+  const size_t num_cols = 16;
+  const std::uint64_t num_rows = 2000000;
+  std::vector<std::string> names;
+  for (size_t n = 0; n < num_cols; ++n)
+    names.push_back("x." + std::to_string(n + 1));
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    auto writer = std::make_unique<cmdstan::shm_ring_writer>(name, 1 << 16);
+    (*writer)(names);
+    std::thread consumer([&]() {
+      cmdstan::shm_ring_reader reader(name);
+      EXPECT_EQ(names, reader.names());
+      std::vector<double> rows;
+      std::uint64_t num_read = 0;
+      double last = -1;
+      bool in_order = true;
+      while (true) {
+        bool finished = reader.finished();
+        rows.clear();
+        size_t n = reader.read(rows);
+        for (size_t m = 0; m < n; ++m) {
+          // each row holds its index, plus the column in the others
+          in_order = in_order && rows[m * num_cols] > last
+                     && rows[m * num_cols + num_cols - 1]
+                            == rows[m * num_cols] + num_cols - 1;
+          last = rows[m * num_cols];
+        }
+        num_read += n;
+        if (n == 0 && finished)
+          break;
+      }
+      EXPECT_TRUE(in_order);
+      EXPECT_EQ(num_rows, num_read + reader.lost());
+      EXPECT_EQ(num_rows - 1, last);
+      std::cout << "read " << num_read << " rows, lost " << reader.lost()
+                << std::endl;
+    });
+    std::vector<double> row(num_cols);
+    for (std::uint64_t m = 0; m < num_rows; ++m) {
+      for (size_t n = 0; n < num_cols; ++n)
+        row[n] = m + n;
+      (*writer)(row);
+    }
+    // the writer marks the buffer finished when it is destroyed
+    writer.reset();
+    consumer.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << "published " << num_rows / seconds << " rows of " << num_cols
+            << " doubles per second" << std::endl;
+  cmdstan::shm_ring_reader::unlink(name);
+}
+
+TEST(shm_ring_buffer, overwritten_rows) {
+  // a small buffer, so that the writer keeps overtaking the reader
+  const std::string name = "/cmdstan_shm_overwrite_test";
+  const size_t num_cols = 64;
+  const std::uint64_t num_rows = 200000;
+  std::vector<std::string> names;
+  for (size_t n = 0; n < num_cols; ++n)
+    names.push_back("x." + std::to_string(n + 1));
+
+  auto writer = std::make_unique<cmdstan::shm_ring_writer>(name, 3);
+  (*writer)(names);
+  std::thread consumer([&]() {
+    cmdstan::shm_ring_reader reader(name);
+    std::vector<double> rows;
+    std::uint64_t num_read = 0;
+    std::uint64_t num_torn = 0;
+    while (true) {
+      bool finished = reader.finished();
+      rows.clear();
+      size_t n = reader.read(rows, 2);
+      for (size_t m = 0; m < n; ++m)
+        for (size_t k = 1; k < num_cols; ++k)
+          if (rows[m * num_cols + k] != rows[m * num_cols] + k)
+            ++num_torn;
+      num_read += n;
+      if (n == 0 && finished)
+        break;
+    }
+    // every row delivered is a whole row written by the writer
+    EXPECT_EQ(0, num_torn);
+    EXPECT_EQ(num_rows, num_read + reader.lost());
+  });
+  std::vector<double> row(num_cols);
+  for (std::uint64_t m = 0; m < num_rows; ++m) {
+    for (size_t n = 0; n < num_cols; ++n)
+      row[n] = m + n;
+    (*writer)(row);
+  }
+  writer.reset();
+  consumer.join();
+  cmdstan::shm_ring_reader::unlink(name);
+}
+
+TEST(shm_ring_buffer, sampler_output) {
+  std::vector<std::string> model_path
+      = {"src", "test", "test-models", "test_model"};
+  std::string model = convert_model_path(model_path);
+  const std::string name = "/cmdstan_shm_sampler_test";
+  run_command_output out = run_command(
+      model + " sample num_samples=1000 num_chains=2 output file=test/shm.csv"
+      + " shm=cmdstan_shm_sampler_test");
+  ASSERT_FALSE(out.hasError) << out.output;
+  for (std::string chain : {"_1", "_2"}) {
+    cmdstan::shm_ring_reader reader(name + chain);
+    EXPECT_TRUE(reader.finished());
+    EXPECT_EQ("lp__", reader.names()[0]);
+    EXPECT_EQ("mu2", reader.names().back());
+    std::vector<double> rows;
+    EXPECT_EQ(1000, reader.read(rows));
+    EXPECT_EQ(0, reader.lost());
+    cmdstan::shm_ring_reader::unlink(name + chain);
+  }
+
+  // only the NUTS sampler with a diagonal metric publishes draws
+  out = run_command(model + " sample algorithm=hmc metric=dense_e"
+                    + " output file=test/shm.csv shm=cmdstan_shm_dense");
+  EXPECT_TRUE(out.hasError);
+}
+#endif
@@ -1,7 +1,15 @@
+#include <cmdstan/stansummary_autocorr.hpp>
+#include <cmdstan/stansummary_cache.hpp>
 #include <cmdstan/stansummary_helper.hpp>
+#include <cmdstan/summary_draws.hpp>
 #include <test/utility.hpp>
 #include <stan/io/ends_with.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <fstream>
+#include <limits>
+#include <numeric>
 #include <sstream>
 #include <boost/algorithm/string.hpp>
 #include <gtest/gtest.h>
@@ -683,3 +691,430 @@ TEST(CommandStansummary, check_csv_output_include_param) {
   if (return_code != 0)
     FAIL();
 }
+
+TEST(CommandStansummary, summary_cache) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::string csv_file = "src" + path_separator + "test" + path_separator
+                         + "interface" + path_separator + "example_output"
+                         + path_separator + "bernoulli_chain_1.csv";
+  std::string cache_file = "src" + path_separator + "test" + path_separator
+                           + "interface" + path_separator + "example_output"
+                           + path_separator + "tmp_test_summary_cache.bin";
+  std::vector<std::string> filenames;
+  filenames.push_back(csv_file);
+  std::vector<std::string> pcts = {"5", "50", "95"};
+  Eigen::VectorXd probs = percentiles_to_probs(pcts);
+
+  chains_summary summary;
+  summary.warmup_times.resize(filenames.size());
+  summary.sampling_times.resize(filenames.size());
+  summary.thin.resize(filenames.size());
+  stan::mcmc::chains<> chains = parse_csv_files(
+      filenames, summary.metadata, summary.warmup_times,
+      summary.sampling_times, summary.thin, &std::cout);
+  init_summary(chains, get_header(pcts).size(), summary);
+  std::vector<int> all_idxes(chains.num_params());
+  std::iota(all_idxes.begin(), all_idxes.end(), 0);
+  get_stats(chains, probs, all_idxes, summary);
+  cmdstan::write_summary_cache(cache_file, filenames, pcts, false, summary);
+
+  chains_summary cached;
+  ASSERT_TRUE(
+      cmdstan::read_summary_cache(cache_file, filenames, pcts, false, cached));
+  EXPECT_EQ(summary.param_names, cached.param_names);
+  EXPECT_EQ(summary.metadata.model, cached.metadata.model);
+  EXPECT_EQ(summary.metadata.algorithm, cached.metadata.algorithm);
+  EXPECT_EQ(summary.metadata.engine, cached.metadata.engine);
+  EXPECT_EQ(summary.num_kept_samples, cached.num_kept_samples);
+  EXPECT_EQ(summary.num_warmup, cached.num_warmup);
+  EXPECT_EQ(summary.warmup_times, cached.warmup_times);
+  EXPECT_EQ(summary.sampling_times, cached.sampling_times);
+  EXPECT_EQ(summary.thin, cached.thin);
+  EXPECT_EQ(summary.stats, cached.stats);
+
+  // cache is keyed on the percentiles, the precision, and the input files
+  std::vector<std::string> other_pcts = {"10", "50", "90"};
+  EXPECT_FALSE(cmdstan::read_summary_cache(cache_file, filenames, other_pcts,
+                                           false, cached));
+  EXPECT_FALSE(
+      cmdstan::read_summary_cache(cache_file, filenames, pcts, true, cached));
+  filenames.push_back(csv_file);
+  EXPECT_FALSE(
+      cmdstan::read_summary_cache(cache_file, filenames, pcts, false, cached));
+  EXPECT_EQ(0, std::remove(cache_file.c_str()));
+
+  EXPECT_FALSE(
+      cmdstan::read_summary_cache(cache_file, filenames, pcts, false, cached));
+}
+
+TEST(CommandStansummary, check_cached_output) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::string command = "bin" + path_separator + "stansummary";
+  std::string csv_file = "src" + path_separator + "test" + path_separator
+                         + "interface" + path_separator + "example_output"
+                         + path_separator + "eight_schools_output.csv";
+  std::string cache_file = "src" + path_separator + "test" + path_separator
+                           + "interface" + path_separator + "example_output"
+                           + path_separator + "tmp_test_summary_cache.bin";
+  std::string arg_cache_file = "--cache_file " + cache_file;
+
+  run_command_output expected = run_command(command + " " + csv_file);
+  ASSERT_FALSE(expected.hasError)
+      << "\"" << expected.command << "\" quit with an error";
+
+  // first run computes and saves statistics, second run reads them
+  for (int run = 0; run < 2; ++run) {
+    run_command_output out
+        = run_command(command + " " + arg_cache_file + " " + csv_file);
+    ASSERT_FALSE(out.hasError)
+        << "\"" << out.command << "\" quit with an error";
+    EXPECT_EQ(expected.output, out.output);
+  }
+
+  expected = run_command(command + " -i mu " + csv_file);
+  ASSERT_FALSE(expected.hasError)
+      << "\"" << expected.command << "\" quit with an error";
+  run_command_output out
+      = run_command(command + " -i mu " + arg_cache_file + " " + csv_file);
+  ASSERT_FALSE(out.hasError) << "\"" << out.command << "\" quit with an error";
+  EXPECT_EQ(expected.output, out.output);
+
+  EXPECT_EQ(0, std::remove(cache_file.c_str()));
+}
+
+TEST(CommandStansummary, single_precision_stats) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::vector<std::string> pcts = {"5", "50", "95"};
+  Eigen::VectorXd probs = percentiles_to_probs(pcts);
+  std::vector<std::string> filenames;
+  filenames.push_back("src" + path_separator + "test" + path_separator
+                      + "interface" + path_separator + "example_output"
+                      + path_separator + "mix_output.1.csv");
+  filenames.push_back("src" + path_separator + "test" + path_separator
+                      + "interface" + path_separator + "example_output"
+                      + path_separator + "mix_output.2.csv");
+  stan::io::stan_csv_metadata metadata;
+  Eigen::VectorXd warmup_times(filenames.size());
+  Eigen::VectorXd sampling_times(filenames.size());
+  Eigen::VectorXi thin(filenames.size());
+
+  stan::mcmc::chains<> chains = parse_csv_files(
+      filenames, metadata, warmup_times, sampling_times, thin, &std::cout);
+  auto draws = parse_csv_files<cmdstan::summary_draws<float>>(
+      filenames, metadata, warmup_times, sampling_times, thin, &std::cout);
+  ASSERT_EQ(chains.num_chains(), draws.num_chains());
+  ASSERT_EQ(chains.num_params(), draws.num_params());
+  EXPECT_EQ(chains.num_samples(), draws.num_samples());
+  for (int chain = 0; chain < chains.num_chains(); ++chain) {
+    EXPECT_EQ(chains.num_kept_samples(chain), draws.num_kept_samples(chain));
+    EXPECT_EQ(chains.warmup(chain), draws.warmup(chain));
+  }
+  EXPECT_EQ(get_param_names(chains), get_param_names(draws));
+
+  std::vector<int> cols(chains.num_params());
+  std::iota(cols.begin(), cols.end(), 0);
+  Eigen::MatrixXd stats(cols.size(), get_header(pcts).size());
+  Eigen::MatrixXd stats_float(cols.size(), get_header(pcts).size());
+  get_stats(chains, sampling_times, probs, cols, stats);
+  get_stats(draws, sampling_times, probs, cols, stats_float);
+
+  // Draws are rounded to float, so the mean and quantiles may move by
+  // a few float ulps of the draws and the ESS and R-hat by a relative
+  // amount of the same order.  Differences are reported per statistic.
+  std::vector<std::string> header = get_header(pcts);
+  for (int j = 0; j < stats.cols(); ++j) {
+    double max_abs_diff = 0;
+    double max_rel_diff = 0;
+    for (int i = 0; i < stats.rows(); ++i) {
+      // constant columns, e.g. stepsize__, have undefined ESS and R-hat
+      if (std::isnan(stats(i, j)) && std::isnan(stats_float(i, j)))
+        continue;
+      double scale = std::max(1.0, std::fabs(stats(i, j)));
+      double diff = std::fabs(stats(i, j) - stats_float(i, j));
+      max_abs_diff = std::max(max_abs_diff, diff);
+      max_rel_diff = std::max(max_rel_diff, diff / scale);
+      if (j == 0 || j == 2) {
+        // mean, sd: accumulated in double from rounded draws
+        EXPECT_NEAR(stats(i, j), stats_float(i, j), 1e-5 * scale)
+            << chains.param_name(i) << " " << header[j];
+      } else if (j >= 3 && j < 3 + static_cast<int>(pcts.size())) {
+        // quantiles are order statistics of the rounded draws
+        EXPECT_NEAR(stats(i, j), stats_float(i, j),
+                    0.05 * stats(i, 2) + 1e-5 * scale)
+            << chains.param_name(i) << " " << header[j];
+      } else {
+        // mcse, ess, ess/s, r-hat
+        EXPECT_NEAR(stats(i, j), stats_float(i, j), 1e-3 * scale)
+            << chains.param_name(i) << " " << header[j];
+      }
+    }
+    RecordProperty("max_abs_diff_" + header[j], std::to_string(max_abs_diff));
+    std::cout << "single precision " << header[j]
+              << ": max abs diff = " << max_abs_diff
+              << ", max rel diff = " << max_rel_diff << std::endl;
+  }
+}
+
+TEST(CommandStansummary, check_single_precision_output) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::string command = "bin" + path_separator + "stansummary";
+  std::string csv_file = "src" + path_separator + "test" + path_separator
+                         + "interface" + path_separator + "example_output"
+                         + path_separator + "bernoulli_chain_1.csv";
+
+  run_command_output expected = run_command(command + " " + csv_file);
+  ASSERT_FALSE(expected.hasError)
+      << "\"" << expected.command << "\" quit with an error";
+  run_command_output out
+      = run_command(command + " --single_precision " + csv_file);
+  ASSERT_FALSE(out.hasError) << "\"" << out.command << "\" quit with an error";
+
+  // same report layout and run information
+  EXPECT_EQ(expected.header, out.header);
+  std::istringstream expected_stream(expected.body);
+  std::istringstream out_stream(out.body);
+  std::string expected_line;
+  std::string line;
+  while (std::getline(expected_stream, expected_line)) {
+    ASSERT_TRUE(static_cast<bool>(std::getline(out_stream, line)));
+    std::string expected_name
+        = expected_line.substr(0, expected_line.find(' '));
+    EXPECT_EQ(expected_name, line.substr(0, line.find(' ')));
+  }
+  EXPECT_FALSE(static_cast<bool>(std::getline(out_stream, line)));
+}
+
+TEST(CommandStansummary, summary_draws_matches_chains) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::vector<std::string> pcts = {"5", "50", "95"};
+  Eigen::VectorXd probs = percentiles_to_probs(pcts);
+  std::vector<std::string> filenames;
+  filenames.push_back("src" + path_separator + "test" + path_separator
+                      + "interface" + path_separator + "example_output"
+                      + path_separator + "mix_output.1.csv");
+  filenames.push_back("src" + path_separator + "test" + path_separator
+                      + "interface" + path_separator + "example_output"
+                      + path_separator + "mix_output.2.csv");
+  stan::io::stan_csv_metadata metadata;
+  Eigen::VectorXd warmup_times(filenames.size());
+  Eigen::VectorXd sampling_times(filenames.size());
+  Eigen::VectorXi thin(filenames.size());
+
+  stan::mcmc::chains<> chains = parse_csv_files(
+      filenames, metadata, warmup_times, sampling_times, thin, &std::cout);
+  // parsed draws are moved into the container, not copied
+  auto draws = parse_csv_files<cmdstan::summary_draws<>>(
+      filenames, metadata, warmup_times, sampling_times, thin, &std::cout);
+  ASSERT_EQ(chains.num_chains(), draws.num_chains());
+  ASSERT_EQ(chains.num_params(), draws.num_params());
+  for (int chain = 0; chain < chains.num_chains(); ++chain)
+    EXPECT_EQ(chains.num_samples(chain), draws.num_samples(chain));
+
+  std::vector<int> cols(chains.num_params());
+  std::iota(cols.begin(), cols.end(), 0);
+  Eigen::MatrixXd stats(cols.size(), get_header(pcts).size());
+  Eigen::MatrixXd stats_draws(cols.size(), get_header(pcts).size());
+  get_stats(chains, sampling_times, probs, cols, stats);
+  get_stats(draws, sampling_times, probs, cols, stats_draws);
+  for (int i = 0; i < stats.rows(); ++i) {
+    for (int j = 0; j < stats.cols(); ++j) {
+      if (std::isnan(stats(i, j))) {
+        EXPECT_TRUE(std::isnan(stats_draws(i, j)));
+      } else {
+        EXPECT_NEAR(stats(i, j), stats_draws(i, j),
+                    1e-12 * std::max(1.0, std::fabs(stats(i, j))))
+            << chains.param_name(i) << " " << j;
+      }
+    }
+  }
+}
+
+TEST(CommandStansummary, compute_autocorrelations) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::vector<std::string> filenames;
+  filenames.push_back("src" + path_separator + "test" + path_separator
+                      + "interface" + path_separator + "example_output"
+                      + path_separator + "mix_output.1.csv");
+  filenames.push_back("src" + path_separator + "test" + path_separator
+                      + "interface" + path_separator + "example_output"
+                      + path_separator + "mix_output.2.csv");
+  stan::io::stan_csv_metadata metadata;
+  Eigen::VectorXd warmup_times(filenames.size());
+  Eigen::VectorXd sampling_times(filenames.size());
+  Eigen::VectorXi thin(filenames.size());
+  stan::mcmc::chains<> chains = parse_csv_files(
+      filenames, metadata, warmup_times, sampling_times, thin, &std::cout);
+
+  int max_lag = 20;
+  std::vector<Eigen::MatrixXd> acfs
+      = cmdstan::compute_autocorrelations(chains, max_lag);
+  ASSERT_EQ(2U, acfs.size());
+  for (int chain = 0; chain < chains.num_chains(); ++chain) {
+    ASSERT_EQ(chains.num_params(), acfs[chain].rows());
+    ASSERT_EQ(max_lag + 1, acfs[chain].cols());
+    for (int i = 0; i < chains.num_params(); ++i) {
+      Eigen::VectorXd expected = chains.autocorrelation(chain, i);
+      for (int lag = 0; lag <= max_lag; ++lag) {
+        if (std::isnan(expected(lag)))
+          EXPECT_TRUE(std::isnan(acfs[chain](i, lag)));
+        else
+          EXPECT_NEAR(expected(lag), acfs[chain](i, lag), 1e-10)
+              << chains.param_name(i) << " lag " << lag;
+      }
+    }
+  }
+
+  // lags are truncated at the number of draws
+  acfs = cmdstan::compute_autocorrelations(chains, 100000);
+  EXPECT_EQ(chains.num_kept_samples(0), acfs[0].cols());
+  EXPECT_THROW(cmdstan::compute_autocorrelations(chains, -1),
+               std::invalid_argument);
+
+  std::stringstream ss;
+  acfs = cmdstan::compute_autocorrelations(chains, max_lag);
+  std::vector<Eigen::MatrixXd> ess
+      = cmdstan::compute_autocorrelation_ess(chains, acfs);
+  ASSERT_EQ(2U, ess.size());
+  EXPECT_EQ(chains.num_params(), ess[0].rows());
+  EXPECT_EQ(2, ess[0].cols());
+  cmdstan::write_autocorrelations_binary(get_param_names(chains), acfs, ess,
+                                         ss);
+  std::vector<std::string> names;
+  std::vector<Eigen::MatrixXd> acfs_read;
+  std::vector<Eigen::MatrixXd> ess_read;
+  cmdstan::read_autocorrelations_binary(ss, names, acfs_read, ess_read);
+  EXPECT_EQ(get_param_names(chains), names);
+  ASSERT_EQ(acfs.size(), acfs_read.size());
+  ASSERT_EQ(ess.size(), ess_read.size());
+  for (size_t chain = 0; chain < acfs.size(); ++chain) {
+    EXPECT_TRUE(acfs[chain].isApprox(acfs_read[chain]));
+    EXPECT_TRUE(ess[chain].isApprox(ess_read[chain]));
+  }
+}
+
+TEST(CommandStansummary, autocorrelation_ess) {
+  // the integrated autocorrelation time of an AR(1) process with
+  // coefficient 0.5 is (1 + 0.5) / (1 - 0.5) = 3
+  int num_draws = 1000;
+  Eigen::RowVectorXd acf(num_draws);
+  for (int lag = 0; lag < num_draws; ++lag)
+    acf(lag) = std::pow(0.5, lag);
+  Eigen::Vector2d ess = cmdstan::autocorrelation_ess(acf, num_draws);
+  EXPECT_NEAR(num_draws / 3.0, ess(0), 1e-8);
+  EXPECT_EQ(num_draws - 3, ess(1));
+
+  // the sum is truncated at the largest lag
+  ess = cmdstan::autocorrelation_ess(acf.head(11), num_draws);
+  EXPECT_EQ(9, ess(1));
+
+  // uncorrelated draws
+  acf.setZero();
+  acf(0) = 1;
+  ess = cmdstan::autocorrelation_ess(acf, num_draws);
+  EXPECT_FLOAT_EQ(num_draws, ess(0));
+  EXPECT_EQ(3, ess(1));
+
+  // constant draws
+  acf.setConstant(std::numeric_limits<double>::quiet_NaN());
+  EXPECT_TRUE(std::isnan(cmdstan::autocorrelation_ess(acf, num_draws)(0)));
+}
+
+TEST(CommandStansummary, check_autocorr_file_output) {
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::string command = "bin" + path_separator + "stansummary";
+  std::string csv_file = "src" + path_separator + "test" + path_separator
+                         + "interface" + path_separator + "example_output"
+                         + path_separator + "bernoulli_chain_1.csv";
+  std::string target_file = "src" + path_separator + "test" + path_separator
+                            + "interface" + path_separator + "example_output"
+                            + path_separator + "tmp_test_autocorr_file.csv";
+
+  run_command_output out
+      = run_command(command + " --autocorr_file " + target_file
+                    + " --max_lag 10 " + csv_file);
+  ASSERT_FALSE(out.hasError) << "\"" << out.command << "\" quit with an error";
+
+  std::ifstream target_stream(target_file.c_str());
+  ASSERT_TRUE(target_stream.is_open());
+  std::string line;
+  std::getline(target_stream, line);
+  EXPECT_EQ(
+      "chain,lag,\"lp__\",\"accept_stat__\",\"stepsize__\",\"treedepth__\","
+      "\"n_leapfrog__\",\"divergent__\",\"energy__\",\"theta\"",
+      line);
+  std::getline(target_stream, line);
+  EXPECT_EQ(0U, line.find("1,0,1,1,"));
+  int num_lines = 1;
+  while (std::getline(target_stream, line)) {
+    ++num_lines;
+    if (num_lines == 12)
+      EXPECT_EQ(0U, line.find("1,ess,"));
+    if (num_lines == 13)
+      EXPECT_EQ(0U, line.find("1,ess_lag,"));
+  }
+  EXPECT_EQ(13, num_lines);
+  target_stream.close();
+  EXPECT_EQ(0, std::remove(target_file.c_str()));
+}
+
+TEST(CommandStansummary, header_index) {
+  std::vector<std::string> names
+      = {"lp__", "mu",     "theta[1]", "theta[2]", "theta[3]", "z[1,1]",
+         "z[2,1]", "z[1,2]", "z[2,2]", "z[1,3]",   "z[2,3]",   "sigma"};
+  header_index index = make_header_index(names);
+  ASSERT_EQ(5U, index.variables.size());
+  EXPECT_EQ("lp__", index.variables[0].name);
+  EXPECT_TRUE(index.variables[0].dims.empty());
+  EXPECT_EQ("theta", index.variables[2].name);
+  EXPECT_EQ(std::vector<int>({3}), index.variables[2].dims);
+  EXPECT_EQ(2, index.variables[2].first_column);
+  EXPECT_EQ(3, index.variables[2].num_columns);
+  EXPECT_EQ("z", index.variables[3].name);
+  EXPECT_EQ(std::vector<int>({2, 3}), index.variables[3].dims);
+  EXPECT_EQ(5, index.variables[3].first_column);
+  EXPECT_EQ(6, index.variables[3].num_columns);
+  EXPECT_EQ("sigma", index.variables[4].name);
+
+  EXPECT_EQ(3, index.column_variable[6]);
+  EXPECT_EQ(1, index.column_offset[6]);
+  EXPECT_EQ(std::vector<int>({2, 3}), dimensions(index, 5));
+
+  // row-major traversal agrees with next_index / matrix_index
+  std::vector<int> dims = {3, 4, 2};
+  variable_info var;
+  var.name = "a";
+  var.dims = dims;
+  var.first_column = 0;
+  var.num_columns = 24;
+  std::vector<int> offsets = row_major_offsets(var);
+  std::vector<int> idx(dims.size(), 1);
+  for (int k = 0; k < 24; ++k) {
+    EXPECT_EQ(matrix_index(idx, dims), offsets[k]);
+    if (k < 23)
+      next_index(idx, dims);
+  }
+  EXPECT_EQ(std::vector<int>({0, 2, 4, 1, 3, 5}),
+            row_major_offsets(index.variables[3]));
+}
+
+TEST(CommandStansummary, check_console_output_include_container) {
+  // containers are included element by element, not by name
+  std::string path_separator;
+  path_separator.push_back(get_path_separator());
+  std::string command = "bin" + path_separator + "stansummary";
+  std::string csv_file = "src" + path_separator + "test" + path_separator
+                         + "interface" + path_separator + "example_output"
+                         + path_separator + "eight_schools_output.csv";
+
+  run_command_output out = run_command(command + " -i theta " + csv_file);
+  EXPECT_TRUE(out.hasError);
+  EXPECT_NE(std::string::npos,
+            out.output.find("Unrecognized parameter(s): 'theta'"));
+}
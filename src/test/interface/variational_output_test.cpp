@@ -74,3 +74,26 @@ TEST_F(CmdStan, variational_fullrank) {
   ASSERT_EQ(1, chains.num_chains());
   ASSERT_EQ(1001, chains.num_samples());
 }
+
+TEST_F(CmdStan, variational_multi) {
+  run_command_output out
+      = run_command(base_command + " variational num_chains=3");
+
+  ASSERT_EQ(0, out.err_code);
+
+  stan::mcmc::chains<> chains = parse_output_file();
+  ASSERT_EQ(1, chains.num_chains());
+  ASSERT_EQ(1001, chains.num_samples());
+  std::ifstream combined(output_file);
+  std::stringstream contents;
+  contents << combined.rdbuf();
+  EXPECT_NE(contents.str().find("best of 3 runs"), std::string::npos);
+
+  for (int i = 1; i <= 3; ++i) {
+    std::ifstream run_stream("test/output_" + std::to_string(i) + ".csv");
+    ASSERT_TRUE(run_stream.good());
+    stan::io::stan_csv parsed_run
+        = stan::io::stan_csv_reader::parse(run_stream, 0);
+    EXPECT_EQ(1001, parsed_run.samples.rows());
+  }
+}